@@ -0,0 +1,223 @@
+/**
+ * cache-compress.h - Codifiche compatte per i file della cache L2 di Mini-Rosetta
+ *
+ * - Interi a lunghezza variabile (LEB128) e zigzag per le differenze con segno:
+ *   le tabelle di entrate e rilocazioni sono indirizzi vicini e piccoli contatori.
+ * - Compressore a blocchi nel formato LZ4 block (sequenze token / letterali /
+ *   offset / lunghezza del match), senza dipendenze esterne. La compressione usa
+ *   una tabella hash a un solo candidato; la decompressione verifica ogni
+ *   lunghezza e offset, quindi un input corrotto non scrive fuori dal buffer.
+ */
+
+#ifndef CACHE_COMPRESS_H
+#define CACHE_COMPRESS_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+using byte = uint8_t;
+
+// Aggiunge un intero senza segno in LEB128
+inline void put_varint(std::vector<byte>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<byte>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<byte>(value));
+}
+
+// Legge un intero LEB128 da data[pos, size); false se troncato o troppo lungo
+inline bool get_varint(const byte* data, size_t size, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos >= size) {
+            return false;
+        }
+        byte b = data[pos++];
+        value |= uint64_t(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Differenza con segno in un intero senza segno piccolo per valori vicini a 0
+inline uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Aggiunge un valore a 64 bit così com'è (hash e checksum non si comprimono)
+inline void put_u64(std::vector<byte>& out, uint64_t value) {
+    size_t pos = out.size();
+    out.resize(pos + sizeof(value));
+    memcpy(out.data() + pos, &value, sizeof(value));
+}
+
+inline bool get_u64(const byte* data, size_t size, size_t& pos, uint64_t& value) {
+    if (pos > size || size - pos < sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, data + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+// Compressore LZ4 block
+class BlockCompressor {
+public:
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr size_t LAST_LITERALS = 5;  // Byte finali sempre letterali
+    static constexpr size_t MATCH_LIMIT = 12;   // Un match non inizia negli ultimi 12 byte
+    static constexpr size_t MAX_OFFSET = 65535;
+    static constexpr unsigned HASH_BITS = 12;
+
+private:
+    static uint32_t read32(const byte* p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t hash(uint32_t value) {
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Lunghezza oltre 15 nel campo del token: serie di 255 più il resto
+    static void put_length(std::vector<byte>& out, size_t length) {
+        while (length >= 255) {
+            out.push_back(255);
+            length -= 255;
+        }
+        out.push_back(static_cast<byte>(length));
+    }
+
+    static bool get_length(const byte* src, size_t size, size_t& pos, size_t& length) {
+        byte b;
+        do {
+            if (pos >= size) {
+                return false;
+            }
+            b = src[pos++];
+            length += b;
+        } while (b == 255);
+        return true;
+    }
+
+    // Sequenza: letterali src[anchor, anchor + literals) seguiti da un match (match_length 0 = ultima)
+    static void put_sequence(std::vector<byte>& out, const byte* literals, size_t literal_length,
+                             size_t offset, size_t match_length) {
+        size_t token_pos = out.size();
+        out.push_back(0);
+        byte token = static_cast<byte>(std::min<size_t>(literal_length, 15) << 4);
+        if (literal_length >= 15) {
+            put_length(out, literal_length - 15);
+        }
+        out.insert(out.end(), literals, literals + literal_length);
+
+        if (match_length > 0) {
+            out.push_back(static_cast<byte>(offset));
+            out.push_back(static_cast<byte>(offset >> 8));
+            size_t extra = match_length - MIN_MATCH;
+            token |= static_cast<byte>(std::min<size_t>(extra, 15));
+            if (extra >= 15) {
+                put_length(out, extra - 15);
+            }
+        }
+        out[token_pos] = token;
+    }
+
+public:
+    // Comprime src[0, size) aggiungendo il risultato a out
+    static void compress(const byte* src, size_t size, std::vector<byte>& out) {
+        size_t anchor = 0;
+        if (size > MATCH_LIMIT) {
+            uint32_t table[1u << HASH_BITS] = {};  // Posizione + 1 (0 = vuoto)
+            size_t limit = size - MATCH_LIMIT;
+            size_t pos = 0;
+            while (pos <= limit) {
+                uint32_t value = read32(src + pos);
+                uint32_t& slot = table[hash(value)];
+                size_t candidate = slot;
+                slot = static_cast<uint32_t>(pos + 1);
+
+                if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || read32(src + candidate - 1) != value) {
+                    pos++;
+                    continue;
+                }
+
+                size_t ref = candidate - 1;
+                size_t length = MIN_MATCH;
+                while (pos + length < size - LAST_LITERALS && src[ref + length] == src[pos + length]) {
+                    length++;
+                }
+                put_sequence(out, src + anchor, pos - anchor, pos - ref, length);
+                pos += length;
+                anchor = pos;
+            }
+        }
+        put_sequence(out, src + anchor, size - anchor, 0, 0);
+    }
+
+    // Decomprime src[0, size) in dst, che deve risultare riempito esattamente
+    static bool decompress(const byte* src, size_t size, byte* dst, size_t dst_size) {
+        size_t in = 0;
+        size_t out = 0;
+        while (in < size) {
+            byte token = src[in++];
+
+            size_t literal_length = token >> 4;
+            if (literal_length == 15 && !get_length(src, size, in, literal_length)) {
+                return false;
+            }
+            if (literal_length > size - in || literal_length > dst_size - out) {
+                return false;
+            }
+            if (literal_length > 0) {
+                memcpy(dst + out, src + in, literal_length);
+            }
+            in += literal_length;
+            out += literal_length;
+
+            // L'ultima sequenza non ha match
+            if (in == size) {
+                break;
+            }
+
+            if (size - in < 2) {
+                return false;
+            }
+            size_t offset = src[in] | (size_t(src[in + 1]) << 8);
+            in += 2;
+            size_t match_length = token & 15;
+            if (match_length == 15 && !get_length(src, size, in, match_length)) {
+                return false;
+            }
+            match_length += MIN_MATCH;
+            if (offset == 0 || offset > out || match_length > dst_size - out) {
+                return false;
+            }
+
+            // Il match può sovrapporsi all'output che sta producendo
+            const byte* match = dst + out - offset;
+            if (offset >= match_length) {
+                memcpy(dst + out, match, match_length);
+            } else {
+                for (size_t i = 0; i < match_length; i++) {
+                    dst[out + i] = match[i];
+                }
+            }
+            out += match_length;
+        }
+        return out == dst_size;
+    }
+};
+
+#endif // CACHE_COMPRESS_H
@@ -0,0 +1,886 @@
+/**
+ * cache-daemon.h - Daemon di traduzione di Mini-Rosetta
+ *
+ * Senza daemon ogni processo apre la directory di cache, scrive i log L2 e
+ * compatta i file con il proprio PersistenceManager: N processi dello stesso
+ * binario ripetono lo stesso lavoro e si contendono i file sotto flock. Il
+ * TranslationDaemon è un processo di lunga durata che possiede la directory:
+ * scrive i log, esegue manutenzione e compattazione e prepara per ogni binario
+ * e set di regole una regione di codice condivisa (SharedCodeCache anonima),
+ * che riempie in anticipo con le traduzioni correnti del file L2 senza
+ * rilocazioni. Restano attive le regioni degli ultimi MAX_REGIONS_PER_BINARY
+ * set di regole richiesti.
+ *
+ * I client si collegano a un socket Unix (SOCK_STREAM). Per ogni binario
+ * ricevono con SCM_RIGHTS i descrittori del file L2, del suo log (in sola
+ * lettura) e della regione condivisa, che mappano direttamente: le ricerche
+ * non passano dal daemon. Le nuove traduzioni tornano al daemon come record del
+ * log L2 (nel formato di L2LogSegment::encode), a lotti. I client mappano i
+ * file in sola lettura: i contatori di esecuzione dei loro hit tornano al
+ * daemon come L2HitRecord, che li applica alla propria mappatura.
+ *
+ * Messaggio: [DaemonMessageHeader][payload]
+ *   ATTACH: DaemonAttachRequest          -> REPLY DaemonAttachReply + descrittori
+ *   APPEND: DaemonAppendHeader + record  (nessuna risposta)
+ *   FLUSH:  vuoto                        -> REPLY DaemonAttachReply (solo status)
+ *   HITS:   DaemonHitsHeader + L2HitRecord (nessuna risposta)
+ *
+ * La traduzione resta nei client, che possiedono l'immagine guest e il
+ * traduttore; il daemon non esegue codice guest.
+ */
+
+#ifndef CACHE_DAEMON_H
+#define CACHE_DAEMON_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cache-l2.h"
+#include "cache-shm.h"
+#include "cache-persistence.h"
+
+// Header di un messaggio tra client e daemon
+struct DaemonMessageHeader {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t payload_size;
+};
+
+// Richiesta di collegamento a un binario
+struct DaemonAttachRequest {
+    uint64_t image_hash;
+    uint64_t image_size;
+    uint64_t rules_fingerprint;
+    char binary_id[128];
+};
+
+// Risposta del daemon; per ATTACH è seguita dai descrittori indicati in fd_mask
+struct DaemonAttachReply {
+    int32_t status;           // 0 = successo
+    uint32_t fd_mask;         // DAEMON_FD_*: descrittori allegati, in quest'ordine
+    char cache_file[256];     // Percorso del file L2 nella directory del daemon
+};
+
+// Header di un lotto di record del log L2, seguito dai record serializzati
+struct DaemonAppendHeader {
+    char binary_id[128];
+    uint32_t record_count;
+    uint32_t reserved;
+};
+
+// Header di un lotto di contatori di esecuzione, seguito da record_count L2HitRecord
+struct DaemonHitsHeader {
+    char binary_id[128];
+    uint32_t record_count;
+    uint32_t reserved;
+    uint64_t file_hits;       // Hit totali del file, comprese le entrate del log
+};
+
+constexpr uint32_t DAEMON_MAGIC = 0x4E454144;  // "DAEN" in hex
+constexpr uint32_t DAEMON_MSG_ATTACH = 1;
+constexpr uint32_t DAEMON_MSG_APPEND = 2;
+constexpr uint32_t DAEMON_MSG_FLUSH = 3;
+constexpr uint32_t DAEMON_MSG_REPLY = 4;
+constexpr uint32_t DAEMON_MSG_HITS = 5;
+
+constexpr uint32_t DAEMON_FD_CACHE_FILE = 1u << 0;
+constexpr uint32_t DAEMON_FD_CACHE_LOG = 1u << 1;
+constexpr uint32_t DAEMON_FD_SHARED_CODE = 1u << 2;
+
+// Trasporto dei messaggi sul socket, con descrittori allegati
+class DaemonChannel {
+public:
+    static constexpr size_t MAX_FDS = 3;
+    static constexpr uint64_t MAX_PAYLOAD = 64 * 1024 * 1024;
+
+#if defined(__linux__)
+    static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static constexpr int SEND_FLAGS = 0;   // SIGPIPE è disattivato sul socket (SO_NOSIGPIPE)
+#endif
+
+    // Imposta FD_CLOEXEC; sui sistemi senza SOCK_CLOEXEC e MSG_CMSG_CLOEXEC il
+    // descrittore resta ereditabile per un istante dopo la sua creazione
+    static void set_cloexec(int fd) {
+        int flags = fcntl(fd, F_GETFD);
+        if (flags >= 0) {
+            fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+        }
+    }
+
+    // Crea un socket Unix di tipo stream chiuso all'exec, che non genera SIGPIPE
+    static int open_socket() {
+#if defined(__linux__)
+        return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            set_cloexec(fd);
+#ifdef SO_NOSIGPIPE
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        }
+        return fd;
+#endif
+    }
+
+    // Accetta una connessione sul socket in ascolto (chiusa all'exec)
+    static int accept_connection(int listen_fd) {
+#if defined(__linux__)
+        return accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+#else
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0) {
+            set_cloexec(fd);
+#ifdef SO_NOSIGPIPE
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        }
+        return fd;
+#endif
+    }
+
+    // Invia un messaggio; i descrittori viaggiano con il primo byte
+    static bool send_message(int socket_fd, uint32_t type, const void* payload, size_t payload_size,
+                             const std::vector<int>& fds = {}) {
+        DaemonMessageHeader header;
+        header.magic = DAEMON_MAGIC;
+        header.type = type;
+        header.payload_size = payload_size;
+
+        std::vector<byte> data(sizeof(header) + payload_size);
+        memcpy(data.data(), &header, sizeof(header));
+        if (payload_size > 0) {
+            memcpy(data.data() + sizeof(header), payload, payload_size);
+        }
+
+        size_t sent = 0;
+        while (sent < data.size()) {
+            struct iovec iov;
+            iov.iov_base = data.data() + sent;
+            iov.iov_len = data.size() - sent;
+
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+
+            alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+            if (sent == 0 && !fds.empty()) {
+                if (fds.size() > MAX_FDS) {
+                    return false;
+                }
+                memset(control, 0, sizeof(control));
+                msg.msg_control = control;
+                msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+                struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+                memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+            }
+
+            ssize_t written = sendmsg(socket_fd, &msg, SEND_FLAGS);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            sent += written;
+        }
+        return true;
+    }
+
+    // Riceve un messaggio; i descrittori ricevuti sono aggiunti a fds (chiusi all'exec)
+    static bool receive_message(int socket_fd, DaemonMessageHeader& header, std::vector<byte>& payload,
+                                std::vector<int>& fds) {
+        byte* target = reinterpret_cast<byte*>(&header);
+        size_t received = 0;
+        while (received < sizeof(header)) {
+            struct iovec iov;
+            iov.iov_base = target + received;
+            iov.iov_len = sizeof(header) - received;
+
+            alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+#if defined(__linux__)
+            ssize_t count = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+#else
+            ssize_t count = recvmsg(socket_fd, &msg, 0);
+#endif
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return false;
+            }
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                    size_t count_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                    for (size_t i = 0; i < count_fds; i++) {
+                        int fd;
+                        memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+#if !defined(__linux__)
+                        set_cloexec(fd);
+#endif
+                        fds.push_back(fd);
+                    }
+                }
+            }
+            received += count;
+        }
+        if (header.magic != DAEMON_MAGIC || header.payload_size > MAX_PAYLOAD) {
+            return false;
+        }
+
+        payload.resize(header.payload_size);
+        received = 0;
+        while (received < payload.size()) {
+            ssize_t count = recv(socket_fd, payload.data() + received, payload.size() - received, 0);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return false;
+            }
+            received += count;
+        }
+        return true;
+    }
+
+    // Copia una stringa in un campo a dimensione fissa, terminato da zero
+    template <size_t N>
+    static bool copy_string(char (&field)[N], const std::string& value) {
+        if (value.size() >= N) {
+            return false;
+        }
+        memset(field, 0, N);
+        memcpy(field, value.data(), value.size());
+        return true;
+    }
+
+    template <size_t N>
+    static std::string read_string(const char (&field)[N]) {
+        return std::string(field, strnlen(field, N));
+    }
+};
+
+// Descrittori ricevuti dal daemon per un binario (di cui il chiamante prende possesso)
+struct DaemonAttachment {
+    int cache_fd = -1;
+    int log_fd = -1;
+    int shared_code_fd = -1;
+    std::string cache_file;
+};
+
+// Lato client del protocollo. Thread-safe: una richiesta alla volta sul socket.
+class TranslationDaemonClient {
+public:
+    static constexpr size_t APPEND_BATCH_BYTES = 256 * 1024;
+    static constexpr size_t MAX_HITS_PER_MESSAGE = 64 * 1024;
+
+private:
+    int socket_fd = -1;
+    std::string socket_path;
+    std::mutex mutex;  // Serializza le richieste e protegge i lotti in attesa
+
+    // Record in attesa per binario, già serializzati
+    struct PendingBatch {
+        std::vector<byte> data;
+        uint32_t record_count = 0;
+    };
+    std::unordered_map<std::string, PendingBatch> pending;
+    size_t pending_bytes = 0;
+
+    // Invia i lotti in attesa (mutex acquisito)
+    bool send_pending_locked() {
+        bool ok = socket_fd >= 0;
+        for (auto& [binary_id, batch] : pending) {
+            DaemonAppendHeader header;
+            if (!ok || !DaemonChannel::copy_string(header.binary_id, binary_id)) {
+                ok = false;
+                continue;
+            }
+            header.record_count = batch.record_count;
+            header.reserved = 0;
+            std::vector<byte> payload(sizeof(header) + batch.data.size());
+            memcpy(payload.data(), &header, sizeof(header));
+            memcpy(payload.data() + sizeof(header), batch.data.data(), batch.data.size());
+            ok = DaemonChannel::send_message(socket_fd, DAEMON_MSG_APPEND, payload.data(), payload.size());
+        }
+        pending.clear();
+        pending_bytes = 0;
+        if (!ok) {
+            disconnect_locked();
+        }
+        return ok;
+    }
+
+    // Attende la risposta a una richiesta (mutex acquisito)
+    bool receive_reply_locked(DaemonAttachReply& reply, std::vector<int>& fds) {
+        DaemonMessageHeader header;
+        std::vector<byte> payload;
+        if (!DaemonChannel::receive_message(socket_fd, header, payload, fds) ||
+            header.type != DAEMON_MSG_REPLY || payload.size() != sizeof(reply)) {
+            for (int fd : fds) {
+                ::close(fd);
+            }
+            fds.clear();
+            disconnect_locked();
+            return false;
+        }
+        memcpy(&reply, payload.data(), sizeof(reply));
+        return true;
+    }
+
+    void disconnect_locked() {
+        if (socket_fd >= 0) {
+            ::close(socket_fd);
+            std::cerr << "Connessione con il daemon di traduzione persa" << std::endl;
+        }
+        socket_fd = -1;
+    }
+
+public:
+    TranslationDaemonClient() = default;
+    TranslationDaemonClient(const TranslationDaemonClient&) = delete;
+    TranslationDaemonClient& operator=(const TranslationDaemonClient&) = delete;
+
+    ~TranslationDaemonClient() {
+        flush();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (socket_fd >= 0) {
+            ::close(socket_fd);
+        }
+    }
+
+    // Si collega al socket del daemon
+    bool connect(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        socket_path = path;
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        memcpy(address.sun_path, socket_path.data(), socket_path.size());
+
+        int fd = DaemonChannel::open_socket();
+        if (fd < 0) {
+            return false;
+        }
+        if (::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            return false;
+        }
+        if (socket_fd >= 0) {
+            ::close(socket_fd);
+        }
+        socket_fd = fd;
+        return true;
+    }
+
+    // Apre una nuova connessione al daemon, ad es. nel figlio di un fork, che non
+    // deve condividere il socket del padre. I record in attesa restano al padre.
+    bool reconnect() {
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (socket_fd >= 0) {
+                ::close(socket_fd);
+            }
+            socket_fd = -1;
+            pending.clear();
+            pending_bytes = 0;
+            path = socket_path;
+        }
+        return !path.empty() && connect(path);
+    }
+
+    bool is_connected() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return socket_fd >= 0;
+    }
+
+    // Chiede al daemon i descrittori della cache di un binario
+    bool attach(const std::string& binary_id, uint64_t image_hash, size_t image_size, uint64_t rules_fingerprint,
+                DaemonAttachment& attachment) {
+        DaemonAttachRequest request;
+        memset(&request, 0, sizeof(request));
+        request.image_hash = image_hash;
+        request.image_size = image_size;
+        request.rules_fingerprint = rules_fingerprint;
+        if (!DaemonChannel::copy_string(request.binary_id, binary_id)) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (socket_fd < 0 || !DaemonChannel::send_message(socket_fd, DAEMON_MSG_ATTACH, &request, sizeof(request))) {
+            disconnect_locked();
+            return false;
+        }
+
+        DaemonAttachReply reply;
+        std::vector<int> fds;
+        if (!receive_reply_locked(reply, fds)) {
+            return false;
+        }
+        size_t expected = __builtin_popcount(reply.fd_mask);
+        if (reply.status != 0 || fds.size() != expected) {
+            for (int fd : fds) {
+                ::close(fd);
+            }
+            return false;
+        }
+
+        size_t next = 0;
+        attachment.cache_fd = (reply.fd_mask & DAEMON_FD_CACHE_FILE) ? fds[next++] : -1;
+        attachment.log_fd = (reply.fd_mask & DAEMON_FD_CACHE_LOG) ? fds[next++] : -1;
+        attachment.shared_code_fd = (reply.fd_mask & DAEMON_FD_SHARED_CODE) ? fds[next++] : -1;
+        attachment.cache_file = DaemonChannel::read_string(reply.cache_file);
+        return true;
+    }
+
+    // Accoda un record per il log L2 del binario; i lotti sono inviati a
+    // APPEND_BATCH_BYTES o con flush
+    bool queue_record(const std::string& binary_id, const L2LogRecord& record) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (socket_fd < 0) {
+            return false;
+        }
+        PendingBatch& batch = pending[binary_id];
+        size_t before = batch.data.size();
+        L2LogSegment::encode(record, batch.data);
+        batch.record_count++;
+        pending_bytes += batch.data.size() - before;
+        return pending_bytes < APPEND_BATCH_BYTES || send_pending_locked();
+    }
+
+    // Invia al daemon i contatori di esecuzione raccolti per il file L2 del
+    // binario (vedi L2CacheFile::take_hits), in lotti di MAX_HITS_PER_MESSAGE
+    bool send_hits(const std::string& binary_id, const std::vector<L2HitRecord>& hits, uint64_t file_hits) {
+        DaemonHitsHeader header;
+        if (!DaemonChannel::copy_string(header.binary_id, binary_id)) {
+            return false;
+        }
+        header.reserved = 0;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t next = 0;
+        do {
+            size_t count = std::min(hits.size() - next, MAX_HITS_PER_MESSAGE);
+            header.record_count = static_cast<uint32_t>(count);
+            header.file_hits = (next == 0) ? file_hits : 0;
+            std::vector<byte> payload(sizeof(header) + count * sizeof(L2HitRecord));
+            memcpy(payload.data(), &header, sizeof(header));
+            if (count > 0) {
+                memcpy(payload.data() + sizeof(header), hits.data() + next, count * sizeof(L2HitRecord));
+            }
+            if (socket_fd < 0 || !DaemonChannel::send_message(socket_fd, DAEMON_MSG_HITS, payload.data(), payload.size())) {
+                disconnect_locked();
+                return false;
+            }
+            next += count;
+        } while (next < hits.size());
+        return true;
+    }
+
+    // Invia i record in attesa e attende che il daemon li abbia scritti nei log
+    bool flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (socket_fd < 0 || !send_pending_locked() ||
+            !DaemonChannel::send_message(socket_fd, DAEMON_MSG_FLUSH, nullptr, 0)) {
+            disconnect_locked();
+            return false;
+        }
+        DaemonAttachReply reply;
+        std::vector<int> fds;
+        return receive_reply_locked(reply, fds) && reply.status == 0;
+    }
+};
+
+// Daemon: possiede la directory di cache e serve i client sul socket
+class TranslationDaemon {
+public:
+    static constexpr size_t DEFAULT_SHARED_CODE_BYTES = 64 * 1024 * 1024;
+    static constexpr size_t MAX_REGIONS_PER_BINARY = 2;   // Set di regole serviti insieme (rollout)
+
+private:
+    // Regione condivisa con i client di un set di regole
+    struct SharedRegion {
+        std::shared_ptr<SharedCodeCache> shared_code;
+        uint64_t preloaded_creation_time = 0;           // File base già precaricato nella regione
+        uint64_t last_attach = 0;                       // Sequenza dell'ultimo collegamento
+    };
+
+    // Stato di un binario servito
+    struct ServedBinary {
+        std::string cache_file;
+        std::shared_ptr<L2CacheFile> file;              // Mappatura del daemon, con il log scrivibile
+        std::unordered_map<uint64_t, SharedRegion> regions; // Per impronta delle regole
+    };
+
+    std::string cache_directory;
+    std::string socket_path;
+    size_t shared_code_bytes;
+    PersistenceManager persistence;
+
+    std::unordered_map<std::string, ServedBinary> binaries;
+    std::mutex binaries_mutex;
+    uint64_t attach_sequence = 0;        // Protetto da binaries_mutex
+
+    int listen_fd = -1;
+    struct sockaddr_un listen_address;
+    std::atomic<bool> running{false};
+    std::thread accept_thread;
+    std::unordered_set<int> client_fds;  // Un thread (staccato) per client connesso
+    std::mutex clients_mutex;
+    std::condition_variable clients_done;
+
+    // Pubblica nella regione le traduzioni correnti del file senza rilocazioni
+    static size_t preload(const L2CacheFile& file, SharedCodeCache& shared_code, uint64_t rules_fingerprint) {
+        size_t published = 0;
+        file.for_each_entry([&](const CacheFileEntry& e) {
+            if (e.reloc_count > 0 || (e.flags & CACHE_ENTRY_NEEDS_PATCH) || !file.is_current(e, rules_fingerprint)) {
+                return;
+            }
+            const byte* code = file.code_of(e);
+            if (code && shared_code.publish(e.x86_offset, e.x86_hash, e.x86_size, rules_fingerprint, code, e.arm_size)) {
+                published++;
+            }
+        });
+        return published;
+    }
+
+    // Prepara file L2 e regione di un binario e ne raccoglie i descrittori per il client
+    bool attach_binary(const DaemonAttachRequest& request, DaemonAttachReply& reply, std::vector<int>& fds) {
+        std::string binary_id = DaemonChannel::read_string(request.binary_id);
+        if (binary_id.empty() || binary_id.find('/') != std::string::npos || binary_id.find("..") != std::string::npos) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(binaries_mutex);
+        ServedBinary& served = binaries[binary_id];
+        if (served.cache_file.empty()) {
+            served.cache_file = cache_directory + "/" + binary_id + ".cache";
+        }
+
+        // Il primo client di un binario nuovo trova un file vuoto, a cui il log si appoggia
+        if (!std::filesystem::exists(served.cache_file) &&
+            !L2CacheFile::write(served.cache_file, request.image_hash, request.rules_fingerprint, 0, {}, {}, {})) {
+            return false;
+        }
+
+        // Rimappato a ogni collegamento: la compattazione può aver sostituito il file
+        auto file = std::make_shared<L2CacheFile>();
+        if (!file->open(served.cache_file, request.image_hash)) {
+            return false;
+        }
+        bool replaced = !served.file ||
+                        served.file->file_header().creation_time != file->file_header().creation_time;
+        if (replaced) {
+            served.file = file;
+        }
+
+        // Una regione per set di regole: le regole nuove non riempiono quella delle precedenti
+        SharedRegion& region = served.regions[request.rules_fingerprint];
+        region.last_attach = ++attach_sequence;
+        if (!region.shared_code) {
+            auto shared_code = std::make_shared<SharedCodeCache>();
+            if (shared_code->create_anonymous(SharedCodeCache::name_for(binary_id, request.rules_fingerprint),
+                                              shared_code_bytes)) {
+                region.shared_code = shared_code;
+            }
+        }
+        uint64_t file_time = served.file->file_header().creation_time;
+        if (region.shared_code && region.preloaded_creation_time != file_time) {
+            size_t published = preload(*served.file, *region.shared_code, request.rules_fingerprint);
+            region.preloaded_creation_time = file_time;
+            std::cout << "Daemon: " << published << " traduzioni precaricate per " << binary_id << std::endl;
+        }
+        std::shared_ptr<SharedCodeCache> shared_code = region.shared_code;
+
+        // Le regioni delle regole non più richieste sono rilasciate dal daemon:
+        // i client collegati mantengono la propria mappatura finché non terminano
+        while (served.regions.size() > MAX_REGIONS_PER_BINARY) {
+            auto oldest = std::min_element(served.regions.begin(), served.regions.end(),
+                                           [](const auto& a, const auto& b) {
+                                               return a.second.last_attach < b.second.last_attach;
+                                           });
+            served.regions.erase(oldest);
+        }
+
+        reply.fd_mask = 0;
+        int cache_fd = ::open(served.cache_file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (cache_fd < 0) {
+            return false;
+        }
+        fds.push_back(cache_fd);
+        reply.fd_mask |= DAEMON_FD_CACHE_FILE;
+
+        int log_fd = ::open((served.cache_file + ".log").c_str(), O_RDONLY | O_CLOEXEC);
+        if (log_fd >= 0) {
+            fds.push_back(log_fd);
+            reply.fd_mask |= DAEMON_FD_CACHE_LOG;
+        }
+        if (shared_code) {
+            int region_fd = fcntl(shared_code->region_fd(), F_DUPFD_CLOEXEC, 0);
+            if (region_fd >= 0) {
+                fds.push_back(region_fd);
+                reply.fd_mask |= DAEMON_FD_SHARED_CODE;
+            }
+        }
+        return DaemonChannel::copy_string(reply.cache_file, served.cache_file);
+    }
+
+    // Accoda al log L2 del binario i record di un lotto
+    bool append_records(const std::vector<byte>& payload) {
+        DaemonAppendHeader header;
+        if (payload.size() < sizeof(header)) {
+            return false;
+        }
+        memcpy(&header, payload.data(), sizeof(header));
+        std::string binary_id = DaemonChannel::read_string(header.binary_id);
+
+        std::shared_ptr<L2CacheFile> file;
+        {
+            std::lock_guard<std::mutex> lock(binaries_mutex);
+            auto it = binaries.find(binary_id);
+            if (it == binaries.end() || !it->second.file) {
+                return false;
+            }
+            file = it->second.file;
+        }
+
+        size_t pos = sizeof(header);
+        for (uint32_t i = 0; i < header.record_count; i++) {
+            L2LogRecord record;
+            size_t size = L2LogSegment::decode(payload.data() + pos, payload.size() - pos, record);
+            if (size == 0) {
+                return false;
+            }
+            persistence.queue_log_record(binary_id, file, std::move(record));
+            pos += size;
+        }
+        return true;
+    }
+
+    // Applica alla mappatura del daemon i contatori di esecuzione di un client
+    bool apply_hits(const std::vector<byte>& payload) {
+        DaemonHitsHeader header;
+        if (payload.size() < sizeof(header)) {
+            return false;
+        }
+        memcpy(&header, payload.data(), sizeof(header));
+        if (payload.size() != sizeof(header) + uint64_t(header.record_count) * sizeof(L2HitRecord)) {
+            return false;
+        }
+        std::string binary_id = DaemonChannel::read_string(header.binary_id);
+
+        std::shared_ptr<L2CacheFile> file;
+        {
+            std::lock_guard<std::mutex> lock(binaries_mutex);
+            auto it = binaries.find(binary_id);
+            if (it == binaries.end() || !it->second.file) {
+                return false;
+            }
+            file = it->second.file;
+        }
+
+        std::vector<L2HitRecord> hits(header.record_count);
+        if (!hits.empty()) {
+            memcpy(hits.data(), payload.data() + sizeof(header), hits.size() * sizeof(L2HitRecord));
+        }
+        file->apply_hits(hits, header.file_hits);
+        return true;
+    }
+
+    // Serve un client fino alla disconnessione
+    void serve_client(int client_fd) {
+        while (running) {
+            DaemonMessageHeader header;
+            std::vector<byte> payload;
+            std::vector<int> received_fds;
+            bool received = DaemonChannel::receive_message(client_fd, header, payload, received_fds);
+            for (int fd : received_fds) {
+                ::close(fd);  // I client non inviano descrittori
+            }
+            if (!received) {
+                break;
+            }
+
+            DaemonAttachReply reply;
+            memset(&reply, 0, sizeof(reply));
+            std::vector<int> fds;
+            bool replied = true;
+            if (header.type == DAEMON_MSG_ATTACH && payload.size() == sizeof(DaemonAttachRequest)) {
+                DaemonAttachRequest request;
+                memcpy(&request, payload.data(), sizeof(request));
+                reply.status = attach_binary(request, reply, fds) ? 0 : -1;
+                if (reply.status != 0) {
+                    for (int fd : fds) {
+                        ::close(fd);
+                    }
+                    fds.clear();
+                    reply.fd_mask = 0;
+                }
+            } else if (header.type == DAEMON_MSG_APPEND) {
+                replied = false;
+                if (!append_records(payload)) {
+                    std::cerr << "Daemon: lotto di record non valido" << std::endl;
+                }
+            } else if (header.type == DAEMON_MSG_HITS) {
+                replied = false;
+                if (!apply_hits(payload)) {
+                    std::cerr << "Daemon: lotto di contatori non valido" << std::endl;
+                }
+            } else if (header.type == DAEMON_MSG_FLUSH) {
+                persistence.flush();
+            } else {
+                break;
+            }
+
+            bool sent = !replied || DaemonChannel::send_message(client_fd, DAEMON_MSG_REPLY, &reply, sizeof(reply), fds);
+            for (int fd : fds) {
+                ::close(fd);
+            }
+            if (!sent) {
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        client_fds.erase(client_fd);
+        ::close(client_fd);
+        clients_done.notify_all();
+    }
+
+    void accept_loop() {
+        while (running) {
+            int client_fd = DaemonChannel::accept_connection(listen_fd);
+            if (client_fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            if (!running) {
+                ::close(client_fd);
+                break;
+            }
+            client_fds.insert(client_fd);
+            std::thread(&TranslationDaemon::serve_client, this, client_fd).detach();
+        }
+    }
+
+public:
+    TranslationDaemon(const std::string& cache_dir, const std::string& socket, size_t region_bytes = 0)
+        : cache_directory(cache_dir), socket_path(socket),
+          shared_code_bytes(region_bytes > 0 ? region_bytes : DEFAULT_SHARED_CODE_BYTES),
+          persistence(cache_dir) {}
+
+    TranslationDaemon(const TranslationDaemon&) = delete;
+    TranslationDaemon& operator=(const TranslationDaemon&) = delete;
+
+    ~TranslationDaemon() {
+        stop();
+    }
+
+    // Crea il socket (accessibile solo all'utente) e avvia il thread di accettazione
+    bool start() {
+        struct sockaddr_un& address = listen_address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Percorso del socket troppo lungo: " << socket_path << std::endl;
+            return false;
+        }
+        memcpy(address.sun_path, socket_path.data(), socket_path.size());
+
+        listen_fd = DaemonChannel::open_socket();
+        if (listen_fd < 0) {
+            return false;
+        }
+        // Un socket rimasto da un daemon precedente viene sostituito
+        ::unlink(socket_path.c_str());
+        if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+            chmod(socket_path.c_str(), 0600) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+            std::cerr << "Impossibile avviare il daemon sul socket: " << socket_path << std::endl;
+            ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+
+        running = true;
+        accept_thread = std::thread(&TranslationDaemon::accept_loop, this);
+        std::cout << "Daemon di traduzione in ascolto su " << socket_path << std::endl;
+        return true;
+    }
+
+    // Chiude il socket, disconnette i client e scrive i record in attesa
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        // Sblocca accept collegandosi al socket: shutdown sul socket in ascolto
+        // lo sveglia solo su Linux (altrove fallisce con ENOTCONN)
+        int wake_fd = DaemonChannel::open_socket();
+        if (wake_fd >= 0) {
+            ::connect(wake_fd, reinterpret_cast<struct sockaddr*>(&listen_address), sizeof(listen_address));
+            ::close(wake_fd);
+        }
+        if (accept_thread.joinable()) {
+            accept_thread.join();
+        }
+        ::close(listen_fd);
+        listen_fd = -1;
+        ::unlink(socket_path.c_str());
+
+        {
+            std::unique_lock<std::mutex> lock(clients_mutex);
+            for (int fd : client_fds) {
+                shutdown(fd, SHUT_RDWR);
+            }
+            clients_done.wait(lock, [this] { return client_fds.empty(); });
+        }
+        persistence.flush();
+    }
+
+    PersistenceManager& persistence_manager() { return persistence; }
+
+    size_t served_binary_count() {
+        std::lock_guard<std::mutex> lock(binaries_mutex);
+        return binaries.size();
+    }
+};
+
+#endif // CACHE_DAEMON_H
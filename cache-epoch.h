@@ -0,0 +1,199 @@
+/**
+ * cache-epoch.h - Recupero della memoria basato su epoche per Mini-Rosetta
+ *
+ * I lettori delle strutture lock-free della cache annunciano l'epoca globale
+ * in uno slot per thread (operazioni wait-free, senza lock). Gli scrittori
+ * pubblicano le nuove versioni e "ritirano" quelle vecchie, che vengono
+ * liberate solo quando nessun lettore può ancora riferirle, cioè dopo che
+ * l'epoca globale è avanzata di due passi.
+ */
+
+#ifndef CACHE_EPOCH_H
+#define CACHE_EPOCH_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+class EpochManager {
+public:
+    static constexpr size_t MAX_READER_SLOTS = 1024;  // Thread lettori contemporanei supportati
+    static constexpr size_t RECLAIM_INTERVAL = 64;    // Ritiri tra due tentativi di recupero
+
+private:
+    // Slot di un thread lettore: epoca osservata (0 = fuori da sezione critica)
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> in_use{false};
+    };
+
+    // Oggetto ritirato in attesa che nessun lettore possa riferirlo
+    struct RetiredObject {
+        uint64_t epoch;
+        void* object;
+        void (*deleter)(void*);
+    };
+
+    // Stato per thread: slot assegnato e profondità di annidamento delle guardie
+    struct ThreadState {
+        ReaderSlot* slot = nullptr;
+        bool slot_claimed = false;
+        int depth = 0;
+
+        ~ThreadState() {
+            if (slot) {
+                slot->epoch.store(0, std::memory_order_release);
+                slot->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    std::atomic<uint64_t> global_epoch{1};
+    ReaderSlot slots[MAX_READER_SLOTS];
+
+    std::mutex retire_mutex;
+    std::vector<RetiredObject> retired;
+    size_t retires_since_reclaim = 0;
+
+    static ThreadState& thread_state() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    // Assegna uno slot al thread corrente alla prima lettura
+    ReaderSlot* claim_slot(ThreadState& state) {
+        if (!state.slot_claimed) {
+            state.slot_claimed = true;
+            for (auto& slot : slots) {
+                bool expected = false;
+                if (!slot.in_use.load(std::memory_order_relaxed) &&
+                    slot.in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                    state.slot = &slot;
+                    break;
+                }
+            }
+        }
+        return state.slot;
+    }
+
+    // Avanza l'epoca globale se tutti i lettori attivi l'hanno già osservata
+    bool try_advance() {
+        uint64_t current = global_epoch.load(std::memory_order_seq_cst);
+        for (const auto& slot : slots) {
+            uint64_t observed = slot.epoch.load(std::memory_order_seq_cst);
+            if (observed != 0 && observed != current) {
+                return false;
+            }
+        }
+        return global_epoch.compare_exchange_strong(current, current + 1, std::memory_order_seq_cst);
+    }
+
+    // Libera gli oggetti ritirati almeno due epoche fa (retire_mutex acquisito)
+    void reclaim_locked() {
+        try_advance();
+        uint64_t current = global_epoch.load(std::memory_order_seq_cst);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); i++) {
+            if (retired[i].epoch + 2 <= current) {
+                retired[i].deleter(retired[i].object);
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+
+public:
+    ~EpochManager() {
+        // Alla distruzione del processo non ci sono più lettori
+        for (auto& r : retired) {
+            r.deleter(r.object);
+        }
+    }
+
+    // Istanza condivisa dal processo
+    static EpochManager& instance() {
+        static EpochManager manager;
+        return manager;
+    }
+
+    // Entra in una sezione critica di lettura (wait-free). Restituisce false se
+    // non ci sono slot liberi: il chiamante deve usare un percorso con lock.
+    bool enter() {
+        ThreadState& state = thread_state();
+        if (state.depth > 0) {
+            state.depth++;
+            return true;
+        }
+
+        ReaderSlot* slot = claim_slot(state);
+        if (!slot) {
+            return false;
+        }
+
+        slot->epoch.store(global_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        state.depth = 1;
+        return true;
+    }
+
+    // Esce dalla sezione critica di lettura
+    void exit() {
+        ThreadState& state = thread_state();
+        if (--state.depth == 0) {
+            state.slot->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    // Ritira un oggetto già reso irraggiungibile per i nuovi lettori
+    void retire(void* object, void (*deleter)(void*)) {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        retired.push_back({global_epoch.load(std::memory_order_seq_cst), object, deleter});
+
+        if (++retires_since_reclaim >= RECLAIM_INTERVAL) {
+            retires_since_reclaim = 0;
+            reclaim_locked();
+        }
+    }
+
+    template <typename T>
+    void retire(const T* object) {
+        retire(const_cast<T*>(object), [](void* p) { delete static_cast<T*>(p); });
+    }
+
+    // Forza un tentativo di recupero (ad es. a fine esecuzione)
+    void reclaim() {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        reclaim_locked();
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        return retired.size();
+    }
+};
+
+// Guardia RAII per una sezione critica di lettura
+class EpochGuard {
+private:
+    bool entered;
+
+public:
+    EpochGuard() : entered(EpochManager::instance().enter()) {}
+
+    ~EpochGuard() {
+        if (entered) {
+            EpochManager::instance().exit();
+        }
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+    // False se il thread non ha ottenuto uno slot lettore
+    bool active() const { return entered; }
+};
+
+#endif // CACHE_EPOCH_H
@@ -0,0 +1,1835 @@
+/**
+ * cache-l2.h - Formato su disco della cache L2 di Mini-Rosetta
+ *
+ * Layout del file (versione 4):
+ *   [CacheFileHeader][filtro di Bloom][indice hash: L2IndexSlot * index_slots]
+ *   [CacheFileEntry * entry_count][CacheFileRelocation * reloc_count]
+ *   [padding fino a CODE_ALIGNMENT][codice ARM]
+ *
+ * Il filtro di Bloom sugli offset delle entrate occupa lo spazio tra l'header e
+ * l'indice (index_offset - sizeof(CacheFileHeader) byte, 0 = assente): un miss
+ * certo non tocca né l'indice né le entrate, che a freddo sono page fault.
+ *
+ * L'header riporta l'impronta delle regole e del traduttore che hanno scritto
+ * il file e, dopo una compattazione, quella precedente; ogni entrata conserva
+ * i 32 bit bassi della propria. Un processo usa solo le entrate della propria
+ * impronta: le altre restano nel file e il blocco viene ritradotto quando è
+ * eseguito, con la nuova versione accanto a quelle delle altre regole.
+ *
+ * Gli indirizzi guest sono salvati come offset dalla base del modulo e i
+ * riferimenti a indirizzi guest nel codice ARM come record di rilocazione:
+ * lo stesso file vale per qualunque indirizzo di caricamento.
+ *
+ * Accanto al file base c'è un log append-only (<file>.log, vedi L2LogSegment):
+ * i checkpoint vi aggiungono solo le entrate nuove o modificate, quindi il loro
+ * I/O è proporzionale al lavoro nuovo e non alla dimensione della cache.
+ *
+ * Il file viene mappato in memoria una volta per binario: una ricerca è un
+ * probing lineare nell'indice più il confronto dell'entrata, senza syscall.
+ * La sezione di codice è allineata a pagina, così può essere mappata a parte
+ * in sola lettura ed esecuzione: i blocchi senza patch girano senza copie.
+ * Le statistiche di esecuzione sono accumulate in memoria a ogni hit e
+ * applicate alla mappatura condivisa in blocco da flush_stats, chiamata
+ * periodicamente dal PersistenceManager: la ricerca non sporca pagine del file.
+ * Il file non viene mai modificato in struttura: una nuova versione
+ * viene scritta in un file temporaneo e rinominata, così le mappature esistenti
+ * restano valide sul contenuto precedente.
+ *
+ * Formato compresso (CACHE_FORMAT_COMPRESSED nell'header), per le directory
+ * di cache condivise o su dischi lenti:
+ *   [CacheFileHeader][L2PackedSections][filtro di Bloom][entrate codificate][rilocazioni codificate]
+ *   [offset dei blocchi di codice: uint64_t * (chunk_count + 1)][blocchi compressi]
+ * Le tabelle sono codificate per differenza con interi a lunghezza variabile;
+ * il codice è diviso in blocchi da CODE_CHUNK compressi indipendentemente
+ * (formato LZ4 block, vedi cache-compress.h). All'apertura le tabelle vengono
+ * decodificate in un'immagine anonima con il layout non compresso e l'indice
+ * ricostruito; ogni blocco di codice è decompresso al primo accesso. Il codice
+ * di un file compresso viene sempre copiato e le statistiche di esecuzione non
+ * tornano sul disco fino alla riscrittura successiva.
+ *
+ * Codice condiviso (CACHE_FORMAT_SHARED_OBJECTS nell'header): il codice delle
+ * entrate senza rilocazioni è salvato una sola volta nell'archivio degli
+ * oggetti della directory (vedi cache-objects.h), comune a tutti i binari; le
+ * entrate con CACHE_ENTRY_SHARED riportano in arm_offset l'offset del codice
+ * nell'archivio. Il checksum dell'entrata copre anche quel codice.
+ *
+ * Consistenza dopo un crash: il file base è scritto in un temporaneo,
+ * sincronizzato su disco e solo allora rinominato, quindi un file visibile è
+ * sempre completo. Ogni entrata ha un checksum dei propri dati (campi
+ * invarianti, rilocazioni e codice) verificato al primo uso: un'entrata
+ * danneggiata viene scartata senza rifiutare il resto del file. Nel log ogni
+ * gruppo di record è chiuso da un record di commit; i record senza commit
+ * (append interrotto) sono ignorati e troncati.
+ */
+
+#ifndef CACHE_L2_H
+#define CACHE_L2_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <xxhash.h>
+#include "cache-compress.h"
+#include "cache-objects.h"
+
+using byte = uint8_t;
+
+// Struttura per l'header della cache persistente
+struct CacheFileHeader {
+    uint64_t magic;           // Magic number per identificare il file di cache
+    uint32_t version;         // Versione del formato di cache
+    uint32_t entry_count;     // Numero di entrate nella cache
+    uint64_t x86_hash;        // Hash del binario x86 originale
+    uint64_t creation_time;   // Timestamp di creazione
+    uint64_t last_access;     // Ultimo accesso (aggiornato nella mappatura)
+    uint64_t hit_count;       // Contatore accessi (aggiornato nella mappatura)
+    uint64_t index_offset;    // Offset dell'indice hash
+    uint64_t index_slots;     // Slot dell'indice (potenza di 2)
+    uint64_t entries_offset;  // Offset dell'array di entrate
+    uint64_t code_offset;     // Offset della sezione di codice ARM
+    uint64_t code_size;       // Dimensione della sezione di codice ARM
+    uint64_t reloc_offset;    // Offset dei record di rilocazione
+    uint64_t reloc_count;     // Numero di record di rilocazione
+    uint64_t rules_fingerprint; // Impronta di regole e traduttore dello scrittore (0 = sconosciuta)
+    uint64_t format_flags;    // Varianti del formato (CACHE_FORMAT_*)
+    uint64_t previous_rules_fingerprint; // Regole precedenti ancora valide per le loro entrate (0 = nessuna)
+};
+
+// Struttura per un blocco memorizzato nella cache persistente
+struct CacheFileEntry {
+    uint64_t x86_offset;      // Offset del blocco x86 dalla base del modulo
+    uint32_t x86_size;        // Dimensione del blocco x86
+    uint64_t x86_hash;        // Hash del blocco x86
+    uint64_t arm_offset;      // Offset al codice ARM nella sezione dati
+    uint32_t arm_size;        // Dimensione del codice ARM
+    uint32_t execution_count; // Contatore esecuzioni
+    uint64_t last_execution;  // Timestamp ultima esecuzione
+    uint32_t flags;           // Flag (hot/cold, ottimizzato, ecc.)
+    uint32_t reloc_first;     // Primo record di rilocazione dell'entrata
+    uint32_t reloc_count;     // Record di rilocazione dell'entrata
+    uint32_t rules_tag;       // 32 bit bassi dell'impronta delle regole usate per tradurla
+    uint64_t checksum;        // XXH64 di campi invarianti, rilocazioni e codice (vedi L2CacheFile::entry_checksum)
+};
+
+// Tipi di rilocazione del codice ARM
+enum class RelocationType : uint16_t {
+    ABS64 = 1,        // Letterale a 64 bit = base del modulo + module_offset
+    MOVZ_MOVK64 = 2   // Sequenza MOVZ/MOVK (4 istruzioni) che materializza base + module_offset
+};
+
+// Riferimento a un indirizzo guest del modulo nel codice ARM di un'entrata
+struct CacheFileRelocation {
+    uint32_t arm_offset;      // Offset nel codice ARM dell'entrata
+    RelocationType type;
+    uint16_t reserved;
+    uint64_t module_offset;   // Indirizzo guest di destinazione, relativo alla base del modulo
+};
+
+// Applica una rilocazione al codice di un'entrata; false se fuori dai limiti
+inline bool apply_relocation(byte* code, size_t code_size, const CacheFileRelocation& reloc, uint64_t module_base) {
+    uint64_t value = module_base + reloc.module_offset;
+
+    switch (reloc.type) {
+        case RelocationType::ABS64:
+            if (reloc.arm_offset > code_size || code_size - reloc.arm_offset < sizeof(uint64_t)) {
+                return false;
+            }
+            memcpy(code + reloc.arm_offset, &value, sizeof(value));
+            return true;
+
+        case RelocationType::MOVZ_MOVK64:
+            if (reloc.arm_offset > code_size || code_size - reloc.arm_offset < 4 * sizeof(uint32_t)) {
+                return false;
+            }
+            for (size_t i = 0; i < 4; i++) {
+                uint32_t inst;
+                memcpy(&inst, code + reloc.arm_offset + i * sizeof(uint32_t), sizeof(inst));
+                // Il campo hw (bit 22:21) indica quale mezza parola carica l'istruzione
+                uint32_t shift = ((inst >> 21) & 3) * 16;
+                uint32_t imm16 = static_cast<uint32_t>(value >> shift) & 0xFFFF;
+                inst = (inst & ~(0xFFFFu << 5)) | (imm16 << 5);
+                memcpy(code + reloc.arm_offset + i * sizeof(uint32_t), &inst, sizeof(inst));
+            }
+            return true;
+    }
+    return false;
+}
+
+// Flag di CacheFileEntry: il codice contiene riferimenti da correggere prima
+// dell'esecuzione, quindi va copiato invece che eseguito dalla mappatura
+constexpr uint32_t CACHE_ENTRY_NEEDS_PATCH = 1u << 16;
+
+// Flag di CacheFileEntry: il codice è nell'archivio degli oggetti condiviso
+// e arm_offset è il suo offset nell'archivio
+constexpr uint32_t CACHE_ENTRY_SHARED = 1u << 17;
+
+// Flag di CacheFileHeader::format_flags: tabelle codificate e codice compresso
+constexpr uint64_t CACHE_FORMAT_COMPRESSED = 1;
+
+// Flag di CacheFileHeader::format_flags: entrate con codice nell'archivio degli oggetti
+constexpr uint64_t CACHE_FORMAT_SHARED_OBJECTS = 2;
+
+// Dimensioni delle sezioni di un file compresso, subito dopo l'header
+struct L2PackedSections {
+    uint64_t entries_size;    // Byte della tabella delle entrate codificata
+    uint64_t relocs_size;     // Byte della tabella delle rilocazioni codificata
+    uint64_t chunk_count;     // Blocchi della sezione di codice
+    uint64_t filter_size;     // Byte del filtro di Bloom (non compresso)
+};
+
+// Slot dell'indice su disco: entrata + 1 (0 = vuoto) e bit alti dell'hash
+struct L2IndexSlot {
+    uint32_t entry;
+    uint32_t tag;
+};
+
+// Header del log di un file L2
+struct L2LogHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t base_creation_time;  // creation_time del file base a cui il log si applica
+    uint64_t x86_hash;            // Hash del binario x86 del file base
+    uint64_t previous_base_time;  // File base del log riscritto dall'ultima compattazione (0 = nessuno)
+    uint64_t merged_bytes;        // Byte di quel log uniti nel file base: il resto segue questo header
+};
+
+// Hit di un blocco raccolti su una mappatura in sola lettura, applicati da chi
+// possiede il file (vedi L2CacheFile::take_hits e apply_hits). Il blocco è
+// identificato da offset e hash, validi anche dopo una compattazione.
+struct L2HitRecord {
+    uint64_t x86_offset;
+    uint64_t x86_hash;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t last_execution;
+};
+
+// Header di un record del log, seguito da CacheFileEntry, rilocazioni e codice ARM
+// (o da L2LogCommit per i record di commit)
+struct L2LogRecordHeader {
+    uint32_t magic;
+    uint32_t payload_size;        // Byte del record dopo questo header
+    uint64_t rules_fingerprint;   // Impronta delle regole con cui è stato tradotto il blocco
+    uint64_t checksum;            // XXH64 del payload
+};
+
+// Record di commit che chiude un gruppo di record aggiunti con un solo append
+struct L2LogCommit {
+    uint32_t record_count;        // Record del gruppo
+    uint32_t reserved;
+    uint64_t group_checksum;      // XXH64 dei byte del gruppo (header e payload dei record)
+};
+
+// Blocco salvato nel log. In memoria entry.arm_offset è l'indice del record e
+// entry.reloc_first è 0: codice e rilocazioni sono contenuti nel record.
+struct L2LogRecord {
+    CacheFileEntry entry;
+    uint64_t rules_fingerprint = 0;
+    std::vector<CacheFileRelocation> relocations;
+    std::vector<byte> code;
+};
+
+class L2CacheFile;
+
+// Destinazione asincrona dei record del log (ad es. il thread del PersistenceManager):
+// riceve l'ID del binario, il file L2 a cui aggiungere il record e il record
+using L2RecordSink = std::function<void(const std::string&, const std::shared_ptr<L2CacheFile>&, L2LogRecord&&)>;
+
+// Segmento di log append-only di un file L2. Le ricerche lo consultano prima
+// del file base, dal record più recente. Ogni append termina con un record di
+// commit: all'apertura i gruppi sono verificati in ordine e il file viene
+// troncato dopo l'ultimo commit valido (scrittura interrotta da un crash). Le modifiche al file avvengono sotto
+// flock, quindi più processi possono aggiungere record allo stesso log.
+// I record non dipendono dal file base: un log legato a un file base più
+// recente (compattato da un altro processo) resta utilizzabile.
+// La compattazione scrive il nuovo log in un file temporaneo e lo rinomina
+// sotto il flock del log precedente; chi scrive verifica dopo ogni flock che
+// il percorso indichi ancora il proprio file, altrimenti lo riapre. L'header
+// del nuovo log indica quanti byte del precedente sono stati uniti nel file
+// base, così un processo che ne aveva già letto la coda non la legge due volte.
+class L2LogSegment {
+public:
+    static constexpr uint64_t LOG_MAGIC = 0x474F4C45534F5243; // "CROSELOG" in hex
+    static constexpr uint32_t LOG_VERSION = 3;
+    static constexpr uint32_t RECORD_MAGIC = 0x4345524C;      // "LREC" in hex
+    static constexpr uint32_t COMMIT_MAGIC = 0x4D4D4F43;      // "COMM" in hex
+    static constexpr uint32_t MAX_RECORD_SIZE = 64 * 1024 * 1024;
+
+private:
+    int fd = -1;
+    bool writable = false;
+    std::string log_path;             // Vuoto per i log aperti da descrittore
+    uint64_t base_creation_time = 0;  // File base mappato da questo processo
+    uint64_t log_base_time = 0;       // File base indicato nell'header del log
+    uint64_t x86_hash = 0;
+
+    mutable std::shared_mutex mutex;                 // Protegge records, index e log_size
+    std::deque<L2LogRecord> records;                 // Indirizzi stabili durante gli append
+    std::unordered_multimap<uint64_t, size_t> index; // x86_offset -> record
+    std::unordered_set<uint64_t> record_checksums;   // Checksum dei payload dei record letti
+    uint64_t log_size = 0;                           // Byte del file già letti e verificati
+
+    // Aggiunge il record serializzato (header + payload) a out; restituisce il checksum del payload
+    static uint64_t serialize(const L2LogRecord& record, std::vector<byte>& out) {
+        CacheFileEntry entry = record.entry;
+        entry.arm_offset = 0;
+        entry.reloc_first = 0;
+        entry.reloc_count = static_cast<uint32_t>(record.relocations.size());
+        entry.arm_size = static_cast<uint32_t>(record.code.size());
+
+        size_t start = out.size();
+        size_t relocs_size = record.relocations.size() * sizeof(CacheFileRelocation);
+        L2LogRecordHeader header;
+        header.magic = RECORD_MAGIC;
+        header.payload_size = static_cast<uint32_t>(sizeof(CacheFileEntry) + relocs_size + record.code.size());
+        header.rules_fingerprint = record.rules_fingerprint;
+
+        out.resize(start + sizeof(header) + header.payload_size);
+        byte* payload = out.data() + start + sizeof(header);
+        memcpy(payload, &entry, sizeof(entry));
+        if (relocs_size > 0) {
+            memcpy(payload + sizeof(entry), record.relocations.data(), relocs_size);
+        }
+        if (!record.code.empty()) {
+            memcpy(payload + sizeof(entry) + relocs_size, record.code.data(), record.code.size());
+        }
+
+        header.checksum = XXH64(payload, header.payload_size, 0);
+        memcpy(out.data() + start, &header, sizeof(header));
+        return header.checksum;
+    }
+
+    // Aggiunge il record di commit del gruppo serializzato in out da group_start
+    static void serialize_commit(size_t group_start, uint32_t record_count, std::vector<byte>& out) {
+        L2LogCommit commit;
+        commit.record_count = record_count;
+        commit.reserved = 0;
+        commit.group_checksum = XXH64(out.data() + group_start, out.size() - group_start, 0);
+
+        L2LogRecordHeader header;
+        header.magic = COMMIT_MAGIC;
+        header.payload_size = sizeof(commit);
+        header.rules_fingerprint = 0;
+        header.checksum = XXH64(&commit, sizeof(commit), 0);
+
+        size_t start = out.size();
+        out.resize(start + sizeof(header) + sizeof(commit));
+        memcpy(out.data() + start, &header, sizeof(header));
+        memcpy(out.data() + start + sizeof(header), &commit, sizeof(commit));
+    }
+
+    // Verifica il record di commit all'inizio di data per il gruppo che lo precede;
+    // restituisce la sua dimensione, o 0 se non è un commit valido per il gruppo
+    static size_t parse_commit(const byte* data, size_t available, const byte* group, size_t group_size,
+                               size_t record_count) {
+        L2LogRecordHeader header;
+        L2LogCommit commit;
+        if (available < sizeof(header) + sizeof(commit)) {
+            return 0;
+        }
+        memcpy(&header, data, sizeof(header));
+        memcpy(&commit, data + sizeof(header), sizeof(commit));
+        if (header.magic != COMMIT_MAGIC || header.payload_size != sizeof(commit) ||
+            XXH64(&commit, sizeof(commit), 0) != header.checksum ||
+            commit.record_count != record_count || XXH64(group, group_size, 0) != commit.group_checksum) {
+            return 0;
+        }
+        return sizeof(header) + sizeof(commit);
+    }
+
+    // Decodifica un record all'inizio di data; restituisce la sua dimensione
+    // totale, o 0 se è incompleto o corrotto. checksum riceve quello del payload.
+    static size_t parse(const byte* data, size_t available, L2LogRecord& record, uint64_t* checksum = nullptr) {
+        L2LogRecordHeader header;
+        if (available < sizeof(header)) {
+            return 0;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != RECORD_MAGIC || header.payload_size < sizeof(CacheFileEntry) ||
+            header.payload_size > MAX_RECORD_SIZE || available - sizeof(header) < header.payload_size) {
+            return 0;
+        }
+
+        const byte* payload = data + sizeof(header);
+        if (XXH64(payload, header.payload_size, 0) != header.checksum) {
+            return 0;
+        }
+
+        memcpy(&record.entry, payload, sizeof(CacheFileEntry));
+        uint64_t relocs_size = uint64_t(record.entry.reloc_count) * sizeof(CacheFileRelocation);
+        if (sizeof(CacheFileEntry) + relocs_size + record.entry.arm_size != header.payload_size) {
+            return 0;
+        }
+
+        const byte* relocs = payload + sizeof(CacheFileEntry);
+        record.rules_fingerprint = header.rules_fingerprint;
+        record.relocations.resize(record.entry.reloc_count);
+        if (relocs_size > 0) {
+            memcpy(record.relocations.data(), relocs, relocs_size);
+        }
+        record.code.assign(relocs + relocs_size, relocs + relocs_size + record.entry.arm_size);
+        if (checksum) {
+            *checksum = header.checksum;
+        }
+        return sizeof(header) + header.payload_size;
+    }
+
+    // Rende il record visibile alle ricerche (mutex acquisito in scrittura)
+    void add_locked(L2LogRecord&& record, uint64_t checksum) {
+        record_checksums.insert(checksum);
+        record.entry.arm_offset = records.size();
+        record.entry.reloc_first = 0;
+        index.emplace(record.entry.x86_offset, records.size());
+        records.push_back(std::move(record));
+    }
+
+    // Legge i gruppi di record aggiunti al file dopo log_size (da questo o da altri
+    // processi). I record diventano visibili solo con il commit del loro gruppo.
+    // Con truncate il file è troncato alla fine dell'ultimo commit valido.
+    // Chiamato con mutex acquisito; con truncate anche con flock.
+    bool catch_up_locked(bool truncate) {
+        L2LogHeader header;
+        if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+            header.magic != LOG_MAGIC || header.version != LOG_VERSION) {
+            return false;
+        }
+
+        // Log riscritto da una compattazione: la coda conservata segue l'header.
+        // Se la compattazione è partita dal log già letto, i byte letti oltre
+        // merged_bytes sono in testa al nuovo log e vengono saltati; dopo più
+        // compattazioni la posizione non è nota e si scartano i record già presenti.
+        bool skip_known = false;
+        if (header.base_creation_time != log_base_time) {
+            if (header.previous_base_time == log_base_time && header.merged_bytes >= sizeof(header) &&
+                log_size >= header.merged_bytes) {
+                log_size = sizeof(header) + (log_size - header.merged_bytes);
+            } else {
+                skip_known = header.previous_base_time != log_base_time;
+                log_size = sizeof(header);
+            }
+            log_base_time = header.base_creation_time;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+        uint64_t file_size = st.st_size;
+        if (file_size <= log_size) {
+            return true;
+        }
+
+        std::vector<byte> data(file_size - log_size);
+        ssize_t read_bytes = pread(fd, data.data(), data.size(), static_cast<off_t>(log_size));
+        if (read_bytes != static_cast<ssize_t>(data.size())) {
+            return false;
+        }
+
+        size_t pos = 0;
+        size_t committed = 0;
+        std::vector<std::pair<L2LogRecord, uint64_t>> group;
+        while (pos < data.size()) {
+            uint32_t magic = 0;
+            if (data.size() - pos >= sizeof(magic)) {
+                memcpy(&magic, data.data() + pos, sizeof(magic));
+            }
+            if (magic == COMMIT_MAGIC) {
+                size_t commit_size = parse_commit(data.data() + pos, data.size() - pos, data.data() + committed,
+                                                  pos - committed, group.size());
+                if (commit_size == 0) {
+                    break;
+                }
+                for (auto& [record, checksum] : group) {
+                    if (!skip_known || !record_checksums.count(checksum)) {
+                        add_locked(std::move(record), checksum);
+                    }
+                }
+                group.clear();
+                pos += commit_size;
+                committed = pos;
+                continue;
+            }
+
+            L2LogRecord record;
+            uint64_t checksum = 0;
+            size_t record_size = parse(data.data() + pos, data.size() - pos, record, &checksum);
+            if (record_size == 0) {
+                break;
+            }
+            group.emplace_back(std::move(record), checksum);
+            pos += record_size;
+        }
+        log_size += committed;
+
+        if (committed < data.size() && truncate) {
+            std::cerr << "Log della cache troncato dopo l'ultimo commit valido (" << (data.size() - committed)
+                      << " byte scartati)" << std::endl;
+            if (ftruncate(fd, static_cast<off_t>(log_size)) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Riporta il log a un header vuoto per il file base corrente (flock acquisito)
+    bool reset_locked() {
+        L2LogHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = LOG_MAGIC;
+        header.version = LOG_VERSION;
+        header.base_creation_time = base_creation_time;
+        header.x86_hash = x86_hash;
+
+        if (ftruncate(fd, 0) != 0 ||
+            pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+            return false;
+        }
+        log_base_time = base_creation_time;
+        log_size = sizeof(header);
+        return true;
+    }
+
+    // Acquisisce flock sul log indicato dal percorso (mutex acquisito). Se una
+    // compattazione lo ha sostituito nel frattempo, riapre il percorso: i record
+    // del nuovo file sono letti da catch_up_locked.
+    bool lock_current_locked() {
+        while (true) {
+            if (flock(fd, LOCK_EX) != 0) {
+                return false;
+            }
+            struct stat by_fd, by_path;
+            if (log_path.empty() ||
+                (fstat(fd, &by_fd) == 0 && ::stat(log_path.c_str(), &by_path) == 0 &&
+                 by_fd.st_ino == by_path.st_ino && by_fd.st_dev == by_path.st_dev)) {
+                return true;
+            }
+            int current_fd = ::open(log_path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+            flock(fd, LOCK_UN);
+            if (current_fd < 0) {
+                return false;
+            }
+            ::close(fd);
+            fd = current_fd;
+        }
+    }
+
+public:
+    L2LogSegment() = default;
+    L2LogSegment(const L2LogSegment&) = delete;
+    L2LogSegment& operator=(const L2LogSegment&) = delete;
+
+    ~L2LogSegment() {
+        close();
+    }
+
+    // Serializza un record nel formato del log, per trasmetterlo a chi scrive il
+    // log (ad es. il daemon di traduzione); i gruppi non hanno record di commit
+    static void encode(const L2LogRecord& record, std::vector<byte>& out) {
+        serialize(record, out);
+    }
+
+    // Decodifica un record prodotto da encode; restituisce la sua dimensione, o 0 se non valido
+    static size_t decode(const byte* data, size_t available, L2LogRecord& record) {
+        return parse(data, available, record);
+    }
+
+    // Apre (o crea) il log del file base con i valori di header indicati.
+    // Un log scritto per un file base precedente o per un altro binario viene svuotato.
+    bool open(const std::string& path, uint64_t base_time, uint64_t base_hash, bool allow_write) {
+        close();
+
+        int log_fd = allow_write ? ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644) : ::open(path.c_str(), O_RDONLY);
+        if (log_fd < 0) {
+            return false;
+        }
+        log_path = allow_write ? path : std::string();
+        return adopt(log_fd, base_time, base_hash, allow_write);
+    }
+
+    // Apre in sola lettura il log aperto in log_fd, di cui prende possesso
+    bool open_fd(int log_fd, uint64_t base_time, uint64_t base_hash) {
+        close();
+        return adopt(log_fd, base_time, base_hash, false);
+    }
+
+private:
+    // Legge (e con allow_write ripara o svuota) il log aperto in log_fd
+    bool adopt(int log_fd, uint64_t base_time, uint64_t base_hash, bool allow_write) {
+        fd = log_fd;
+        writable = allow_write;
+        base_creation_time = base_time;
+        x86_hash = base_hash;
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (writable && !lock_current_locked()) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+
+        L2LogHeader header;
+        bool matches = pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+                       header.magic == LOG_MAGIC && header.version == LOG_VERSION &&
+                       header.base_creation_time >= base_creation_time && header.x86_hash == x86_hash;
+        bool ok;
+        if (matches) {
+            log_base_time = header.base_creation_time;
+            log_size = sizeof(header);
+            ok = catch_up_locked(writable);
+        } else {
+            ok = writable && reset_locked();
+        }
+
+        if (writable) {
+            flock(fd, LOCK_UN);
+        }
+        if (!ok) {
+            lock.unlock();
+            close();
+        }
+        return ok;
+    }
+
+public:
+    void close() {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+        writable = false;
+        log_path.clear();
+        records.clear();
+        index.clear();
+        record_checksums.clear();
+        log_size = 0;
+    }
+
+    bool is_open() const { return fd >= 0; }
+
+    // Aggiunge i record al log con una sola scrittura, chiusa da un record di
+    // commit, e li rende visibili alle ricerche. Non sincronizza il file: dopo
+    // un crash un gruppo è intero o assente, grazie a checksum e commit.
+    // In caso di errore il file torna alla dimensione precedente.
+    bool append(std::vector<L2LogRecord>& new_records) {
+        if (new_records.empty()) {
+            return true;
+        }
+        if (!writable) {
+            return false;
+        }
+
+        std::vector<byte> buffer;
+        std::vector<uint64_t> checksums;
+        checksums.reserve(new_records.size());
+        for (const auto& record : new_records) {
+            checksums.push_back(serialize(record, buffer));
+        }
+        serialize_commit(0, static_cast<uint32_t>(new_records.size()), buffer);
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (!lock_current_locked()) {
+            return false;
+        }
+
+        // Prima i record aggiunti da altri processi, così l'offset iniziale è noto
+        bool ok = catch_up_locked(true);
+        uint64_t start = log_size;
+        size_t written = 0;
+        while (ok && written < buffer.size()) {
+            ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+            if (n <= 0) {
+                std::cerr << "Errore nella scrittura del log della cache" << std::endl;
+                ok = false;
+                if (ftruncate(fd, static_cast<off_t>(start)) != 0) {
+                    std::cerr << "Impossibile ripristinare il log della cache" << std::endl;
+                }
+                break;
+            }
+            written += n;
+        }
+
+        if (ok) {
+            for (size_t i = 0; i < new_records.size(); i++) {
+                add_locked(std::move(new_records[i]), checksums[i]);
+            }
+            log_size += buffer.size();
+        }
+        flock(fd, LOCK_UN);
+        return ok;
+    }
+
+    // Sostituisce il file base tramite commit (eseguito sotto flock) e lega il log
+    // al nuovo file base. I record oltre i primi merged_bytes del log, aggiunti
+    // dopo la lettura del compattatore, vengono conservati. Fallisce senza
+    // modifiche se il log è stato riscritto da un altro processo nel frattempo.
+    // Il nuovo log è scritto in un file temporaneo, sincronizzato e rinominato
+    // prima di rilasciare il flock: dopo un crash resta il log vecchio o il nuovo.
+    bool rebase(uint64_t new_base_time, uint64_t merged_bytes, const std::function<bool()>& commit) {
+        if (!writable || log_path.empty()) {
+            return false;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (!lock_current_locked()) {
+            return false;
+        }
+
+        L2LogHeader header;
+        bool ok = pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+                  header.magic == LOG_MAGIC && header.base_creation_time == log_base_time &&
+                  catch_up_locked(true) && merged_bytes >= sizeof(header) && merged_bytes <= log_size;
+
+        std::vector<byte> buffer;
+        if (ok) {
+            buffer.resize(sizeof(header) + (log_size - merged_bytes));
+            ssize_t tail = static_cast<ssize_t>(log_size - merged_bytes);
+            ok = pread(fd, buffer.data() + sizeof(header), tail, static_cast<off_t>(merged_bytes)) == tail;
+        }
+        ok = ok && commit();
+
+        if (ok) {
+            header.previous_base_time = log_base_time;
+            header.merged_bytes = merged_bytes;
+            header.base_creation_time = new_base_time;
+            memcpy(buffer.data(), &header, sizeof(header));
+
+            std::string temp_path = log_path + ".tmp." + std::to_string(getpid());
+            int new_fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+            ok = new_fd >= 0 &&
+                 ::write(new_fd, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size()) &&
+                 fsync(new_fd) == 0 && ::rename(temp_path.c_str(), log_path.c_str()) == 0;
+            if (ok) {
+                // La chiusura rilascia il flock sul log sostituito: chi vi è in attesa riapre il percorso
+                ::close(fd);
+                fd = new_fd;
+                log_base_time = new_base_time;
+                log_size = buffer.size();
+                return true;
+            }
+            std::cerr << "Errore nella riscrittura del log della cache: " << log_path << std::endl;
+            if (new_fd >= 0) {
+                ::close(new_fd);
+            }
+            ::unlink(temp_path.c_str());
+        }
+        flock(fd, LOCK_UN);
+        return ok;
+    }
+
+    // Cerca il record più recente per offset nel modulo che soddisfa match.
+    // match è chiamato senza lock: i record non si spostano dopo l'inserimento.
+    template <typename Match>
+    const CacheFileEntry* find(uint64_t x86_offset, Match&& match) const {
+        std::vector<std::pair<size_t, const CacheFileEntry*>> candidates;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto range = index.equal_range(x86_offset);
+            for (auto it = range.first; it != range.second; ++it) {
+                candidates.emplace_back(it->second, &records[it->second].entry);
+            }
+        }
+
+        std::sort(candidates.rbegin(), candidates.rend());
+        for (const auto& [i, entry] : candidates) {
+            if (match(*entry)) {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // Vero se il log ha record per l'offset nel modulo
+    bool contains(uint64_t x86_offset) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return index.count(x86_offset) > 0;
+    }
+
+    // Record di un'entrata restituita da find (nullptr se non appartiene al log)
+    const L2LogRecord* record_of(const CacheFileEntry& e) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (e.arm_offset >= records.size() || &records[e.arm_offset].entry != &e) {
+            return nullptr;
+        }
+        return &records[e.arm_offset];
+    }
+
+    // Visita i record dal più recente (senza lock durante la visita)
+    template <typename Visit>
+    void for_each(Visit&& visit) const {
+        std::vector<const L2LogRecord*> snapshot;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            snapshot.reserve(records.size());
+            for (size_t i = records.size(); i-- > 0; ) {
+                snapshot.push_back(&records[i]);
+            }
+        }
+        for (const L2LogRecord* record : snapshot) {
+            visit(*record);
+        }
+    }
+
+    size_t record_count() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return records.size();
+    }
+
+    uint64_t size_bytes() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return log_size;
+    }
+};
+
+// File di cache L2 mappato in memoria
+class L2CacheFile {
+public:
+    static constexpr uint64_t CACHE_MAGIC = 0x415243524F535345; // "ARCROSSE" in hex
+    static constexpr uint32_t FORMAT_VERSION = 4;
+    static constexpr size_t CODE_ALIGNMENT = 16384; // Multiplo delle pagine da 4 KB e 16 KB
+    static constexpr size_t WRITE_CHUNK = 1024 * 1024; // Blocco di scrittura del codice
+    static constexpr size_t CODE_CHUNK = 64 * 1024;    // Blocco di codice compresso indipendentemente
+    static constexpr size_t FILTER_BLOCK = 64;         // Blocco del filtro di Bloom: una linea di cache
+    static constexpr size_t FILTER_BITS_PER_KEY = 10;  // ~1% di falsi positivi
+    static constexpr unsigned FILTER_PROBES = 6;       // Bit impostati per chiave, nello stesso blocco
+    static constexpr size_t SHARED_MIN_SIZE = 64;      // Codice più corto resta nel file: l'oggetto costa un header
+
+private:
+    int fd = -1;                // Tenuto aperto: il percorso può puntare a un file più recente
+    byte* base = nullptr;
+    size_t mapped_size = 0;
+    bool writable = false;
+
+    // Mappatura eseguibile della sezione di codice, creata al primo uso
+    std::mutex exec_mutex;
+    bool exec_attempted = false;
+    std::atomic<byte*> exec_base{nullptr};
+
+    CacheFileHeader* header = nullptr;
+    const L2IndexSlot* index = nullptr;
+    CacheFileEntry* entries = nullptr;
+    const CacheFileRelocation* relocations = nullptr;
+    const byte* code = nullptr;
+    const uint64_t* filter = nullptr;
+    uint64_t filter_blocks = 0;
+
+    // Esito della verifica del checksum per entrata del file base
+    enum : uint8_t { ENTRY_UNCHECKED = 0, ENTRY_VALID = 1, ENTRY_CORRUPT = 2 };
+    mutable std::unique_ptr<std::atomic<uint8_t>[]> entry_state;
+    mutable std::atomic<size_t> corrupt_entries{0};
+
+    // File compresso: mappatura del file su disco, mentre base punta all'immagine
+    // decodificata. I blocchi di codice sono decompressi nell'immagine al primo uso.
+    enum : uint8_t { CHUNK_PENDING = 0, CHUNK_READY = 1, CHUNK_CORRUPT = 2 };
+    byte* packed = nullptr;
+    size_t packed_size = 0;
+    const byte* chunk_table = nullptr;    // chunk_count + 1 offset in chunk_data
+    const byte* chunk_data = nullptr;
+    size_t chunk_data_size = 0;
+    mutable std::unique_ptr<std::atomic<uint8_t>[]> chunk_state;
+    mutable std::mutex chunk_mutex;
+
+    // Statistiche di esecuzione non ancora applicate alla mappatura: hit per
+    // entrata del file base, hit totali del file e istante dell'ultimo hit
+    std::unique_ptr<std::atomic<uint32_t>[]> pending_hits;
+    std::atomic<uint64_t> pending_file_hits{0};
+    std::atomic<uint64_t> last_hit{0};
+
+    // Archivio degli oggetti per le entrate con CACHE_ENTRY_SHARED
+    std::shared_ptr<L2ObjectStore> objects;
+
+    // Entrate aggiunte dopo la scrittura del file base
+    L2LogSegment log;
+
+    static uint64_t align_up(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    static uint64_t now() {
+        return std::chrono::system_clock::now().time_since_epoch().count();
+    }
+
+    // Verifica che header e sezioni siano coerenti con la dimensione del file
+    bool validate(uint64_t expected_hash, const std::string& path) const {
+        if (mapped_size < sizeof(CacheFileHeader) ||
+            header->magic != CACHE_MAGIC || header->version != FORMAT_VERSION) {
+            std::cerr << "File di cache non valido o versione non supportata: " << path << std::endl;
+            return false;
+        }
+        if (expected_hash != 0 && header->x86_hash != expected_hash) {
+            std::cerr << "Hash del binario non corrispondente per la cache: " << path << std::endl;
+            return false;
+        }
+
+        uint64_t slots = header->index_slots;
+        bool valid = slots != 0 && (slots & (slots - 1)) == 0 &&
+                     header->entry_count < slots &&
+                     header->index_offset >= sizeof(CacheFileHeader) &&
+                     (header->index_offset - sizeof(CacheFileHeader)) % FILTER_BLOCK == 0 &&
+                     header->index_offset + slots * sizeof(L2IndexSlot) <= header->entries_offset &&
+                     header->entries_offset + uint64_t(header->entry_count) * sizeof(CacheFileEntry) <= header->reloc_offset &&
+                     header->reloc_count <= mapped_size / sizeof(CacheFileRelocation) &&
+                     header->reloc_offset + header->reloc_count * sizeof(CacheFileRelocation) <= header->code_offset &&
+                     header->code_offset + header->code_size <= mapped_size;
+        if (!valid) {
+            std::cerr << "File di cache corrotto: " << path << std::endl;
+        }
+        return valid;
+    }
+
+    // Verifica (una sola volta) il checksum dell'entrata i del file base
+    bool entry_valid(size_t i) const {
+        uint8_t state = entry_state[i].load(std::memory_order_acquire);
+        if (state == ENTRY_UNCHECKED) {
+            const CacheFileEntry& e = entries[i];
+            const byte* entry_code = code_of(e);
+            const CacheFileRelocation* entry_relocs = relocations_of(e);
+            bool valid = entry_code && entry_relocs && entry_checksum(e, entry_relocs, entry_code) == e.checksum;
+            state = valid ? ENTRY_VALID : ENTRY_CORRUPT;
+            uint8_t expected = ENTRY_UNCHECKED;
+            if (entry_state[i].compare_exchange_strong(expected, state, std::memory_order_acq_rel) && !valid) {
+                corrupt_entries++;
+                std::cerr << "Entrata corrotta nella cache scartata (offset 0x" << std::hex << e.x86_offset
+                          << std::dec << ")" << std::endl;
+            }
+        }
+        return state == ENTRY_VALID;
+    }
+
+    // Sincronizza su disco un file o una directory
+    static bool sync_path(const std::string& path) {
+        int sync_fd = ::open(path.c_str(), O_RDONLY);
+        if (sync_fd < 0) {
+            return false;
+        }
+        bool ok = fsync(sync_fd) == 0;
+        ::close(sync_fd);
+        return ok;
+    }
+
+    // Blocco del filtro e bit della chiave al suo interno (doppio hashing). Fa parte
+    // del formato come slot_hash.
+    template <typename Visit>
+    static void filter_bits(uint64_t x86_offset, uint64_t blocks, Visit&& visit) {
+        uint64_t h = slot_hash(x86_offset);
+        uint64_t block = ((h >> 32) * blocks) >> 32;
+        uint32_t h1 = static_cast<uint32_t>(h);
+        uint32_t h2 = static_cast<uint32_t>((h * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+        for (unsigned i = 0; i < FILTER_PROBES; i++) {
+            uint32_t bit = (h1 + i * h2) & (FILTER_BLOCK * 8 - 1);
+            visit(block * (FILTER_BLOCK / sizeof(uint64_t)) + bit / 64, uint64_t(1) << (bit % 64));
+        }
+    }
+
+    // Costruisce il filtro di Bloom sugli offset delle entrate (vuoto senza entrate)
+    static std::vector<uint64_t> build_filter(const std::vector<CacheFileEntry>& file_entries) {
+        uint64_t blocks = (file_entries.size() * FILTER_BITS_PER_KEY + FILTER_BLOCK * 8 - 1) / (FILTER_BLOCK * 8);
+        std::vector<uint64_t> words(blocks * (FILTER_BLOCK / sizeof(uint64_t)), 0);
+        for (const auto& e : file_entries) {
+            filter_bits(e.x86_offset, blocks, [&](uint64_t word, uint64_t mask) { words[word] |= mask; });
+        }
+        return words;
+    }
+
+    // Costruisce l'indice hash delle entrate
+    static void build_index(const CacheFileEntry* file_entries, size_t count, L2IndexSlot* slot_table, uint64_t slots) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t h = slot_hash(file_entries[i].x86_offset);
+            uint64_t pos = h & (slots - 1);
+            while (slot_table[pos].entry != 0) {
+                pos = (pos + 1) & (slots - 1);
+            }
+            slot_table[pos] = {static_cast<uint32_t>(i + 1), static_cast<uint32_t>(h >> 32)};
+        }
+    }
+
+    // Codifica le entrate per differenza dalla precedente: offset vicini,
+    // codice e rilocazioni per lo più contigui, stessa etichetta delle regole
+    static void encode_entries(const std::vector<CacheFileEntry>& file_entries, std::vector<byte>& out) {
+        CacheFileEntry previous;
+        memset(&previous, 0, sizeof(previous));
+        uint64_t arm_end = 0;
+        uint64_t reloc_end = 0;
+        for (const auto& e : file_entries) {
+            put_varint(out, zigzag_encode(static_cast<int64_t>(e.x86_offset - previous.x86_offset)));
+            put_varint(out, e.x86_size);
+            put_u64(out, e.x86_hash);
+            put_varint(out, zigzag_encode(static_cast<int64_t>(e.arm_offset - arm_end)));
+            put_varint(out, e.arm_size);
+            put_varint(out, e.execution_count);
+            put_varint(out, zigzag_encode(static_cast<int64_t>(e.last_execution - previous.last_execution)));
+            put_varint(out, e.flags);
+            put_varint(out, zigzag_encode(static_cast<int64_t>(e.reloc_first - reloc_end)));
+            put_varint(out, e.reloc_count);
+            put_varint(out, e.rules_tag ^ previous.rules_tag);
+            put_u64(out, e.checksum);
+            previous = e;
+            arm_end = e.arm_offset + e.arm_size;
+            reloc_end = uint64_t(e.reloc_first) + e.reloc_count;
+        }
+    }
+
+    static bool decode_entries(const byte* data, size_t size, CacheFileEntry* file_entries, size_t count) {
+        CacheFileEntry previous;
+        memset(&previous, 0, sizeof(previous));
+        uint64_t arm_end = 0;
+        uint64_t reloc_end = 0;
+        size_t pos = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint64_t v[10];
+            uint64_t x86_hash, checksum;
+            if (!get_varint(data, size, pos, v[0]) || !get_varint(data, size, pos, v[1]) ||
+                !get_u64(data, size, pos, x86_hash) || !get_varint(data, size, pos, v[2]) ||
+                !get_varint(data, size, pos, v[3]) || !get_varint(data, size, pos, v[4]) ||
+                !get_varint(data, size, pos, v[5]) || !get_varint(data, size, pos, v[6]) ||
+                !get_varint(data, size, pos, v[7]) || !get_varint(data, size, pos, v[8]) ||
+                !get_varint(data, size, pos, v[9]) || !get_u64(data, size, pos, checksum)) {
+                return false;
+            }
+            uint64_t reloc_first = reloc_end + zigzag_decode(v[7]);
+            if (v[1] > UINT32_MAX || v[3] > UINT32_MAX || v[4] > UINT32_MAX || v[6] > UINT32_MAX ||
+                reloc_first > UINT32_MAX || v[8] > UINT32_MAX || v[9] > UINT32_MAX) {
+                return false;
+            }
+
+            CacheFileEntry& e = file_entries[i];
+            e.x86_offset = previous.x86_offset + zigzag_decode(v[0]);
+            e.x86_size = static_cast<uint32_t>(v[1]);
+            e.x86_hash = x86_hash;
+            e.arm_offset = arm_end + zigzag_decode(v[2]);
+            e.arm_size = static_cast<uint32_t>(v[3]);
+            e.execution_count = static_cast<uint32_t>(v[4]);
+            e.last_execution = previous.last_execution + zigzag_decode(v[5]);
+            e.flags = static_cast<uint32_t>(v[6]);
+            e.reloc_first = static_cast<uint32_t>(reloc_first);
+            e.reloc_count = static_cast<uint32_t>(v[8]);
+            e.rules_tag = previous.rules_tag ^ static_cast<uint32_t>(v[9]);
+            e.checksum = checksum;
+            previous = e;
+            arm_end = e.arm_offset + e.arm_size;
+            reloc_end = uint64_t(e.reloc_first) + e.reloc_count;
+        }
+        return pos == size;
+    }
+
+    // Codifica le rilocazioni; l'offset nel modulo per differenza dalla precedente
+    static void encode_relocations(const std::vector<CacheFileRelocation>& file_relocations, std::vector<byte>& out) {
+        uint64_t previous = 0;
+        for (const auto& r : file_relocations) {
+            put_varint(out, r.arm_offset);
+            put_varint(out, static_cast<uint16_t>(r.type));
+            put_varint(out, zigzag_encode(static_cast<int64_t>(r.module_offset - previous)));
+            previous = r.module_offset;
+        }
+    }
+
+    static bool decode_relocations(const byte* data, size_t size, CacheFileRelocation* file_relocations, size_t count) {
+        uint64_t previous = 0;
+        size_t pos = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint64_t arm_offset, type, delta;
+            if (!get_varint(data, size, pos, arm_offset) || !get_varint(data, size, pos, type) ||
+                !get_varint(data, size, pos, delta) || arm_offset > UINT32_MAX || type > UINT16_MAX) {
+                return false;
+            }
+            CacheFileRelocation& r = file_relocations[i];
+            r.arm_offset = static_cast<uint32_t>(arm_offset);
+            r.type = static_cast<RelocationType>(type);
+            r.reserved = 0;
+            r.module_offset = previous + zigzag_decode(delta);
+            previous = r.module_offset;
+        }
+        return pos == size;
+    }
+
+    // Decodifica un file compresso (mappato in base) in un'immagine anonima con
+    // il layout non compresso; base e header passano all'immagine
+    bool unpack(const std::string& path) {
+        packed = base;
+        packed_size = mapped_size;
+        base = nullptr;
+        mapped_size = 0;
+        header = nullptr;
+
+        CacheFileHeader file_header;
+        L2PackedSections sections;
+        if (packed_size < sizeof(file_header) + sizeof(sections)) {
+            std::cerr << "File di cache compresso troncato: " << path << std::endl;
+            return false;
+        }
+        memcpy(&file_header, packed, sizeof(file_header));
+        memcpy(&sections, packed + sizeof(file_header), sizeof(sections));
+
+        uint64_t available = packed_size - sizeof(file_header) - sizeof(sections);
+        uint64_t slots = file_header.index_slots;
+        bool valid = sections.filter_size <= available && sections.filter_size % FILTER_BLOCK == 0 &&
+                     sections.entries_size <= available - sections.filter_size &&
+                     sections.relocs_size <= available - sections.filter_size - sections.entries_size &&
+                     sections.chunk_count == (file_header.code_size + CODE_CHUNK - 1) / CODE_CHUNK &&
+                     sections.chunk_count < (available - sections.filter_size - sections.entries_size -
+                                             sections.relocs_size) / sizeof(uint64_t) &&
+                     file_header.entry_count <= sections.entries_size &&
+                     file_header.reloc_count <= sections.relocs_size &&
+                     slots != 0 && (slots & (slots - 1)) == 0 && file_header.entry_count < slots &&
+                     slots <= std::max<uint64_t>(16, 4 * uint64_t(file_header.entry_count) + 4);
+        if (!valid) {
+            std::cerr << "File di cache compresso corrotto: " << path << std::endl;
+            return false;
+        }
+
+        // Layout dell'immagine: lo stesso di un file non compresso
+        file_header.index_offset = sizeof(CacheFileHeader) + sections.filter_size;
+        file_header.entries_offset = file_header.index_offset + slots * sizeof(L2IndexSlot);
+        file_header.reloc_offset = file_header.entries_offset + uint64_t(file_header.entry_count) * sizeof(CacheFileEntry);
+        file_header.code_offset = align_up(file_header.reloc_offset + file_header.reloc_count * sizeof(CacheFileRelocation),
+                                           CODE_ALIGNMENT);
+        size_t image_size = file_header.code_offset + file_header.code_size;
+        void* image = mmap(nullptr, image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (image == MAP_FAILED) {
+            std::cerr << "Memoria insufficiente per decomprimere la cache: " << path << std::endl;
+            return false;
+        }
+        base = static_cast<byte*>(image);
+        mapped_size = image_size;
+        header = reinterpret_cast<CacheFileHeader*>(base);
+        memcpy(header, &file_header, sizeof(file_header));
+
+        const byte* data = packed + sizeof(file_header) + sizeof(sections);
+        memcpy(base + sizeof(CacheFileHeader), data, sections.filter_size);
+        data += sections.filter_size;
+        auto* image_entries = reinterpret_cast<CacheFileEntry*>(base + file_header.entries_offset);
+        if (!decode_entries(data, sections.entries_size, image_entries, file_header.entry_count) ||
+            !decode_relocations(data + sections.entries_size, sections.relocs_size,
+                                reinterpret_cast<CacheFileRelocation*>(base + file_header.reloc_offset),
+                                file_header.reloc_count)) {
+            std::cerr << "Tabelle del file di cache compresso corrotte: " << path << std::endl;
+            return false;
+        }
+        build_index(image_entries, file_header.entry_count,
+                    reinterpret_cast<L2IndexSlot*>(base + file_header.index_offset), slots);
+
+        chunk_table = data + sections.entries_size + sections.relocs_size;
+        chunk_data = chunk_table + (sections.chunk_count + 1) * sizeof(uint64_t);
+        chunk_data_size = packed + packed_size - chunk_data;
+        chunk_state.reset(new std::atomic<uint8_t>[sections.chunk_count]());
+        return true;
+    }
+
+    // Decomprime il blocco di codice i nell'immagine (chunk_mutex acquisito)
+    bool unpack_chunk(size_t i) const {
+        uint64_t start, end;
+        memcpy(&start, chunk_table + i * sizeof(uint64_t), sizeof(start));
+        memcpy(&end, chunk_table + (i + 1) * sizeof(uint64_t), sizeof(end));
+        if (start > end || end > chunk_data_size) {
+            return false;
+        }
+        size_t chunk_size = std::min<uint64_t>(CODE_CHUNK, header->code_size - i * CODE_CHUNK);
+        byte* target = base + header->code_offset + i * CODE_CHUNK;
+        // Un blocco che non si comprime è salvato così com'è
+        if (end - start == chunk_size) {
+            memcpy(target, chunk_data + start, chunk_size);
+            return true;
+        }
+        return BlockCompressor::decompress(chunk_data + start, end - start, target, chunk_size);
+    }
+
+    // Rende disponibile il codice in [offset, offset + size): per i file compressi
+    // decomprime (una sola volta) i blocchi che lo coprono
+    bool ensure_code(uint64_t offset, uint64_t size) const {
+        if (!packed || size == 0) {
+            return true;
+        }
+        for (size_t i = offset / CODE_CHUNK; i <= (offset + size - 1) / CODE_CHUNK; i++) {
+            uint8_t state = chunk_state[i].load(std::memory_order_acquire);
+            if (state == CHUNK_PENDING) {
+                std::lock_guard<std::mutex> lock(chunk_mutex);
+                state = chunk_state[i].load(std::memory_order_relaxed);
+                if (state == CHUNK_PENDING) {
+                    state = unpack_chunk(i) ? CHUNK_READY : CHUNK_CORRUPT;
+                    chunk_state[i].store(state, std::memory_order_release);
+                }
+            }
+            if (state != CHUNK_READY) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    L2CacheFile() = default;
+    L2CacheFile(const L2CacheFile&) = delete;
+    L2CacheFile& operator=(const L2CacheFile&) = delete;
+
+    ~L2CacheFile() {
+        close();
+    }
+
+    // Hash dell'indirizzo per l'indice su disco (fmix64). Fa parte del formato:
+    // non deve cambiare senza incrementare FORMAT_VERSION.
+    static uint64_t slot_hash(uint64_t x86_offset) {
+        uint64_t h = x86_offset * 0x9E3779B185EBCA87ULL;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Checksum di un'entrata: campi che non cambiano dopo la scrittura (non le
+    // statistiche di esecuzione), rilocazioni e codice ARM
+    static uint64_t entry_checksum(const CacheFileEntry& e, const CacheFileRelocation* entry_relocs, const byte* entry_code) {
+        const uint64_t fields[] = {e.x86_offset, e.x86_size, e.x86_hash, e.arm_offset, e.arm_size,
+                                   e.flags, e.reloc_first, e.reloc_count, e.rules_tag};
+        uint64_t h = XXH64(fields, sizeof(fields), 0);
+        if (e.reloc_count > 0) {
+            h = XXH64(entry_relocs, e.reloc_count * sizeof(CacheFileRelocation), h);
+        }
+        return XXH64(entry_code, e.arm_size, h);
+    }
+
+    // Chiave di contenuto del codice di un'entrata nell'archivio degli oggetti:
+    // blocco x86 (hash e dimensione), regole che l'hanno tradotto e codice ARM
+    static uint64_t object_key(const CacheFileEntry& e, const byte* entry_code) {
+        const uint64_t context[] = {e.x86_hash, e.x86_size, e.rules_tag};
+        return XXH64(entry_code, e.arm_size, XXH64(context, sizeof(context), 0));
+    }
+
+    // Vero se il codice dell'entrata può stare nell'archivio: senza rilocazioni
+    // non dipende dal modulo né dal binario
+    static bool shareable(const CacheFileEntry& e) {
+        return e.reloc_count == 0 && !(e.flags & CACHE_ENTRY_NEEDS_PATCH) && e.arm_size >= SHARED_MIN_SIZE;
+    }
+
+    // Percorso dell'archivio degli oggetti della directory di un file L2
+    static std::string object_store_path(const std::string& path) {
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        return (parent.empty() ? std::filesystem::path(".") : parent) / L2ObjectStore::FILE_NAME;
+    }
+
+    // Rende persistente una rinomina già eseguita sincronizzando la directory
+    static bool sync_parent_directory(const std::string& path) {
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        return sync_path(parent.empty() ? "." : parent.string());
+    }
+
+    // Scrive un nuovo file di cache. Le entrate sono indicizzate per offset nel
+    // modulo: più versioni dello stesso blocco condividono la catena di probing.
+    // reloc_first/reloc_count delle entrate si riferiscono a file_relocations;
+    // il checksum delle entrate è calcolato qui. Con compress il file è scritto
+    // nel formato compresso. Con objects il codice delle entrate condivisibili
+    // è salvato nell'archivio (una sola volta per contenuto) e non nel file.
+    // pace, se presente, è chiamata prima di ogni blocco di codice scritto (limitazione
+    // della banda) e interrompe la scrittura restituendo false; created riceve il
+    // creation_time del nuovo file.
+    static bool write(const std::string& path, uint64_t x86_hash, uint64_t rules_fingerprint,
+                      uint64_t previous_rules_fingerprint, const std::vector<CacheFileEntry>& file_entries,
+                      const std::vector<CacheFileRelocation>& file_relocations,
+                      const std::vector<byte>& arm_code, bool compress = false, L2ObjectStore* objects = nullptr,
+                      const std::function<bool(size_t)>& pace = nullptr, uint64_t* created = nullptr) {
+        uint64_t slots = 16;
+        while (slots < file_entries.size() * 2 + 1) {
+            slots <<= 1;
+        }
+
+        CacheFileHeader file_header;
+        memset(&file_header, 0, sizeof(file_header));
+        file_header.magic = CACHE_MAGIC;
+        file_header.version = FORMAT_VERSION;
+        file_header.entry_count = static_cast<uint32_t>(file_entries.size());
+        file_header.x86_hash = x86_hash;
+        file_header.rules_fingerprint = rules_fingerprint;
+        // Le etichette delle due impronte devono distinguersi
+        if (previous_rules_fingerprint != rules_fingerprint &&
+            rules_tag(previous_rules_fingerprint) != rules_tag(rules_fingerprint)) {
+            file_header.previous_rules_fingerprint = previous_rules_fingerprint;
+        }
+        file_header.creation_time = now();
+        file_header.last_access = file_header.creation_time;
+        std::vector<uint64_t> filter_words = build_filter(file_entries);
+        file_header.index_offset = sizeof(CacheFileHeader) + filter_words.size() * sizeof(uint64_t);
+        file_header.index_slots = slots;
+        file_header.entries_offset = file_header.index_offset + slots * sizeof(L2IndexSlot);
+        file_header.reloc_offset = file_header.entries_offset + file_entries.size() * sizeof(CacheFileEntry);
+        file_header.reloc_count = file_relocations.size();
+        file_header.code_offset = align_up(file_header.reloc_offset + file_relocations.size() * sizeof(CacheFileRelocation),
+                                           CODE_ALIGNMENT);
+
+        // arm_offset delle entrate si riferisce ad arm_code; CACHE_ENTRY_SHARED è deciso qui
+        std::vector<CacheFileEntry> checked_entries(file_entries);
+        std::vector<const byte*> entry_code(checked_entries.size());
+        for (size_t i = 0; i < checked_entries.size(); i++) {
+            CacheFileEntry& e = checked_entries[i];
+            if (e.reloc_first > file_relocations.size() || e.reloc_count > file_relocations.size() - e.reloc_first ||
+                e.arm_offset > arm_code.size() || e.arm_size > arm_code.size() - e.arm_offset) {
+                std::cerr << "Entrata fuori dai limiti nella scrittura della cache: " << path << std::endl;
+                return false;
+            }
+            e.flags &= ~CACHE_ENTRY_SHARED;
+            entry_code[i] = arm_code.data() + e.arm_offset;
+        }
+
+        // Codice condiviso: le entrate salvate nell'archivio escono dalla sezione
+        // di codice del file, che contiene solo le altre
+        std::vector<byte> local_code;
+        if (objects) {
+            std::vector<L2ObjectRequest> requests;
+            std::vector<size_t> requesters;
+            for (size_t i = 0; i < checked_entries.size(); i++) {
+                if (shareable(checked_entries[i])) {
+                    requests.push_back({object_key(checked_entries[i], entry_code[i]), entry_code[i],
+                                        checked_entries[i].arm_size});
+                    requesters.push_back(i);
+                }
+            }
+            objects->store(requests);
+            for (size_t k = 0; k < requests.size(); k++) {
+                if (requests[k].offset != 0) {
+                    checked_entries[requesters[k]].arm_offset = requests[k].offset;
+                    checked_entries[requesters[k]].flags |= CACHE_ENTRY_SHARED;
+                    file_header.format_flags |= CACHE_FORMAT_SHARED_OBJECTS;
+                }
+            }
+            for (size_t i = 0; i < checked_entries.size(); i++) {
+                CacheFileEntry& e = checked_entries[i];
+                if (!(e.flags & CACHE_ENTRY_SHARED)) {
+                    e.arm_offset = local_code.size();
+                    local_code.insert(local_code.end(), entry_code[i], entry_code[i] + e.arm_size);
+                }
+            }
+        }
+        const std::vector<byte>& file_code = objects ? local_code : arm_code;
+        file_header.code_size = file_code.size();
+
+        for (size_t i = 0; i < checked_entries.size(); i++) {
+            CacheFileEntry& e = checked_entries[i];
+            e.checksum = entry_checksum(e, file_relocations.data() + e.reloc_first, entry_code[i]);
+        }
+
+        // Sezioni del file: indice e tabelle grezze, oppure tabelle codificate e codice compresso
+        std::vector<L2IndexSlot> slot_table;
+        std::vector<byte> packed_tables;
+        std::vector<byte> packed_code;
+        std::vector<uint64_t> chunk_offsets;
+        L2PackedSections sections;
+        memset(&sections, 0, sizeof(sections));
+        if (compress) {
+            file_header.format_flags |= CACHE_FORMAT_COMPRESSED;
+            sections.filter_size = filter_words.size() * sizeof(uint64_t);
+            encode_entries(checked_entries, packed_tables);
+            sections.entries_size = packed_tables.size();
+            encode_relocations(file_relocations, packed_tables);
+            sections.relocs_size = packed_tables.size() - sections.entries_size;
+
+            for (size_t offset = 0; offset < file_code.size(); offset += CODE_CHUNK) {
+                size_t chunk = std::min(CODE_CHUNK, file_code.size() - offset);
+                size_t start = packed_code.size();
+                chunk_offsets.push_back(start);
+                BlockCompressor::compress(file_code.data() + offset, chunk, packed_code);
+                if (packed_code.size() - start >= chunk) {
+                    packed_code.resize(start);
+                    packed_code.insert(packed_code.end(), file_code.begin() + offset, file_code.begin() + offset + chunk);
+                }
+            }
+            sections.chunk_count = chunk_offsets.size();
+            chunk_offsets.push_back(packed_code.size());
+        } else {
+            slot_table.assign(slots, L2IndexSlot{0, 0});
+            build_index(checked_entries.data(), checked_entries.size(), slot_table.data(), slots);
+        }
+
+        // Scrive in un file temporaneo, lo sincronizza e lo rinomina: le mappature
+        // aperte restano valide e dopo un crash il percorso contiene il file
+        // precedente o quello nuovo, mai uno parziale. Il nome include il PID
+        // perché più processi possono condividere la directory.
+        std::string temp_path = path + ".tmp." + std::to_string(getpid());
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                std::cerr << "Errore nell'apertura del file di cache per scrittura: " << temp_path << std::endl;
+                return false;
+            }
+
+            file.write(reinterpret_cast<const char*>(&file_header), sizeof(file_header));
+            const std::vector<byte>& code_section = compress ? packed_code : file_code;
+            if (compress) {
+                file.write(reinterpret_cast<const char*>(&sections), sizeof(sections));
+                file.write(reinterpret_cast<const char*>(filter_words.data()), sections.filter_size);
+                file.write(reinterpret_cast<const char*>(packed_tables.data()), packed_tables.size());
+                file.write(reinterpret_cast<const char*>(chunk_offsets.data()), chunk_offsets.size() * sizeof(uint64_t));
+            } else {
+                file.write(reinterpret_cast<const char*>(filter_words.data()), filter_words.size() * sizeof(uint64_t));
+                file.write(reinterpret_cast<const char*>(slot_table.data()), slot_table.size() * sizeof(L2IndexSlot));
+                file.write(reinterpret_cast<const char*>(checked_entries.data()), checked_entries.size() * sizeof(CacheFileEntry));
+                file.write(reinterpret_cast<const char*>(file_relocations.data()),
+                           file_relocations.size() * sizeof(CacheFileRelocation));
+
+                std::vector<char> padding(file_header.code_offset - file_header.reloc_offset -
+                                          file_relocations.size() * sizeof(CacheFileRelocation), 0);
+                file.write(padding.data(), padding.size());
+            }
+            for (size_t written = 0; written < code_section.size() && file; ) {
+                size_t chunk = std::min(WRITE_CHUNK, code_section.size() - written);
+                if (pace && !pace(chunk)) {
+                    file.close();
+                    std::remove(temp_path.c_str());
+                    return false;
+                }
+                file.write(reinterpret_cast<const char*>(code_section.data() + written), chunk);
+                written += chunk;
+            }
+
+            file.flush();
+            if (!file) {
+                std::cerr << "Errore nella scrittura del file di cache: " << temp_path << std::endl;
+                file.close();
+                std::remove(temp_path.c_str());
+                return false;
+            }
+        }
+
+        if (!sync_path(temp_path)) {
+            std::cerr << "Errore nella sincronizzazione del file di cache: " << temp_path << std::endl;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(temp_path, path, ec);
+        if (ec) {
+            std::cerr << "Errore nella sostituzione del file di cache: " << path << " (" << ec.message() << ")" << std::endl;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        sync_parent_directory(path);
+        if (created) {
+            *created = file_header.creation_time;
+        }
+        return true;
+    }
+
+    // Mappa un file di cache; expected_hash = 0 non verifica l'hash del binario
+    bool open(const std::string& path, uint64_t expected_hash = 0) {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDWR);
+        writable = (fd >= 0);
+        if (fd < 0) {
+            fd = ::open(path.c_str(), O_RDONLY);
+        }
+        if (fd < 0) {
+            return false;
+        }
+        if (!map_file(fd, path, expected_hash)) {
+            return false;
+        }
+
+        // Il log è facoltativo: senza, il file base resta utilizzabile
+        if (!log.open(path + ".log", header->creation_time, header->x86_hash, writable)) {
+            std::cerr << "Log della cache non disponibile: " << path << ".log" << std::endl;
+        }
+        return true;
+    }
+
+    // Mappa in sola lettura un file di cache e il suo log ricevuti come descrittori
+    // (ad es. dal daemon di traduzione), di cui prende possesso; log_fd < 0 se
+    // il log manca. path serve per i messaggi e per trovare l'archivio degli oggetti.
+    bool open_fd(int file_fd, int log_fd, const std::string& path, uint64_t expected_hash = 0) {
+        close();
+        writable = false;
+        if (!map_file(file_fd, path, expected_hash)) {
+            if (log_fd >= 0) {
+                ::close(log_fd);
+            }
+            return false;
+        }
+        if (log_fd >= 0 && !log.open_fd(log_fd, header->creation_time, header->x86_hash)) {
+            std::cerr << "Log della cache non disponibile: " << path << ".log" << std::endl;
+        }
+        return true;
+    }
+
+private:
+    // Mappa il file aperto in fd, di cui prende possesso
+    bool map_file(int fd, const std::string& path, uint64_t expected_hash) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CacheFileHeader))) {
+            ::close(fd);
+            return false;
+        }
+
+        int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void* mapping = mmap(nullptr, st.st_size, protection, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            std::cerr << "Errore nella mappatura del file di cache: " << path << std::endl;
+            return false;
+        }
+
+        this->fd = fd;
+        base = static_cast<byte*>(mapping);
+        mapped_size = st.st_size;
+        header = reinterpret_cast<CacheFileHeader*>(base);
+        if (header->magic == CACHE_MAGIC && header->version == FORMAT_VERSION &&
+            (header->format_flags & CACHE_FORMAT_COMPRESSED) && !unpack(path)) {
+            close();
+            return false;
+        }
+        if (!validate(expected_hash, path)) {
+            close();
+            return false;
+        }
+
+        index = reinterpret_cast<const L2IndexSlot*>(base + header->index_offset);
+        entries = reinterpret_cast<CacheFileEntry*>(base + header->entries_offset);
+        relocations = reinterpret_cast<const CacheFileRelocation*>(base + header->reloc_offset);
+        code = base + header->code_offset;
+        filter = reinterpret_cast<const uint64_t*>(base + sizeof(CacheFileHeader));
+        filter_blocks = (header->index_offset - sizeof(CacheFileHeader)) / FILTER_BLOCK;
+        if (!packed) {
+            // Filtro e indice servono dalla prima ricerca: letti subito invece che a page fault
+            madvise(base, header->entries_offset, MADV_WILLNEED);
+        }
+        if (header->format_flags & CACHE_FORMAT_SHARED_OBJECTS) {
+            // Senza archivio le entrate condivise risultano corrotte; le altre restano utilizzabili
+            objects = L2ObjectStore::shared(object_store_path(path));
+            if (!objects) {
+                std::cerr << "Archivio degli oggetti non disponibile per la cache: " << path << std::endl;
+            }
+        }
+        entry_state.reset(new std::atomic<uint8_t>[header->entry_count]());
+        corrupt_entries = 0;
+        pending_hits.reset(new std::atomic<uint32_t>[header->entry_count]());
+        pending_file_hits = 0;
+        
+        return true;
+    }
+
+public:
+    void close() {
+        flush_stats();
+        log.close();
+        if (exec_base.load()) {
+            munmap(exec_base.load(), header->code_size);
+        }
+        if (base) {
+            munmap(base, mapped_size);
+        }
+        if (packed) {
+            munmap(packed, packed_size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+        exec_base = nullptr;
+        exec_attempted = false;
+        base = nullptr;
+        mapped_size = 0;
+        header = nullptr;
+        index = nullptr;
+        entries = nullptr;
+        relocations = nullptr;
+        code = nullptr;
+        filter = nullptr;
+        filter_blocks = 0;
+        entry_state.reset();
+        pending_hits.reset();
+        packed = nullptr;
+        packed_size = 0;
+        chunk_table = nullptr;
+        chunk_data = nullptr;
+        chunk_data_size = 0;
+        chunk_state.reset();
+        objects.reset();
+    }
+
+    bool is_open() const { return base != nullptr; }
+    const CacheFileHeader& file_header() const { return *header; }
+    size_t entry_count() const { return header ? header->entry_count : 0; }
+    const CacheFileEntry& entry(size_t i) const { return entries[i]; }
+    size_t corrupt_entry_count() const { return corrupt_entries.load(); }
+    L2LogSegment& log_segment() { return log; }
+    const L2LogSegment& log_segment() const { return log; }
+    const std::shared_ptr<L2ObjectStore>& object_store() const { return objects; }
+
+    // Vero se l'entrata appartiene al file base (altrimenti è un record del log)
+    bool in_base(const CacheFileEntry& e) const {
+        return std::less_equal<const CacheFileEntry*>()(entries, &e) &&
+               std::less<const CacheFileEntry*>()(&e, entries + entry_count());
+    }
+
+    // Visita tutte le entrate, dal log (più recenti) al file base; le entrate
+    // del file base con checksum errato sono saltate
+    template <typename Visit>
+    void for_each_entry(Visit&& visit) const {
+        log.for_each([&](const L2LogRecord& record) { visit(record.entry); });
+        for (size_t i = 0; i < entry_count(); i++) {
+            if (entry_valid(i)) {
+                visit(entries[i]);
+            }
+        }
+    }
+
+    // Etichetta per entrata di un'impronta delle regole
+    static uint32_t rules_tag(uint64_t rules_fingerprint) { return static_cast<uint32_t>(rules_fingerprint); }
+
+    // Impronta delle regole con cui è stata tradotta l'entrata: dal record per il
+    // log, dall'etichetta per il file base. Falso se l'etichetta non corrisponde
+    // a nessuna delle due impronte registrate nell'header.
+    bool entry_fingerprint(const CacheFileEntry& e, uint64_t& fingerprint) const {
+        if (!in_base(e)) {
+            const L2LogRecord* record = log.record_of(e);
+            if (!record) {
+                return false;
+            }
+            fingerprint = record->rules_fingerprint;
+            return true;
+        }
+        if (e.rules_tag == rules_tag(header->rules_fingerprint)) {
+            fingerprint = header->rules_fingerprint;
+            return true;
+        }
+        if (header->previous_rules_fingerprint != 0 && e.rules_tag == rules_tag(header->previous_rules_fingerprint)) {
+            fingerprint = header->previous_rules_fingerprint;
+            return true;
+        }
+        return false;
+    }
+
+    // Vero se l'entrata è stata tradotta con le regole indicate
+    bool is_current(const CacheFileEntry& e, uint64_t rules_fingerprint) const {
+        uint64_t fingerprint = 0;
+        return entry_fingerprint(e, fingerprint) && fingerprint == rules_fingerprint;
+    }
+
+    // Falso se il file non ha certamente entrate per l'offset: il filtro di Bloom
+    // esclude il file base senza toccare l'indice, poi si consulta il log
+    bool may_contain(uint64_t x86_offset) const {
+        if (!base) {
+            return false;
+        }
+        if (filter_blocks == 0) {
+            return true;
+        }
+        bool present = true;
+        filter_bits(x86_offset, filter_blocks, [&](uint64_t word, uint64_t mask) {
+            present = present && (filter[word] & mask);
+        });
+        return present || log.contains(x86_offset);
+    }
+
+    // Cerca un'entrata per offset nel modulo, prima nel log e poi nel file base;
+    // match decide tra le versioni dello stesso blocco. Le entrate del file base
+    // sono verificate al primo accesso.
+    template <typename Match>
+    const CacheFileEntry* find(uint64_t x86_offset, Match&& match) const {
+        if (!base) {
+            return nullptr;
+        }
+        if (const CacheFileEntry* logged = log.find(x86_offset, match)) {
+            return logged;
+        }
+
+        uint64_t h = slot_hash(x86_offset);
+        uint32_t tag = static_cast<uint32_t>(h >> 32);
+        uint64_t mask = header->index_slots - 1;
+        for (uint64_t pos = h & mask, probes = 0; probes <= mask; pos = (pos + 1) & mask, probes++) {
+            const L2IndexSlot& slot = index[pos];
+            if (slot.entry == 0) {
+                return nullptr;
+            }
+            if (slot.tag == tag && slot.entry <= header->entry_count) {
+                const CacheFileEntry& e = entries[slot.entry - 1];
+                if (e.x86_offset == x86_offset && match(e) && entry_valid(slot.entry - 1)) {
+                    return &e;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // Codice ARM di un'entrata nella mappatura (nullptr se fuori dalla sezione)
+    const byte* code_of(const CacheFileEntry& e) const {
+        if (!in_base(e)) {
+            const L2LogRecord* record = log.record_of(e);
+            return record ? record->code.data() : nullptr;
+        }
+        if (e.flags & CACHE_ENTRY_SHARED) {
+            return objects ? objects->code_at(e.arm_offset, e.arm_size) : nullptr;
+        }
+        if (e.arm_offset > header->code_size || e.arm_size > header->code_size - e.arm_offset ||
+            !ensure_code(e.arm_offset, e.arm_size)) {
+            return nullptr;
+        }
+        return code + e.arm_offset;
+    }
+
+    // Record di rilocazione di un'entrata (nullptr se fuori dalla sezione)
+    const CacheFileRelocation* relocations_of(const CacheFileEntry& e) const {
+        if (!in_base(e)) {
+            // Un record senza rilocazioni restituisce comunque un puntatore valido
+            static const CacheFileRelocation no_relocations{};
+            const L2LogRecord* record = log.record_of(e);
+            if (!record) {
+                return nullptr;
+            }
+            return record->relocations.empty() ? &no_relocations : record->relocations.data();
+        }
+        if (e.reloc_first > header->reloc_count || e.reloc_count > header->reloc_count - e.reloc_first) {
+            return nullptr;
+        }
+        return relocations + e.reloc_first;
+    }
+
+    // Codice di un'entrata eseguibile direttamente dalla mappatura, senza copie.
+    // Restituisce nullptr se l'entrata richiede patch o se la sezione di codice
+    // non può essere mappata (offset non allineato alla pagina, mmap rifiutata).
+    // Il puntatore resta valido finché il file non viene chiuso. Le entrate del
+    // log sono sempre copiate: diventano eseguibili sul posto dopo la compattazione;
+    // così anche quelle di un file compresso, il cui codice non è nel file. Il
+    // codice condiviso è eseguito dalla mappatura dell'archivio degli oggetti.
+    const byte* executable_code_of(const CacheFileEntry& e) {
+        if (in_base(e) && (e.flags & CACHE_ENTRY_SHARED)) {
+            bool patched = e.reloc_count > 0 || (e.flags & CACHE_ENTRY_NEEDS_PATCH);
+            return !patched && objects && objects->is_executable() ? code_of(e) : nullptr;
+        }
+        if (packed || !in_base(e) || (e.flags & CACHE_ENTRY_NEEDS_PATCH) || e.reloc_count > 0 || !code_of(e)) {
+            return nullptr;
+        }
+
+        byte* mapped = exec_base.load(std::memory_order_acquire);
+        if (!mapped) {
+            std::lock_guard<std::mutex> lock(exec_mutex);
+            if (!exec_attempted) {
+                exec_attempted = true;
+                long page_size = sysconf(_SC_PAGESIZE);
+                if (header->code_size > 0 && page_size > 0 && header->code_offset % page_size == 0) {
+                    void* mapping = mmap(nullptr, header->code_size, PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                                         fd, static_cast<off_t>(header->code_offset));
+                    if (mapping != MAP_FAILED) {
+                        exec_base.store(static_cast<byte*>(mapping), std::memory_order_release);
+                    }
+                }
+            }
+            mapped = exec_base.load(std::memory_order_acquire);
+        }
+
+        return mapped ? mapped + e.arm_offset : nullptr;
+    }
+
+    // Registra un hit in memoria, senza toccare la mappatura: vedi flush_stats
+    // (o take_hits per una mappatura in sola lettura)
+    void record_hit(const CacheFileEntry& e) {
+        if (in_base(e)) {
+            pending_hits[&e - entries].fetch_add(1, std::memory_order_relaxed);
+        }
+        pending_file_hits.fetch_add(1, std::memory_order_relaxed);
+        last_hit.store(now(), std::memory_order_relaxed);
+    }
+
+    // Applica alla mappatura condivisa gli hit accumulati, con un solo passaggio
+    // sulle entrate; last_execution diventa l'istante dell'ultimo hit del file.
+    // Per le entrate del log aggiorna solo l'header; per un file compresso solo
+    // l'immagine in memoria. Restituisce il numero di entrate aggiornate.
+    size_t flush_stats() {
+        if (!base || !writable || pending_file_hits.load(std::memory_order_relaxed) == 0) {
+            return 0;
+        }
+        uint64_t hits = pending_file_hits.exchange(0, std::memory_order_acq_rel);
+        uint64_t timestamp = last_hit.load(std::memory_order_relaxed);
+
+        size_t updated = 0;
+        for (size_t i = 0; i < entry_count(); i++) {
+            if (pending_hits[i].load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            uint32_t count = pending_hits[i].exchange(0, std::memory_order_relaxed);
+            // Altri processi possono aggiornare la stessa entrata
+            __atomic_fetch_add(&entries[i].execution_count, count, __ATOMIC_RELAXED);
+            __atomic_store_n(&entries[i].last_execution, timestamp, __ATOMIC_RELAXED);
+            updated++;
+        }
+        __atomic_fetch_add(&header->hit_count, hits, __ATOMIC_RELAXED);
+        __atomic_store_n(&header->last_access, timestamp, __ATOMIC_RELAXED);
+        return updated;
+    }
+
+    // Registra un hit per la versione del blocco con l'hash indicato, ad es. un
+    // hit nella regione condivisa che pubblica il codice del file
+    void record_hit_at(uint64_t x86_offset, uint64_t x86_hash) {
+        const CacheFileEntry* e = find(x86_offset, [x86_hash](const CacheFileEntry& c) { return c.x86_hash == x86_hash; });
+        if (e) {
+            record_hit(*e);
+        }
+    }
+
+    // Preleva gli hit accumulati su una mappatura in sola lettura, che
+    // flush_stats non può applicare, per inviarli a chi possiede il file (il
+    // daemon di traduzione). Aggiunge a hits un record per entrata del file base
+    // e restituisce gli hit totali del file.
+    uint64_t take_hits(std::vector<L2HitRecord>& hits) {
+        if (!base || writable || pending_file_hits.load(std::memory_order_relaxed) == 0) {
+            return 0;
+        }
+        uint64_t file_hits = pending_file_hits.exchange(0, std::memory_order_acq_rel);
+        uint64_t timestamp = last_hit.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < entry_count(); i++) {
+            if (pending_hits[i].load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            L2HitRecord hit;
+            hit.x86_offset = entries[i].x86_offset;
+            hit.x86_hash = entries[i].x86_hash;
+            hit.count = pending_hits[i].exchange(0, std::memory_order_relaxed);
+            hit.reserved = 0;
+            hit.last_execution = timestamp;
+            hits.push_back(hit);
+        }
+        return file_hits;
+    }
+
+    // Applica alla mappatura gli hit prelevati con take_hits da un altro
+    // processo; restituisce il numero di entrate aggiornate
+    size_t apply_hits(const std::vector<L2HitRecord>& hits, uint64_t file_hits) {
+        if (!base || !writable) {
+            return 0;
+        }
+        uint64_t latest = last_hit.load(std::memory_order_relaxed);
+        for (const auto& hit : hits) {
+            const CacheFileEntry* e = find(hit.x86_offset, [&hit](const CacheFileEntry& c) {
+                return c.x86_hash == hit.x86_hash;
+            });
+            if (e && in_base(*e)) {
+                pending_hits[e - entries].fetch_add(hit.count, std::memory_order_relaxed);
+            }
+            latest = std::max(latest, hit.last_execution);
+        }
+        last_hit.store(latest, std::memory_order_relaxed);
+        pending_file_hits.fetch_add(file_hits, std::memory_order_relaxed);
+        return flush_stats();
+    }
+};
+
+#endif // CACHE_L2_H
@@ -0,0 +1,391 @@
+/**
+ * cache-objects.h - Archivio condiviso del codice ARM della cache L2 di Mini-Rosetta
+ *
+ * Gli stessi blocchi x86 compaiono in molti binari (libc statica, stub del
+ * runtime) e più volte nello stesso binario (funzioni inline): ogni file L2 ne
+ * conserverebbe una copia. L'archivio (objects.pack nella directory di cache)
+ * contiene ogni traduzione una sola volta, indirizzata per contenuto; le
+ * entrate dei file L2 con CACHE_ENTRY_SHARED ne riportano l'offset al posto di
+ * un offset nella propria sezione di codice.
+ *
+ * Layout: [L2ObjectStoreHeader][oggetto]*
+ *   oggetto = [L2ObjectHeader][codice ARM][padding fino a OBJECT_ALIGNMENT]
+ *
+ * La chiave di un oggetto è calcolata dallo scrittore (vedi L2CacheFile::object_key)
+ * da hash del blocco x86, contesto di traduzione e codice; a parità di chiave
+ * l'oggetto è riusato solo se i byte coincidono. Il file è append-only: gli
+ * oggetti non si spostano mai, quindi i file L2 che li riferiscono e i
+ * puntatori nella mappatura restano validi. Gli append avvengono sotto flock e sono
+ * sincronizzati su disco prima che un file L2 possa riferirli.
+ *
+ * Il file è mappato in lettura ed esecuzione: il codice condiviso gira dalla
+ * page cache, con una sola copia fisica per tutti i processi e i binari.
+ * La mappatura copre MAX_STORE_SIZE fin dall'apertura, quindi non si sposta
+ * quando l'archivio cresce; si leggono solo gli offset entro la dimensione
+ * del file verificata con fstat (le pagine oltre la fine darebbero SIGBUS).
+ * Gli oggetti non più riferiti non vengono recuperati; oltre MAX_STORE_SIZE
+ * l'archivio non cresce e il codice nuovo resta nei file L2.
+ */
+
+#ifndef CACHE_OBJECTS_H
+#define CACHE_OBJECTS_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using byte = uint8_t;
+
+// Header dell'archivio degli oggetti
+struct L2ObjectStoreHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+};
+
+// Header di un oggetto, seguito dal codice
+struct L2ObjectHeader {
+    uint32_t magic;
+    uint32_t size;            // Byte di codice
+    uint64_t key;             // Chiave di contenuto
+    uint64_t reserved[2];
+};
+
+// Richiesta di salvataggio di un oggetto
+struct L2ObjectRequest {
+    uint64_t key;
+    const byte* code;
+    uint32_t size;
+    uint64_t offset = 0;      // Offset del codice nell'archivio (0 = non salvato)
+};
+
+class L2ObjectStore {
+public:
+    static constexpr uint64_t STORE_MAGIC = 0x534A424F534F5243; // "CROSOBJS" in hex
+    static constexpr uint32_t STORE_VERSION = 1;
+    static constexpr uint32_t OBJECT_MAGIC = 0x4A424F43;       // "COBJ" in hex
+    static constexpr size_t OBJECT_ALIGNMENT = 16;
+    static constexpr uint64_t MAX_STORE_SIZE = 1ULL << 30;
+    static constexpr const char* FILE_NAME = "objects.pack";
+
+private:
+    int fd = -1;
+    bool writable = false;
+    mutable bool executable = false;
+    std::string store_path;
+
+    mutable std::shared_mutex mutex;           // Protegge valid_size, index e indexed_size
+    byte* mapping = nullptr;                   // MAX_STORE_SIZE byte riservati all'apertura
+    mutable size_t valid_size = 0;             // Byte del file verificati con fstat, leggibili in mapping
+    std::unordered_multimap<uint64_t, uint64_t> index; // chiave -> offset del codice (solo per gli scrittori)
+    uint64_t indexed_size = 0;                         // Byte del file già indicizzati
+
+    static uint64_t align_up(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Riserva la mappatura dell'intero MAX_STORE_SIZE (mutex acquisito in scrittura)
+    bool map_locked() {
+        void* new_mapping = mmap(nullptr, MAX_STORE_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        executable = (new_mapping != MAP_FAILED);
+        if (!executable) {
+            // Filesystem montato noexec: il codice condiviso viene copiato
+            new_mapping = mmap(nullptr, MAX_STORE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        if (new_mapping == MAP_FAILED) {
+            return false;
+        }
+        mapping = static_cast<byte*>(new_mapping);
+        return true;
+    }
+
+    // Aggiorna valid_size alla dimensione corrente del file (mutex acquisito in
+    // scrittura). L'archivio è append-only: valid_size non diminuisce.
+    bool refresh_size_locked() const {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+        size_t size = std::min<uint64_t>(st.st_size, MAX_STORE_SIZE);
+        valid_size = std::max(valid_size, size);
+        return true;
+    }
+
+    // Header dell'oggetto il cui codice inizia a offset (mutex acquisito)
+    bool object_at_locked(uint64_t offset, L2ObjectHeader& object) const {
+        if (offset < sizeof(L2ObjectStoreHeader) + sizeof(L2ObjectHeader) || offset % OBJECT_ALIGNMENT != 0 ||
+            offset > valid_size) {
+            return false;
+        }
+        memcpy(&object, mapping + offset - sizeof(L2ObjectHeader), sizeof(object));
+        return object.magic == OBJECT_MAGIC && object.size <= valid_size - offset;
+    }
+
+    // Indicizza gli oggetti aggiunti dopo indexed_size, da questo o da altri
+    // processi. La scansione si ferma al primo oggetto incompleto (append
+    // interrotto da un crash): i byte che seguono non sono riferiti da nessun
+    // file L2 e il prossimo append li sovrascrive. Mutex acquisito in scrittura e flock.
+    bool catch_up_locked() {
+        if (!refresh_size_locked()) {
+            return false;
+        }
+        uint64_t pos = std::max<uint64_t>(indexed_size, sizeof(L2ObjectStoreHeader));
+        while (pos + sizeof(L2ObjectHeader) <= valid_size) {
+            L2ObjectHeader object;
+            uint64_t code_offset = pos + sizeof(L2ObjectHeader);
+            if (!object_at_locked(code_offset, object)) {
+                break;
+            }
+            index.emplace(object.key, code_offset);
+            pos = align_up(code_offset + object.size, OBJECT_ALIGNMENT);
+        }
+        indexed_size = pos;
+        return true;
+    }
+
+    // Offset di un oggetto già presente con la stessa chiave e gli stessi byte (0 = assente)
+    uint64_t find_locked(const L2ObjectRequest& request) const {
+        auto range = index.equal_range(request.key);
+        for (auto it = range.first; it != range.second; ++it) {
+            L2ObjectHeader object;
+            if (object_at_locked(it->second, object) && object.size == request.size &&
+                it->second + object.size <= valid_size &&
+                memcmp(mapping + it->second, request.code, request.size) == 0) {
+                return it->second;
+            }
+        }
+        return 0;
+    }
+
+public:
+    L2ObjectStore() = default;
+    L2ObjectStore(const L2ObjectStore&) = delete;
+    L2ObjectStore& operator=(const L2ObjectStore&) = delete;
+
+    ~L2ObjectStore() {
+        close();
+    }
+
+    // Archivio del percorso condiviso da tutto il processo: i file L2 della
+    // stessa directory usano una sola mappatura. nullptr se non può essere aperto.
+    static std::shared_ptr<L2ObjectStore> shared(const std::string& path) {
+        static std::mutex registry_mutex;
+        static std::unordered_map<std::string, std::weak_ptr<L2ObjectStore>> registry;
+
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        std::weak_ptr<L2ObjectStore>& slot = registry[path];
+        if (auto store = slot.lock()) {
+            return store;
+        }
+        auto store = std::make_shared<L2ObjectStore>();
+        if (!store->open(path)) {
+            registry.erase(path);
+            return nullptr;
+        }
+        slot = store;
+        return store;
+    }
+
+    // Apre (o crea, se la directory è scrivibile) l'archivio
+    bool open(const std::string& path) {
+        close();
+
+        store_path = path;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        writable = (fd >= 0);
+        if (fd < 0) {
+            fd = ::open(path.c_str(), O_RDONLY);
+        }
+        if (fd < 0) {
+            return false;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (writable && flock(fd, LOCK_EX) != 0) {
+            lock.unlock();
+            close();
+            return false;
+        }
+
+        L2ObjectStoreHeader header;
+        bool ok = pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+        if (!ok && writable) {
+            // Archivio nuovo (o creato da un processo interrotto prima dell'header)
+            memset(&header, 0, sizeof(header));
+            header.magic = STORE_MAGIC;
+            header.version = STORE_VERSION;
+            ok = ftruncate(fd, 0) == 0 && pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+                 fsync(fd) == 0;
+        }
+        ok = ok && header.magic == STORE_MAGIC && header.version == STORE_VERSION && map_locked() &&
+             refresh_size_locked();
+        if (!ok) {
+            std::cerr << "Archivio degli oggetti non valido o versione non supportata: " << path << std::endl;
+        }
+
+        if (writable) {
+            flock(fd, LOCK_UN);
+        }
+        if (!ok) {
+            lock.unlock();
+            close();
+        }
+        return ok;
+    }
+
+    // Sostituisce il descrittore con uno nuovo per lo stesso file, ad es. nel
+    // figlio di un fork: i flock sono legati alla descrizione del file, quindi
+    // processi che la condividono non si escluderebbero. La mappatura resta valida.
+    bool reopen_descriptor() {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (fd < 0) {
+            return false;
+        }
+        int fresh = ::open(store_path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fresh < 0) {
+            return false;
+        }
+        bool ok = dup2(fresh, fd) >= 0;
+        ::close(fresh);
+        return ok;
+    }
+
+    void close() {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (mapping) {
+            munmap(mapping, MAX_STORE_SIZE);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+        writable = false;
+        executable = false;
+        mapping = nullptr;
+        valid_size = 0;
+        index.clear();
+        indexed_size = 0;
+    }
+
+    bool is_open() const { return fd >= 0; }
+    bool is_writable() const { return writable; }
+
+    // Vero se il codice restituito da code_at può essere eseguito sul posto
+    bool is_executable() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return executable;
+    }
+
+    uint64_t size_bytes() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return valid_size;
+    }
+
+    // Salva gli oggetti delle richieste con una sola scrittura, sincronizzata su
+    // disco prima di restituire; gli oggetti già presenti (anche più volte nella
+    // stessa chiamata) sono riusati. Le richieste che non trovano posto restano
+    // con offset 0. Restituisce false se l'archivio non è scrivibile.
+    bool store(std::vector<L2ObjectRequest>& requests) {
+        if (!writable) {
+            return false;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (flock(fd, LOCK_EX) != 0) {
+            return false;
+        }
+
+        bool ok = catch_up_locked();
+        uint64_t start = indexed_size;
+        std::vector<byte> buffer;
+        std::unordered_multimap<uint64_t, size_t> added; // chiave -> richiesta che crea l'oggetto
+        for (size_t i = 0; ok && i < requests.size(); i++) {
+            L2ObjectRequest& request = requests[i];
+            request.offset = find_locked(request);
+            if (request.offset != 0) {
+                continue;
+            }
+
+            auto range = added.equal_range(request.key);
+            for (auto it = range.first; it != range.second && request.offset == 0; ++it) {
+                const L2ObjectRequest& first = requests[it->second];
+                if (first.size == request.size && memcmp(first.code, request.code, request.size) == 0) {
+                    request.offset = first.offset;
+                }
+            }
+            uint64_t object_size = align_up(sizeof(L2ObjectHeader) + request.size, OBJECT_ALIGNMENT);
+            if (request.offset != 0 || start + buffer.size() + object_size > MAX_STORE_SIZE) {
+                continue;
+            }
+
+            L2ObjectHeader object;
+            memset(&object, 0, sizeof(object));
+            object.magic = OBJECT_MAGIC;
+            object.size = request.size;
+            object.key = request.key;
+            size_t pos = buffer.size();
+            buffer.resize(pos + object_size, 0);
+            memcpy(buffer.data() + pos, &object, sizeof(object));
+            memcpy(buffer.data() + pos + sizeof(object), request.code, request.size);
+            request.offset = start + pos + sizeof(object);
+            added.emplace(request.key, i);
+        }
+
+        if (ok && !buffer.empty()) {
+            ok = pwrite(fd, buffer.data(), buffer.size(), static_cast<off_t>(start)) == static_cast<ssize_t>(buffer.size()) &&
+                 fsync(fd) == 0;
+            if (ok) {
+                for (const auto& [key, i] : added) {
+                    index.emplace(key, requests[i].offset);
+                }
+                indexed_size = start + buffer.size();
+            } else {
+                // indexed_size non avanza: il prossimo append sovrascrive la scrittura parziale
+                std::cerr << "Errore nella scrittura dell'archivio degli oggetti" << std::endl;
+            }
+        }
+        flock(fd, LOCK_UN);
+
+        if (!ok) {
+            for (auto& request : requests) {
+                request.offset = 0;
+            }
+        }
+        return ok;
+    }
+
+    // Codice dell'oggetto di size byte che inizia a offset (nullptr se l'oggetto
+    // non esiste o ha un'altra dimensione). Il puntatore resta valido fino alla
+    // chiusura dell'archivio; il contenuto è verificato dal checksum dell'entrata.
+    const byte* code_at(uint64_t offset, uint32_t size) const {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            if (offset <= valid_size && size <= valid_size - offset) {
+                L2ObjectHeader object;
+                return object_at_locked(offset, object) && object.size == size ? mapping + offset : nullptr;
+            }
+        }
+
+        // Oggetto aggiunto dopo l'ultimo fstat (da un altro processo o binario)
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        L2ObjectHeader object;
+        if (fd < 0 || !refresh_size_locked() || !object_at_locked(offset, object) || object.size != size) {
+            return nullptr;
+        }
+        return mapping + offset;
+    }
+};
+
+#endif // CACHE_OBJECTS_H
@@ -1,3 +1,6 @@
+#ifndef CACHE_PERSISTENCE_H
+#define CACHE_PERSISTENCE_H
+
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -9,7 +12,88 @@
 #include <atomic>
 #include <thread>
 #include <queue>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <functional>
+#include <future>
+#include <algorithm>
 #include <condition_variable>
+#ifdef __APPLE__
+#include <sys/resource.h>
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "cache-l2.h"
+
+// Limitatore di banda a token bucket per l'I/O di manutenzione
+class IoRateLimiter {
+private:
+    double bytes_per_second;
+    double tokens;
+    std::chrono::steady_clock::time_point last_refill;
+
+public:
+    explicit IoRateLimiter(double rate)
+        : bytes_per_second(rate), tokens(rate), last_refill(std::chrono::steady_clock::now()) {}
+
+    // Attende finché bytes possono essere trasferiti (raffica massima: un secondo di banda)
+    void acquire(size_t bytes) {
+        if (bytes_per_second <= 0) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_refill).count();
+        tokens = std::min(bytes_per_second, tokens + elapsed * bytes_per_second);
+        last_refill = now;
+
+        tokens -= static_cast<double>(bytes);
+        if (tokens < 0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(-tokens / bytes_per_second));
+        }
+    }
+};
+
+// Abbassa la priorità di I/O del thread corrente finché l'oggetto è in vita:
+// la compattazione non deve rallentare le letture e le scritture della cache
+class LowIoPriorityScope {
+private:
+    int previous = -1;
+
+#if defined(__linux__)
+    static constexpr int IOPRIO_WHO_PROCESS = 1;  // Con id 0: il thread corrente
+    static constexpr int IOPRIO_CLASS_IDLE = 3;
+    static constexpr int IOPRIO_CLASS_SHIFT = 13;
+#endif
+
+public:
+    LowIoPriorityScope() {
+#ifdef __APPLE__
+        previous = getiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD);
+        setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE);
+#elif defined(__linux__)
+        previous = static_cast<int>(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0));
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+    }
+
+    ~LowIoPriorityScope() {
+        if (previous < 0) {
+            return;
+        }
+#ifdef __APPLE__
+        setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, previous);
+#elif defined(__linux__)
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, previous);
+#endif
+    }
+
+    LowIoPriorityScope(const LowIoPriorityScope&) = delete;
+    LowIoPriorityScope& operator=(const LowIoPriorityScope&) = delete;
+};
 
 // Classe per gestire la persistenza della cache su disco in modo asincrono
 class PersistenceManager {
@@ -22,13 +106,39 @@ private:
         std::function<void(bool)> callback;     // Callback da chiamare al completamento
     };
     
-    // Thread worker e sincronizzazione
+    // Record del log L2 in attesa, raggruppati per binario
+    struct LogRecordBatch {
+        std::shared_ptr<L2CacheFile> file;      // File L2 più recente del binario
+        std::vector<L2LogRecord> records;
+        size_t bytes = 0;
+        std::chrono::steady_clock::time_point first_record;
+    };
+    
+    // Thread worker e sincronizzazione. Compattazione e manutenzione, lente e
+    // limitate in banda, hanno un thread proprio: il worker resta libero per
+    // lotti di record e barriere di flush().
     std::thread worker_thread;
+    std::thread maintenance_thread;
     std::mutex queue_mutex;
     std::condition_variable condition;
+    std::condition_variable maintenance_condition;
     std::queue<WriteCacheJob> job_queue;
+    std::unordered_map<std::string, LogRecordBatch> log_batches; // binary_id -> record in attesa
     std::atomic<bool> should_terminate{false};
     
+    // Soglie di scrittura dei record L2: un lotto è scritto quando raggiunge
+    // la dimensione o quando il record più vecchio ha superato l'attesa massima
+    const size_t log_batch_bytes = 256 * 1024;
+    const std::chrono::milliseconds log_batch_delay{500};
+    std::atomic<size_t> written_log_records{0};
+    
+    // Statistiche di esecuzione L2: accumulate in memoria dalle ricerche e
+    // applicate ai file a intervalli dal worker, con un aggiornamento per file
+    std::function<size_t()> stats_flusher;
+    std::chrono::steady_clock::time_point last_stats_flush;
+    const std::chrono::seconds stats_flush_interval{5};
+    std::atomic<size_t> flushed_stat_entries{0};
+    
     // Statistiche
     std::atomic<size_t> completed_jobs{0};
     std::atomic<size_t> failed_jobs{0};
@@ -41,19 +151,79 @@ private:
     std::chrono::steady_clock::time_point last_maintenance;
     const std::chrono::seconds maintenance_interval{3600}; // Ogni ora
     const uint64_t max_cache_size = 1024 * 1024 * 1024;   // 1GB
+    
+    // Compattazione dei file L2 (file base + log)
+    std::chrono::steady_clock::time_point last_compaction;
+    const std::chrono::seconds compaction_interval{60};
+    const uint64_t compaction_min_log_bytes = 256 * 1024;  // Log più piccoli non vengono compattati
+    const double compaction_log_ratio = 0.5;                // Soglia log / file base
+    const double compaction_bytes_per_second = 8.0 * 1024 * 1024;
+    std::atomic<bool> compaction_requested{false};
+    std::atomic<size_t> compacted_files{0};
+    std::atomic<uint64_t> reclaimed_bytes{0};
 
+    // Vero se un lotto di record va scritto (queue_mutex acquisito)
+    bool batch_ready(const LogRecordBatch& batch, std::chrono::steady_clock::time_point now) const {
+        return batch.bytes >= log_batch_bytes || now - batch.first_record >= log_batch_delay;
+    }
+    
+    // Preleva i lotti pronti, o tutti con all (queue_mutex acquisito)
+    std::vector<LogRecordBatch> take_log_batches(bool all) {
+        std::vector<LogRecordBatch> ready;
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = log_batches.begin(); it != log_batches.end(); ) {
+            if (all || batch_ready(it->second, now)) {
+                ready.push_back(std::move(it->second));
+                it = log_batches.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return ready;
+    }
+    
+    // Aggiunge i lotti ai log dei file L2, una scrittura per lotto
+    void write_log_batches(std::vector<LogRecordBatch>& batches) {
+        for (auto& batch : batches) {
+            size_t count = batch.records.size();
+            if (batch.file->log_segment().append(batch.records)) {
+                written_log_records += count;
+                completed_jobs++;
+            } else {
+                failed_jobs++;
+            }
+        }
+    }
+    
     // Thread worker per processare i job in background
     void worker_function() {
         while (!should_terminate) {
             WriteCacheJob job;
+            std::vector<LogRecordBatch> batches;
+            std::function<size_t()> flusher;
+            bool barrier = false;
             
             {
                 std::unique_lock<std::mutex> lock(queue_mutex);
-                condition.wait(lock, [this] { 
+                // Con record in attesa il worker si risveglia entro l'attesa massima dei lotti
+                bool had_batches = !log_batches.empty();
+                auto idle = stats_flusher ? std::min(compaction_interval, stats_flush_interval) : compaction_interval;
+                auto timeout = had_batches ? log_batch_delay
+                                           : std::chrono::duration_cast<std::chrono::milliseconds>(idle);
+                condition.wait_for(lock, timeout, [this, had_batches] { 
+                    if (!had_batches && !log_batches.empty()) {
+                        return true;
+                    }
+                    auto now = std::chrono::steady_clock::now();
+                    for (const auto& [binary_id, batch] : log_batches) {
+                        if (batch_ready(batch, now)) {
+                            return true;
+                        }
+                    }
                     return !job_queue.empty() || should_terminate; 
                 });
                 
-                if (should_terminate && job_queue.empty()) {
+                if (should_terminate && job_queue.empty() && log_batches.empty()) {
                     break;
                 }
                 
@@ -61,10 +231,28 @@ private:
                     job = std::move(job_queue.front());
                     job_queue.pop();
                 }
+                
+                // Un job senza file è la barriera di flush(): prima vanno scritti tutti i lotti
+                barrier = job.cache_file.empty() && job.callback;
+                batches = take_log_batches(barrier || should_terminate);
+                flusher = stats_flusher;
+            }
+            
+            write_log_batches(batches);
+            
+            // Statistiche di esecuzione accumulate, anche prima di completare una barriera
+            auto stats_now = std::chrono::steady_clock::now();
+            if (flusher && (barrier || should_terminate || stats_now - last_stats_flush >= stats_flush_interval)) {
+                flushed_stat_entries += flusher();
+                last_stats_flush = stats_now;
             }
             
             // Processa il job
-            if (!job.cache_file.empty()) {
+            if (job.cache_file.empty()) {
+                if (job.callback) {
+                    job.callback(true);
+                }
+            } else {
                 bool success = write_to_file(job.cache_file, job.data, job.offset);
                 
                 if (success) {
@@ -78,13 +266,33 @@ private:
                     job.callback(success);
                 }
             }
+        }
+    }
+    
+    // Thread di compattazione e manutenzione: ogni compaction_interval o su
+    // richiesta compatta i file L2 il cui log è cresciuto troppo
+    void maintenance_function() {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        while (!should_terminate) {
+            maintenance_condition.wait_for(lock, compaction_interval, [this] {
+                return should_terminate || compaction_requested;
+            });
+            if (should_terminate) {
+                break;
+            }
+            compaction_requested = false;
+            lock.unlock();
             
-            // Controlla se è necessaria manutenzione della cache
+            compact_segments();
             auto now = std::chrono::steady_clock::now();
+            last_compaction = now;
+            
+            // Controlla se è necessaria manutenzione della cache
             if (now - last_maintenance > maintenance_interval) {
                 perform_maintenance();
                 last_maintenance = now;
             }
+            lock.lock();
         }
     }
     
@@ -133,6 +341,179 @@ private:
         }
     }
     
+    // Vero se il file L2 va compattato: log grande rispetto al file base. Regole
+    // diverse da sole non bastano: processi con regole diverse possono
+    // condividere il file e ognuno ritraduce nel log solo ciò che gli manca.
+    bool needs_compaction(const std::filesystem::path& cache_file) {
+        std::error_code ec;
+        uint64_t base_size = std::filesystem::file_size(cache_file, ec);
+        if (ec) {
+            return false;
+        }
+        uint64_t log_size = std::filesystem::file_size(cache_file.string() + ".log", ec);
+        return !ec && log_size >= compaction_min_log_bytes && log_size > base_size * compaction_log_ratio;
+    }
+    
+    // Compatta i file L2 che ne hanno bisogno
+    void compact_segments() {
+        try {
+            std::vector<std::filesystem::path> candidates;
+            for (const auto& entry : std::filesystem::directory_iterator(cache_directory)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".cache" && needs_compaction(entry.path())) {
+                    candidates.push_back(entry.path());
+                }
+            }
+            
+            for (const auto& path : candidates) {
+                if (should_terminate) {
+                    break;
+                }
+                compact_cache_file(path.string());
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Errore durante la compattazione della cache: " << e.what() << std::endl;
+        }
+    }
+    
+    // Unisce file base e log in un nuovo file base (interrotta da stop_worker,
+    // che non attende la fine di un file grande). Scarta le versioni superate
+    // (stesso blocco, codice guest e regole: vale la più recente). Conserva le
+    // entrate delle due impronte delle regole usate più di recente, qualunque
+    // sia quella del processo che compatta: la più recente diventa l'impronta
+    // del file, l'altra quella precedente; le entrate di regole più vecchie
+    // sono scartate. Le entrate calde sono scritte per prime e contigue. Il
+    // nuovo file è scritto a parte e rinominato: i lettori della mappatura
+    // esistente non vengono mai bloccati.
+    bool compact_cache_file(const std::string& path) {
+        LowIoPriorityScope io_priority;
+        IoRateLimiter limiter(compaction_bytes_per_second);
+        
+        L2CacheFile file;
+        if (!file.open(path)) {
+            return false;
+        }
+        
+        uint64_t merged_bytes = file.log_segment().size_bytes();
+        
+        // Impronte dalla più recente: record del log, poi quelle del file base
+        std::vector<uint64_t> fingerprints;
+        auto note_fingerprint = [&fingerprints](uint64_t fingerprint) {
+            if (std::find(fingerprints.begin(), fingerprints.end(), fingerprint) == fingerprints.end()) {
+                fingerprints.push_back(fingerprint);
+            }
+        };
+        file.log_segment().for_each([&](const L2LogRecord& record) { note_fingerprint(record.rules_fingerprint); });
+        note_fingerprint(file.file_header().rules_fingerprint);
+        if (file.file_header().previous_rules_fingerprint != 0) {
+            note_fingerprint(file.file_header().previous_rules_fingerprint);
+        }
+        uint64_t current = fingerprints[0];
+        uint64_t previous = 0;
+        for (size_t i = 1; i < fingerprints.size() && previous == 0; i++) {
+            if (L2CacheFile::rules_tag(fingerprints[i]) != L2CacheFile::rules_tag(current)) {
+                previous = fingerprints[i];
+            }
+        }
+        
+        struct KeptEntry {
+            CacheFileEntry entry;
+            const byte* code;
+            const CacheFileRelocation* relocations;
+        };
+        std::vector<KeptEntry> kept;
+        std::set<std::tuple<uint64_t, uint64_t, uint64_t>> seen;
+        size_t superseded = 0;
+        size_t stale = 0;
+        
+        // Dal più recente: log in ordine inverso, poi file base
+        file.for_each_entry([&](const CacheFileEntry& e) {
+            const byte* code = file.code_of(e);
+            const CacheFileRelocation* relocs = file.relocations_of(e);
+            if (!code || !relocs) {
+                return;
+            }
+            
+            uint64_t entry_fingerprint;
+            if (!file.entry_fingerprint(e, entry_fingerprint) ||
+                (entry_fingerprint != current && (previous == 0 || entry_fingerprint != previous))) {
+                stale++;
+                return;
+            }
+            if (!seen.insert({e.x86_offset, e.x86_hash, entry_fingerprint}).second) {
+                superseded++;
+                return;
+            }
+            
+            KeptEntry k{e, code, relocs};
+            k.entry.rules_tag = L2CacheFile::rules_tag(entry_fingerprint);
+            kept.push_back(k);
+        });
+        
+        std::stable_sort(kept.begin(), kept.end(), [](const KeptEntry& a, const KeptEntry& b) {
+            return a.entry.execution_count > b.entry.execution_count;
+        });
+        
+        std::vector<CacheFileEntry> file_entries;
+        std::vector<CacheFileRelocation> file_relocations;
+        std::vector<byte> arm_code;
+        file_entries.reserve(kept.size());
+        for (auto& k : kept) {
+            if (should_terminate) {
+                return false;
+            }
+            // La lettura dalla mappatura è I/O: rientra nel limite di banda
+            limiter.acquire(k.entry.arm_size);
+            k.entry.arm_offset = arm_code.size();
+            k.entry.reloc_first = static_cast<uint32_t>(file_relocations.size());
+            file_relocations.insert(file_relocations.end(), k.relocations, k.relocations + k.entry.reloc_count);
+            arm_code.insert(arm_code.end(), k.code, k.code + k.entry.arm_size);
+            file_entries.push_back(k.entry);
+        }
+        
+        std::error_code ec;
+        uint64_t old_size = std::filesystem::file_size(path, ec) + std::filesystem::file_size(path + ".log", ec);
+        std::string compact_path = path + ".compact";
+        uint64_t created = 0;
+        // La compattazione mantiene il formato (compresso o no, con codice condiviso o no) del file base
+        bool compress = (file.file_header().format_flags & CACHE_FORMAT_COMPRESSED) != 0;
+        if (!L2CacheFile::write(compact_path, file.file_header().x86_hash, current, previous, file_entries, file_relocations,
+                                arm_code, compress, file.object_store().get(),
+                                [this, &limiter](size_t bytes) {
+                                    limiter.acquire(bytes);
+                                    return !should_terminate;
+                                }, &created)) {
+            std::filesystem::remove(compact_path, ec);
+            return false;
+        }
+        
+        // Sostituzione del file base e riscrittura del log sotto lo stesso flock:
+        // i record aggiunti durante la compattazione restano nel log
+        bool replaced = file.log_segment().rebase(created, merged_bytes, [&] {
+            std::error_code rename_ec;
+            std::filesystem::rename(compact_path, path, rename_ec);
+            if (rename_ec) {
+                return false;
+            }
+            L2CacheFile::sync_parent_directory(path);
+            return true;
+        });
+        if (!replaced) {
+            std::filesystem::remove(compact_path, ec);
+            return false;
+        }
+        // Il log riscritto è stato rinominato dopo il file base
+        L2CacheFile::sync_parent_directory(path);
+        
+        uint64_t new_size = std::filesystem::file_size(path, ec) + std::filesystem::file_size(path + ".log", ec);
+        compacted_files++;
+        if (old_size > new_size) {
+            reclaimed_bytes += old_size - new_size;
+        }
+        std::cout << "Cache compattata: " << path << " (" << file_entries.size() << " entrate, "
+                  << superseded << " superate, " << stale << " obsolete)" << std::endl;
+        return true;
+    }
+    
     // Esegue operazioni di manutenzione della cache
     void perform_maintenance() {
         try {
@@ -144,7 +525,10 @@ private:
             
             for (const auto& entry : std::filesystem::directory_iterator(cache_directory)) {
                 if (entry.is_regular_file() && entry.path().extension() == ".cache") {
-                    uint64_t file_size = entry.file_size();
+                    // Il log fa parte del file di cache
+                    std::error_code ec;
+                    uint64_t log_size = std::filesystem::file_size(entry.path().string() + ".log", ec);
+                    uint64_t file_size = entry.file_size() + (ec ? 0 : log_size);
                     total_size += file_size;
                     cache_files.push_back({entry.path(), {file_size, entry.last_write_time()}});
                 }
@@ -174,6 +558,7 @@ private:
                     try {
                         std::cout << "Eliminazione file cache: " << file_entry.first << std::endl;
                         std::filesystem::remove(file_entry.first);
+                        std::filesystem::remove(file_entry.first.string() + ".log");
                         freed_space += file_entry.second.first;
                     } catch (const std::exception& e) {
                         std::cerr << "Errore nell'eliminazione del file: " << e.what() << std::endl;
@@ -193,25 +578,93 @@ public:
     PersistenceManager(const std::string& cache_dir = "./cache") 
         : cache_directory(cache_dir), 
           last_flush(std::chrono::steady_clock::now()),
-          last_maintenance(std::chrono::steady_clock::now()) {
+          last_maintenance(std::chrono::steady_clock::now()),
+          last_compaction(std::chrono::steady_clock::now()) {
         
         // Crea la directory di cache
         std::filesystem::create_directories(cache_directory);
         
-        // Avvia il thread worker
+        // Avvia il thread worker e quello di compattazione
         worker_thread = std::thread(&PersistenceManager::worker_function, this);
+        maintenance_thread = std::thread(&PersistenceManager::maintenance_function, this);
     }
     
     ~PersistenceManager() {
         // Attendi il completamento di tutti i job e termina il thread
+        stop_worker();
+    }
+    
+    // Ferma il worker dopo aver completato i job e i record in attesa, ad es.
+    // prima di un fork: i thread non vengono duplicati nel processo figlio. Una
+    // compattazione in corso è interrotta: il file è compattato di nuovo più avanti.
+    void stop_worker() {
+        if (!worker_thread.joinable()) {
+            return;
+        }
         flush();
         
-        should_terminate = true;
+        // Impostato sotto il lock: una notifica tra il controllo del predicato e
+        // l'attesa di un thread andrebbe persa fino al timeout
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            should_terminate = true;
+        }
         condition.notify_one();
-        
+        maintenance_condition.notify_one();
+        worker_thread.join();
+        maintenance_thread.join();
+    }
+    
+    // Riavvia il worker fermato con stop_worker (dopo un fork, nel padre e nel figlio)
+    void start_worker() {
         if (worker_thread.joinable()) {
-            worker_thread.join();
+            return;
+        }
+        should_terminate = false;
+        worker_thread = std::thread(&PersistenceManager::worker_function, this);
+        maintenance_thread = std::thread(&PersistenceManager::maintenance_function, this);
+    }
+    
+    // Accoda un record per il log L2 di un binario. Non blocca il chiamante oltre
+    // l'inserimento: la scrittura avviene nel worker, a lotti per binario.
+    void queue_log_record(const std::string& binary_id, const std::shared_ptr<L2CacheFile>& file, L2LogRecord&& record) {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            // Il primo record in attesa risveglia il worker per accorciarne l'attesa
+            wake = log_batches.empty();
+            LogRecordBatch& batch = log_batches[binary_id];
+            if (batch.records.empty()) {
+                batch.first_record = std::chrono::steady_clock::now();
+            }
+            batch.file = file;
+            batch.bytes += sizeof(L2LogRecordHeader) + sizeof(CacheFileEntry) + record.code.size() +
+                           record.relocations.size() * sizeof(CacheFileRelocation);
+            batch.records.push_back(std::move(record));
+            wake = wake || batch.bytes >= log_batch_bytes;
         }
+        
+        if (wake) {
+            condition.notify_one();
+        }
+    }
+    
+    // Imposta la funzione che applica ai file L2 le statistiche di esecuzione
+    // accumulate (ad es. TranslationCache::flush_l2_stats); nullptr la rimuove
+    void set_stats_flusher(std::function<size_t()> flusher) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stats_flusher = std::move(flusher);
+    }
+    
+    size_t get_flushed_stat_entries() const {
+        return flushed_stat_entries.load();
+    }
+    
+    // Sink per TranslationCache::set_l2_record_sink
+    L2RecordSink record_sink() {
+        return [this](const std::string& binary_id, const std::shared_ptr<L2CacheFile>& file, L2LogRecord&& record) {
+            queue_log_record(binary_id, file, std::move(record));
+        };
     }
     
     // Aggiunge un job di scrittura alla coda
@@ -231,10 +684,13 @@ public:
         condition.notify_one();
     }
     
-    // Attende il completamento di tutti i job
+    // Attende il completamento di tutti i job, la scrittura dei record L2 in
+    // attesa e l'applicazione delle statistiche di esecuzione accumulate
     void flush() {
         std::unique_lock<std::mutex> lock(queue_mutex);
-        if (job_queue.empty()) {
+        // La barriera è accodata anche con coda e lotti vuoti: il worker può
+        // star ancora scrivendo lotti già prelevati con take_log_batches
+        if (!worker_thread.joinable() || should_terminate) {
             return;
         }
         
@@ -259,6 +715,21 @@ public:
         last_flush = std::chrono::steady_clock::now();
     }
     
+    // Richiede una compattazione dei file L2 al thread di compattazione
+    void request_compaction() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            compaction_requested = true;
+        }
+        maintenance_condition.notify_one();
+    }
+    
+    // Statistiche della compattazione
+    void get_compaction_stats(size_t& files, uint64_t& bytes_reclaimed) {
+        files = compacted_files.load();
+        bytes_reclaimed = reclaimed_bytes.load();
+    }
+    
     // Forza la manutenzione della cache
     void force_maintenance() {
         perform_maintenance();
@@ -268,7 +739,7 @@ public:
     // Ottieni statistiche
     void get_stats(size_t& pending_jobs, size_t& completed, size_t& failed) {
         std::lock_guard<std::mutex> lock(queue_mutex);
-        pending_jobs = job_queue.size();
+        pending_jobs = job_queue.size() + log_batches.size();
         completed = completed_jobs.load();
         failed = failed_jobs.load();
     }
@@ -283,10 +754,13 @@ public:
             for (const auto& entry : std::filesystem::directory_iterator(cache_directory)) {
                 if (entry.is_regular_file() && entry.path().extension() == ".cache") {
                     std::filesystem::remove(entry.path());
+                    std::filesystem::remove(entry.path().string() + ".log");
                 }
             }
         } catch (const std::exception& e) {
             std::cerr << "Errore durante la pulizia della cache: " << e.what() << std::endl;
         }
     }
-};
\ No newline at end of file
+};
+
+#endif // CACHE_PERSISTENCE_H
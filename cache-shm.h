@@ -0,0 +1,485 @@
+/**
+ * cache-shm.h - Cache di traduzione in memoria condivisa di Mini-Rosetta
+ *
+ * I processi worker dello stesso binario traducono lo stesso codice: ognuno
+ * nella propria memoria ARM, con RSS che cresce con il numero di worker. La
+ * SharedCodeCache è una regione di memoria condivisa POSIX (shm_open) con nome
+ * derivato dall'ID deterministico del binario e dall'impronta delle regole
+ * (un nuovo set di regole parte da una regione vuota), che contiene un indice e il
+ * codice ARM delle traduzioni: un blocco tradotto da un worker è eseguibile da
+ * tutti gli altri, e i worker avviati dopo il primo trovano già tutto tradotto.
+ *
+ * Layout: [SharedCodeHeader][SharedCodeSlot * slot_count][codice ARM]
+ *
+ * Le entrate sono indicizzate per offset dalla base del modulo, come in L2, e
+ * contengono solo codice senza rilocazioni: valgono per qualunque indirizzo di
+ * caricamento. La pubblicazione è senza lock: lo spazio per il codice è
+ * riservato con un fetch_add, lo slot con un CAS sulla chiave e l'entrata
+ * diventa visibile con la scrittura (release) del suo stato. Le entrate non
+ * vengono mai rimosse: a regione piena la pubblicazione fallisce e il codice
+ * resta privato del processo.
+ *
+ * La regione è mappata due volte: in scrittura per pubblicare e in lettura ed
+ * esecuzione per eseguire, così nessuna pagina è scrivibile ed eseguibile
+ * insieme. Sopra la regione ogni processo mantiene la propria cache L1, che fa
+ * da jump cache: un hit nella regione viene promosso in L1.
+ */
+
+#ifndef CACHE_SHM_H
+#define CACHE_SHM_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <xxhash.h>
+
+using byte = uint8_t;
+
+// Header della regione condivisa
+struct SharedCodeHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t ready;           // 1 quando il creatore ha inizializzato la regione
+    uint64_t region_size;
+    uint64_t slot_count;      // Potenza di 2
+    uint64_t code_offset;     // Offset della sezione di codice
+    uint64_t code_capacity;
+    uint64_t code_used;       // Byte di codice riservati (fetch_add)
+    uint64_t entry_count;     // Slot riservati (fetch_add)
+    uint64_t last_attach;     // Secondi dall'epoch dell'ultimo collegamento
+};
+
+// Slot dell'indice condiviso
+struct SharedCodeSlot {
+    uint64_t key;             // x86_offset + 1 (0 = libero), assegnata con CAS
+    uint32_t state;           // SLOT_PUBLISHED quando i campi sono completi
+    uint32_t x86_size;
+    uint64_t x86_hash;
+    uint64_t rules_fingerprint;
+    uint64_t code_offset;     // Offset nella sezione di codice
+    uint32_t code_size;
+    uint32_t reserved;
+};
+
+// Traduzione trovata nella regione condivisa
+struct SharedCodeHit {
+    const byte* code = nullptr;   // Eseguibile se la regione lo è, altrimenti da copiare
+    uint32_t code_size = 0;
+    uint32_t x86_size = 0;
+    uint64_t x86_hash = 0;
+};
+
+class SharedCodeCache {
+public:
+    static constexpr uint64_t SHM_MAGIC = 0x4D48534F52434F52; // "ROCROSHM" in hex
+    static constexpr uint32_t SHM_VERSION = 2;
+    static constexpr uint32_t SLOT_PUBLISHED = 1;
+    static constexpr size_t CODE_ALIGNMENT = 16;
+    static constexpr size_t BYTES_PER_SLOT = 512;       // Dimensionamento dell'indice sulla regione
+    static constexpr size_t MIN_REGION_SIZE = 1024 * 1024;
+    static constexpr int ATTACH_TIMEOUT_MS = 2000;      // Attesa dell'inizializzazione da parte del creatore
+    static constexpr uint64_t IDLE_REGION_SECONDS = 24 * 3600; // Regioni di altre regole senza collegamenti: rimosse
+
+private:
+    std::string name;
+    int fd = -1;
+    byte* rw_base = nullptr;          // Mappatura per la pubblicazione
+    const byte* exec_base = nullptr;  // Mappatura per l'esecuzione (nullptr se rifiutata)
+    size_t region_size = 0;
+
+    SharedCodeHeader* header = nullptr;
+    SharedCodeSlot* slots = nullptr;
+
+    static uint64_t align_up(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    static uint64_t slot_hash(uint64_t x86_offset) {
+        uint64_t h = x86_offset * 0x9E3779B185EBCA87ULL;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Layout di una regione di size byte
+    static void plan(uint64_t size, SharedCodeHeader& layout) {
+        memset(&layout, 0, sizeof(layout));
+        layout.magic = SHM_MAGIC;
+        layout.version = SHM_VERSION;
+        layout.region_size = size;
+        layout.slot_count = 1024;
+        while (layout.slot_count * 2 * BYTES_PER_SLOT <= size) {
+            layout.slot_count <<= 1;
+        }
+        layout.code_offset = align_up(sizeof(SharedCodeHeader) + layout.slot_count * sizeof(SharedCodeSlot), 4096);
+        layout.code_capacity = size - layout.code_offset;
+    }
+
+    // Verifica che l'header di una regione esistente sia coerente con la sua dimensione
+    bool validate() const {
+        uint64_t slot_count = header->slot_count;
+        return header->magic == SHM_MAGIC && header->version == SHM_VERSION &&
+               header->region_size == region_size && slot_count != 0 && (slot_count & (slot_count - 1)) == 0 &&
+               header->code_offset >= sizeof(SharedCodeHeader) + slot_count * sizeof(SharedCodeSlot) &&
+               header->code_offset <= region_size && header->code_capacity == region_size - header->code_offset;
+    }
+
+    // Dimensiona e inizializza una regione appena creata (fd aperto)
+    bool initialize(size_t size) {
+        SharedCodeHeader layout;
+        plan(size, layout);
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0 || !map(size)) {
+            std::cerr << "Impossibile creare la cache condivisa: " << name << std::endl;
+            return false;
+        }
+        layout.last_attach = now_seconds();
+        memcpy(header, &layout, sizeof(layout));
+        header->ready = 0;
+        slots = reinterpret_cast<SharedCodeSlot*>(rw_base + sizeof(SharedCodeHeader));
+        __atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool map(size_t size) {
+        void* rw = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (rw == MAP_FAILED) {
+            return false;
+        }
+        rw_base = static_cast<byte*>(rw);
+        region_size = size;
+        header = reinterpret_cast<SharedCodeHeader*>(rw_base);
+
+        // /dev/shm montato noexec: le traduzioni trovate vengono copiate
+        void* rx = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        exec_base = (rx == MAP_FAILED) ? nullptr : static_cast<const byte*>(rx);
+        return true;
+    }
+
+    static uint64_t now_seconds() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    // Prefisso dei nomi delle regioni di un binario
+    static std::string binary_prefix(const std::string& binary_id) {
+        char prefix[24];
+        snprintf(prefix, sizeof(prefix), "/rth%012llx",
+                 static_cast<unsigned long long>(XXH64(binary_id.data(), binary_id.size(), SHM_VERSION) &
+                                                 0xFFFFFFFFFFFFULL));
+        return prefix;
+    }
+
+    // Rimuove la regione se il nome indica ancora l'oggetto aperto in fd:
+    // chi l'ha già ricreata non perde la propria
+    bool remove_if_current() const {
+        int current = shm_open(name.c_str(), O_RDONLY, 0600);
+        if (current < 0) {
+            return true;
+        }
+        struct stat by_name, by_fd;
+        bool same = fstat(current, &by_name) == 0 && fstat(fd, &by_fd) == 0 && by_name.st_ino == by_fd.st_ino &&
+                    by_name.st_dev == by_fd.st_dev;
+        ::close(current);
+        return same && remove(name);
+    }
+
+    // Rimuove le regioni dello stesso binario per altre regole rimaste senza
+    // collegamenti da IDLE_REGION_SECONDS. Solo dove gli oggetti shm sono
+    // elencabili (Linux, /dev/shm); altrove restano fino al riavvio.
+    void remove_idle_siblings() const {
+#if defined(__linux__)
+        std::string prefix = name.substr(1, name.find('-') - 1);
+        uint64_t now = now_seconds();
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator("/dev/shm", ec)) {
+            std::string other = entry.path().filename().string();
+            if (other.compare(0, prefix.size(), prefix) != 0 || "/" + other == name) {
+                continue;
+            }
+            int other_fd = shm_open(("/" + other).c_str(), O_RDONLY, 0600);
+            if (other_fd < 0) {
+                continue;
+            }
+            struct stat st;
+            void* mapped = MAP_FAILED;
+            if (fstat(other_fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(SharedCodeHeader))) {
+                mapped = mmap(nullptr, sizeof(SharedCodeHeader), PROT_READ, MAP_SHARED, other_fd, 0);
+            }
+            ::close(other_fd);
+            if (mapped == MAP_FAILED) {
+                continue;
+            }
+            const SharedCodeHeader* other_header = static_cast<const SharedCodeHeader*>(mapped);
+            uint64_t last_attach = __atomic_load_n(&other_header->last_attach, __ATOMIC_RELAXED);
+            bool idle = other_header->magic == SHM_MAGIC && last_attach + IDLE_REGION_SECONDS < now;
+            munmap(mapped, sizeof(SharedCodeHeader));
+            if (idle) {
+                remove("/" + other);
+            }
+        }
+#endif
+    }
+
+    // Un tentativo di attach; stale indica una regione rimossa perché abbandonata
+    // dal suo creatore o non valida, da ricreare
+    bool try_attach(const std::string& region_name, size_t size, bool& stale) {
+        detach();
+        name = region_name;
+        size = std::max(size, MIN_REGION_SIZE);
+
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            if (!initialize(size)) {
+                detach();
+                remove(region_name);
+                return false;
+            }
+            remove_idle_siblings();
+            return true;
+        }
+
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            std::cerr << "Cache condivisa non disponibile: " << name << std::endl;
+            return false;
+        }
+
+        // Il creatore può non avere ancora dimensionato o inizializzato la regione
+        struct stat st;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ATTACH_TIMEOUT_MS);
+        while (fstat(fd, &st) == 0 && st.st_size < static_cast<off_t>(sizeof(SharedCodeHeader)) &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(SharedCodeHeader)) && map(st.st_size)) {
+            while (__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE) == 0 &&
+                   std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE) != 0 && validate()) {
+                slots = reinterpret_cast<SharedCodeSlot*>(rw_base + sizeof(SharedCodeHeader));
+                __atomic_store_n(&header->last_attach, now_seconds(), __ATOMIC_RELAXED);
+                return true;
+            }
+        }
+
+        std::cerr << "Cache condivisa non inizializzata o non valida, ricreata: " << name << std::endl;
+        stale = remove_if_current();
+        detach();
+        return false;
+    }
+
+public:
+    SharedCodeCache() = default;
+    SharedCodeCache(const SharedCodeCache&) = delete;
+    SharedCodeCache& operator=(const SharedCodeCache&) = delete;
+
+    ~SharedCodeCache() {
+        detach();
+    }
+
+    // Nome della regione di un binario per un'impronta delle regole: le regole
+    // nuove ottengono una regione vuota invece di riempire quella delle precedenti.
+    // "/rth" + 12 cifre per binario e versione + "-" + 8 per le regole: entro i
+    // 31 caratteri accettati da shm_open su macOS.
+    static std::string name_for(const std::string& binary_id, uint64_t rules_fingerprint) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "-%08llx",
+                 static_cast<unsigned long long>(XXH64(&rules_fingerprint, sizeof(rules_fingerprint), 0) & 0xFFFFFFFF));
+        return binary_prefix(binary_id) + suffix;
+    }
+
+    // Rimuove la regione di un binario: i processi collegati la mantengono fino al distacco
+    static bool remove(const std::string& region_name) {
+        return shm_unlink(region_name.c_str()) == 0;
+    }
+
+    // Si collega alla regione indicata, creandola con size byte se non esiste.
+    // Una regione creata da un altro processo mantiene la propria dimensione.
+    // Una regione ancora non inizializzata dopo ATTACH_TIMEOUT_MS (creatore
+    // terminato) o non valida viene rimossa e ricreata.
+    bool attach(const std::string& region_name, size_t size) {
+        for (int attempt = 0; attempt < 2; attempt++) {
+            bool stale = false;
+            if (try_attach(region_name, size, stale)) {
+                return true;
+            }
+            if (!stale) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    // Crea una regione anonima da passare ad altri processi come descrittore,
+    // ad es. dal daemon di traduzione ai suoi client. Su Linux è un memfd;
+    // altrove un oggetto shm_open con nome univoco, rimosso subito dopo la creazione.
+    bool create_anonymous(const std::string& region_name, size_t size) {
+        detach();
+        name = region_name;
+#if defined(__linux__)
+        fd = memfd_create(name.c_str(), MFD_CLOEXEC);
+#else
+        static std::atomic<uint32_t> anonymous_counter{0};
+        std::string unique_name = "/rotheca-a" + std::to_string(getpid()) + "-" + std::to_string(anonymous_counter++);
+        fd = shm_open(unique_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            shm_unlink(unique_name.c_str());
+        }
+#endif
+        if (fd < 0 || !initialize(std::max(size, MIN_REGION_SIZE))) {
+            detach();
+            return false;
+        }
+        return true;
+    }
+
+    // Si collega a una regione ricevuta come descrittore, di cui prende possesso
+    bool attach_fd(int region_fd, const std::string& region_name) {
+        detach();
+        name = region_name;
+        fd = region_fd;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SharedCodeHeader)) || !map(st.st_size) ||
+            __atomic_load_n(&header->ready, __ATOMIC_ACQUIRE) == 0 || !validate()) {
+            std::cerr << "Cache condivisa ricevuta non valida: " << name << std::endl;
+            detach();
+            return false;
+        }
+        slots = reinterpret_cast<SharedCodeSlot*>(rw_base + sizeof(SharedCodeHeader));
+        return true;
+    }
+
+    void detach() {
+        if (exec_base) {
+            munmap(const_cast<byte*>(exec_base), region_size);
+        }
+        if (rw_base) {
+            munmap(rw_base, region_size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+        rw_base = nullptr;
+        exec_base = nullptr;
+        region_size = 0;
+        header = nullptr;
+        slots = nullptr;
+    }
+
+    bool is_attached() const { return header != nullptr; }
+    int region_fd() const { return fd; }
+    bool is_executable() const { return exec_base != nullptr; }
+    const std::string& region_name() const { return name; }
+
+    size_t entry_count() const {
+        return header ? std::min(__atomic_load_n(&header->entry_count, __ATOMIC_RELAXED), header->slot_count) : 0;
+    }
+
+    size_t code_bytes() const {
+        return header ? std::min(__atomic_load_n(&header->code_used, __ATOMIC_RELAXED), header->code_capacity) : 0;
+    }
+
+    // Cerca una traduzione pubblicata per offset nel modulo e impronta delle
+    // regole; match(x86_size, x86_hash) verifica il codice guest corrente.
+    // Senza lock: legge solo slot pubblicati.
+    template <typename Match>
+    bool find(uint64_t x86_offset, uint64_t rules_fingerprint, Match&& match, SharedCodeHit& hit) const {
+        if (!header) {
+            return false;
+        }
+        uint64_t mask = header->slot_count - 1;
+        uint64_t key = x86_offset + 1;
+        for (uint64_t pos = slot_hash(x86_offset) & mask, probes = 0; probes <= mask; pos = (pos + 1) & mask, probes++) {
+            const SharedCodeSlot& slot = slots[pos];
+            uint64_t slot_key = __atomic_load_n(&slot.key, __ATOMIC_ACQUIRE);
+            if (slot_key == 0) {
+                return false;
+            }
+            if (slot_key != key || __atomic_load_n(&slot.state, __ATOMIC_ACQUIRE) != SLOT_PUBLISHED ||
+                slot.rules_fingerprint != rules_fingerprint) {
+                continue;
+            }
+            // La regione è scrivibile da ogni processo collegato: i limiti sono verificati
+            if (slot.code_offset > header->code_capacity || slot.code_size > header->code_capacity - slot.code_offset ||
+                !match(slot.x86_size, slot.x86_hash)) {
+                continue;
+            }
+            const byte* view = exec_base ? exec_base : rw_base;
+            hit.code = view + header->code_offset + slot.code_offset;
+            hit.code_size = slot.code_size;
+            hit.x86_size = slot.x86_size;
+            hit.x86_hash = slot.x86_hash;
+            return true;
+        }
+        return false;
+    }
+
+    // Pubblica una traduzione senza rilocazioni; restituisce il codice nella
+    // regione (come find), o nullptr se la regione è piena. Una traduzione già
+    // pubblicata per lo stesso blocco guest viene riusata.
+    const byte* publish(uint64_t x86_offset, uint64_t x86_hash, uint32_t x86_size, uint64_t rules_fingerprint,
+                        const byte* code, uint32_t code_size) {
+        if (!header || code_size == 0) {
+            return nullptr;
+        }
+
+        SharedCodeHit existing;
+        if (find(x86_offset, rules_fingerprint, [&](uint32_t size, uint64_t hash) {
+                return size == x86_size && hash == x86_hash;
+            }, existing) && existing.code_size == code_size) {
+            return existing.code;
+        }
+
+        // Slot e spazio riservati non vengono restituiti: un fallimento li spreca
+        if (__atomic_fetch_add(&header->entry_count, 1, __ATOMIC_RELAXED) >= header->slot_count * 3 / 4) {
+            return nullptr;
+        }
+        uint64_t reserved = align_up(code_size, CODE_ALIGNMENT);
+        uint64_t offset = __atomic_fetch_add(&header->code_used, reserved, __ATOMIC_RELAXED);
+        if (offset > header->code_capacity || reserved > header->code_capacity - offset) {
+            return nullptr;
+        }
+        byte* target = rw_base + header->code_offset + offset;
+        memcpy(target, code, code_size);
+        if (exec_base) {
+            const byte* executable = exec_base + header->code_offset + offset;
+            __builtin___clear_cache(const_cast<char*>(reinterpret_cast<const char*>(executable)),
+                                    const_cast<char*>(reinterpret_cast<const char*>(executable + code_size)));
+        }
+
+        uint64_t mask = header->slot_count - 1;
+        for (uint64_t pos = slot_hash(x86_offset) & mask, probes = 0; probes <= mask; pos = (pos + 1) & mask, probes++) {
+            SharedCodeSlot& slot = slots[pos];
+            uint64_t expected = 0;
+            if (!__atomic_compare_exchange_n(&slot.key, &expected, x86_offset + 1, false,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            slot.x86_size = x86_size;
+            slot.x86_hash = x86_hash;
+            slot.rules_fingerprint = rules_fingerprint;
+            slot.code_offset = offset;
+            slot.code_size = code_size;
+            __atomic_store_n(&slot.state, SLOT_PUBLISHED, __ATOMIC_RELEASE);
+            return (exec_base ? exec_base : rw_base) + header->code_offset + offset;
+        }
+        return nullptr;
+    }
+};
+
+#endif // CACHE_SHM_H
@@ -3,47 +3,31 @@
 #include <sstream>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <cstdint>
 #include <memory>
 #include <chrono>
 #include <filesystem>
+#include <iomanip>
 #include <sys/mman.h>
 #include <cstring>
 #include <functional>
 #include <algorithm>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
 #include <xxhash.h>
+#include "cache-epoch.h"
+#include "cache-l2.h"
+#include "cache-shm.h"
+#include "cache-daemon.h"
 
 // Tipi di utilità
 using byte = uint8_t;
 using arm_inst = uint32_t;
 
-// Struttura per l'header della cache persistente
-struct CacheFileHeader {
-    uint64_t magic;           // Magic number per identificare il file di cache
-    uint32_t version;         // Versione del formato di cache
-    uint32_t entry_count;     // Numero di entrate nella cache
-    uint64_t x86_hash;        // Hash del binario x86 originale
-    uint64_t creation_time;   // Timestamp di creazione
-    uint64_t last_access;     // Ultimo accesso
-    uint32_t hit_count;       // Contatore accessi
-    uint32_t reserved[4];     // Spazio riservato per futuri usi
-};
-
-// Struttura per un blocco memorizzato nella cache persistente
-struct CacheFileEntry {
-    uint64_t x86_addr;        // Indirizzo originale x86
-    uint32_t x86_size;        // Dimensione del blocco x86
-    uint64_t x86_hash;        // Hash del blocco x86
-    uint64_t arm_offset;      // Offset al codice ARM nella sezione dati
-    uint32_t arm_size;        // Dimensione del codice ARM
-    uint32_t execution_count; // Contatore esecuzioni
-    uint64_t last_execution;  // Timestamp ultima esecuzione
-    uint32_t flags;           // Flag (hot/cold, ottimizzato, ecc.)
-    uint32_t reserved[3];     // Spazio riservato per futuri usi
-};
-
 // Struttura avanzata per la cache in-memory
 struct EnhancedTranslationEntry {
     uint64_t x86_addr;           // Indirizzo originale x86
@@ -55,12 +39,14 @@ struct EnhancedTranslationEntry {
     uint32_t access_count;       // Contatore accessi
     bool is_hot;                 // Flag per blocchi "hot" (frequentemente usati)
     uint32_t flags;              // Flag vari (ottimizzato, linked, ecc.)
+    uint64_t code_generation;    // Generazione delle pagine guest al momento della traduzione
 };
 
 // Livelli di cache
 enum class CacheLevel {
     L1_MEMORY,     // Cache in-memory velocissima (LRU)
     L2_PERSISTENT, // Cache persistente su disco
+    SHARED_MEMORY, // Cache condivisa tra i processi dello stesso binario
     NOT_FOUND      // Non trovato in cache
 };
 
@@ -69,38 +55,1522 @@ struct CacheLookupResult {
     CacheLevel level;
     EnhancedTranslationEntry entry;
     bool found;
+    bool mapped;    // Codice eseguibile sul posto (mappatura L2 o regione condivisa): entry.arm_addr è valido e arm_code è vuoto
 };
 
-// Classe gestore della cache
-class TranslationCache {
+// Stimatore di frequenza per TinyLFU: count-min sketch con contatori a 4 bit
+// (16 per parola a 64 bit, 4 righe). Dopo sample_size incrementi tutti i
+// contatori vengono dimezzati (aging), così la storia vecchia perde peso.
+class FrequencySketch {
 private:
-    static constexpr uint64_t CACHE_MAGIC = 0x415243524F535345; // "ARCROSSE" in hex
-    static constexpr uint32_t CACHE_VERSION = 1;
-    static constexpr size_t MAX_L1_CACHE_ENTRIES = 1024;
-    static constexpr size_t MAX_L2_CACHE_SIZE = 100 * 1024 * 1024; // 100MB
+    static constexpr uint64_t RESET_MASK = 0x7777777777777777ULL; // Azzera il bit alto di ogni nibble
+    static constexpr uint64_t SEEDS[4] = {
+        0xC3A5C85C97CB3127ULL, 0xB492B66FBE98F273ULL,
+        0x9AE16A3B2F90404FULL, 0xCBF29CE484222325ULL
+    };
+
+    std::vector<uint64_t> table;
+    uint64_t table_mask = 0;
+    size_t sample_size = 0;
+    size_t additions = 0;
+
+    // Posizione del contatore per la riga i: parola nella tabella e nibble nella parola
+    size_t index_of(uint64_t key_hash, int i) const {
+        uint64_t h = (key_hash + SEEDS[i]) * SEEDS[i];
+        h += h >> 32;
+        return static_cast<size_t>(h & table_mask);
+    }
+
+    bool increment_at(size_t word, int nibble) {
+        int shift = nibble * 4;
+        uint64_t mask = 0xFULL << shift;
+        if ((table[word] & mask) != mask) {
+            table[word] += 1ULL << shift;
+            return true;
+        }
+        return false;
+    }
+
+    // Aging: dimezza tutti i contatori
+    void reset() {
+        for (auto& word : table) {
+            word = (word >> 1) & RESET_MASK;
+        }
+        additions /= 2;
+    }
+
+public:
+    explicit FrequencySketch(size_t capacity) {
+        size_t words = 16;
+        while (words < capacity) {
+            words <<= 1;
+        }
+        table.assign(words, 0);
+        table_mask = words - 1;
+        sample_size = capacity * 10;
+    }
+
+    // Registra un accesso alla chiave
+    void increment(uint64_t key_hash) {
+        int start = static_cast<int>((key_hash & 3) << 2);
+        bool added = false;
+        for (int i = 0; i < 4; i++) {
+            added |= increment_at(index_of(key_hash, i), start + i);
+        }
+
+        if (added && ++additions >= sample_size) {
+            reset();
+        }
+    }
+
+    // Stima della frequenza (minimo sulle quattro righe)
+    uint32_t frequency(uint64_t key_hash) const {
+        int start = static_cast<int>((key_hash & 3) << 2);
+        uint32_t freq = 15;
+        for (int i = 0; i < 4; i++) {
+            int shift = (start + i) * 4;
+            uint32_t count = static_cast<uint32_t>((table[index_of(key_hash, i)] >> shift) & 0xF);
+            freq = std::min(freq, count);
+        }
+        return freq;
+    }
+
+    // Ridimensiona lo sketch se la cache è cresciuta oltre la sua capacità
+    // (la storia delle frequenze viene persa)
+    void ensure_capacity(size_t capacity) {
+        if (capacity <= table.size()) {
+            return;
+        }
+        *this = FrequencySketch(capacity * 2);
+    }
+
+    void clear() {
+        std::fill(table.begin(), table.end(), 0);
+        additions = 0;
+    }
+};
+
+// Segmenti della cache L1. Con la politica LRU si usa solo WINDOW;
+// con W-TinyLFU la finestra di ammissione precede la parte principale
+// (SLRU divisa in probation e protected).
+enum class L1Segment : uint8_t {
+    WINDOW = 0,
+    PROBATION = 1,
+    PROTECTED = 2
+};
+
+// Indice della cache L1: tabella hash a indirizzamento aperto (linear probing)
+// sull'indirizzo guest (x86_addr) e liste LRU intrusive, una per segmento.
+// Ricerca, aggiornamento, inserimento, rimozione e cambio di segmento sono O(1).
+// L'indice cresce senza fermare il mondo: i nodi sono allocati a blocchi (mai
+// spostati) e la tabella viene raddoppiata con un rehash incrementale, migrando
+// pochi bucket a ogni modifica. Ogni nodo ha un peso in byte, sommato per segmento.
+class L1CacheIndex {
+public:
+    static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+    static constexpr size_t SEGMENT_COUNT = 3;
+    static constexpr size_t NODE_CHUNK_SIZE = 256;  // Nodi per blocco di allocazione
+    static constexpr size_t REHASH_STEP = 16;       // Bucket migrati per modifica durante il rehash
+
+private:
+    static constexpr uint32_t TOMBSTONE = UINT32_MAX - 1; // Usato solo nella tabella in migrazione
+
+    // Nodo: entrata più collegamenti della lista LRU e posizione nella tabella
+    struct Node {
+        EnhancedTranslationEntry entry;
+        uint32_t prev;       // Verso la testa (più recente)
+        uint32_t next;       // Verso la coda (meno recente) o prossimo nodo libero
+        uint32_t bucket;     // Bucket che punta a questo nodo
+        uint32_t weight;     // Peso in byte (codice + metadati)
+        uint32_t table_generation; // Tabella in cui è stato inserito il bucket
+        L1Segment segment;   // Lista LRU di appartenenza
+    };
+
+    // Bucket: indice del nodo più un tag dell'hash per evitare di leggere il nodo
+    struct Bucket {
+        uint32_t node;
+        uint32_t tag;
+    };
+
+    struct HashTable {
+        std::vector<Bucket> buckets;  // Dimensione potenza di 2
+        uint64_t mask = 0;
+    };
+
+    // Lista LRU di un segmento
+    struct LruList {
+        uint32_t head = INVALID_NODE;
+        uint32_t tail = INVALID_NODE;
+        size_t count = 0;
+        size_t weight = 0;
+    };
+
+    std::vector<std::unique_ptr<Node[]>> chunks;  // Pool di nodi a blocchi
+    HashTable table;            // Tabella corrente
+    HashTable old_table;        // Tabella in migrazione (vuota se nessun rehash in corso)
+    size_t rehash_cursor = 0;
+    uint32_t table_generation = 0;  // Incrementata a ogni raddoppio della tabella
+    uint32_t free_head = INVALID_NODE;
+    LruList lists[SEGMENT_COUNT];
+    size_t count = 0;
+
+    Node& node_at(uint32_t n) { return chunks[n / NODE_CHUNK_SIZE][n % NODE_CHUNK_SIZE]; }
+    const Node& node_at(uint32_t n) const { return chunks[n / NODE_CHUNK_SIZE][n % NODE_CHUNK_SIZE]; }
+
+    LruList& list_of(uint32_t n) { return lists[static_cast<size_t>(node_at(n).segment)]; }
+
+    void lru_unlink(uint32_t n) {
+        Node& node = node_at(n);
+        LruList& list = list_of(n);
+        if (node.prev != INVALID_NODE) node_at(node.prev).next = node.next; else list.head = node.next;
+        if (node.next != INVALID_NODE) node_at(node.next).prev = node.prev; else list.tail = node.prev;
+        node.prev = node.next = INVALID_NODE;
+        list.count--;
+        list.weight -= node.weight;
+    }
+
+    void lru_push_front(uint32_t n) {
+        Node& node = node_at(n);
+        LruList& list = list_of(n);
+        node.prev = INVALID_NODE;
+        node.next = list.head;
+        if (list.head != INVALID_NODE) node_at(list.head).prev = n;
+        list.head = n;
+        if (list.tail == INVALID_NODE) list.tail = n;
+        list.count++;
+        list.weight += node.weight;
+    }
+
+    static HashTable make_table(size_t size) {
+        HashTable t;
+        t.buckets.assign(size, {INVALID_NODE, 0});
+        t.mask = size - 1;
+        return t;
+    }
+
+    // Inserisce il nodo nella tabella corrente
+    void place(uint32_t n) {
+        Node& node = node_at(n);
+        uint64_t h = key_hash(node.entry.x86_addr);
+        uint64_t pos = h & table.mask;
+        while (table.buckets[pos].node != INVALID_NODE) {
+            pos = (pos + 1) & table.mask;
+        }
+        table.buckets[pos] = {n, static_cast<uint32_t>(h >> 32)};
+        node.bucket = static_cast<uint32_t>(pos);
+        node.table_generation = table_generation;
+    }
+
+    // Cerca in una tabella; le tombstone non interrompono la catena
+    uint32_t probe(const HashTable& t, uint64_t h, uint64_t x86_addr) const {
+        uint32_t tag = static_cast<uint32_t>(h >> 32);
+        for (uint64_t pos = h & t.mask; ; pos = (pos + 1) & t.mask) {
+            const Bucket& b = t.buckets[pos];
+            if (b.node == INVALID_NODE) {
+                return INVALID_NODE;
+            }
+            if (b.node != TOMBSTONE && b.tag == tag) {
+                if (node_at(b.node).entry.x86_addr == x86_addr) {
+                    return b.node;
+                }
+            }
+        }
+    }
+
+    // Cerca in una tabella conoscendo solo l'hash della chiave (bit 0 ignorato)
+    uint32_t probe_hashed(const HashTable& t, uint64_t h) const {
+        uint32_t tag = static_cast<uint32_t>(h >> 32);
+        for (uint64_t pos = h & t.mask; ; pos = (pos + 1) & t.mask) {
+            const Bucket& b = t.buckets[pos];
+            if (b.node == INVALID_NODE) {
+                return INVALID_NODE;
+            }
+            if (b.node != TOMBSTONE && b.tag == tag) {
+                const EnhancedTranslationEntry& e = node_at(b.node).entry;
+                if ((key_hash(e.x86_addr) | 1) == (h | 1)) {
+                    return b.node;
+                }
+            }
+        }
+    }
     
-    std::string cache_directory;
-    std::vector<EnhancedTranslationEntry> l1_cache; // Cache in-memory (LRU)
-    std::unordered_map<std::string, std::string> binary_cache_map; // Mappa binary_id -> cache_file
+    // Migra alcuni bucket dalla tabella vecchia a quella corrente
+    void rehash_step(size_t steps) {
+        while (steps-- > 0 && rehash_cursor < old_table.buckets.size()) {
+            Bucket& b = old_table.buckets[rehash_cursor++];
+            if (b.node != INVALID_NODE && b.node != TOMBSTONE) {
+                place(b.node);
+                // La tombstone mantiene integre le catene delle chiavi non ancora migrate
+                b.node = TOMBSTONE;
+            }
+        }
+
+        if (!old_table.buckets.empty() && rehash_cursor >= old_table.buckets.size()) {
+            old_table = HashTable();
+            rehash_cursor = 0;
+        }
+    }
+
+    // Avvia il raddoppio della tabella se il fattore di carico supera 0.5
+    void maybe_grow_table() {
+        if ((count + 1) * 2 <= table.buckets.size()) {
+            return;
+        }
+
+        // Rehash precedente non ancora concluso: completalo prima di raddoppiare
+        rehash_step(old_table.buckets.size());
+
+        old_table = std::move(table);
+        table = make_table(old_table.buckets.size() * 2);
+        rehash_cursor = 0;
+        
+        // I nodi con la generazione precedente risultano nella tabella in migrazione
+        table_generation++;
+    }
+
+    // Aggiunge un blocco di nodi alla free list
+    void grow_pool() {
+        uint32_t base = static_cast<uint32_t>(chunks.size() * NODE_CHUNK_SIZE);
+        chunks.emplace_back(new Node[NODE_CHUNK_SIZE]);
+        for (size_t i = 0; i < NODE_CHUNK_SIZE; i++) {
+            Node& node = chunks.back()[i];
+            node.prev = INVALID_NODE;
+            node.next = (i + 1 < NODE_CHUNK_SIZE) ? base + static_cast<uint32_t>(i + 1) : free_head;
+        }
+        free_head = base;
+    }
+
+    // Rimozione con backward shift: nessuna tombstone, le catene restano compatte
+    void erase_bucket(uint64_t pos) {
+        uint64_t hole = pos;
+        uint64_t next = (pos + 1) & table.mask;
+
+        while (table.buckets[next].node != INVALID_NODE) {
+            const Node& moved = node_at(table.buckets[next].node);
+            uint64_t home = key_hash(moved.entry.x86_addr) & table.mask;
+
+            // Sposta indietro solo se il bucket di origine non cade tra hole e next
+            bool in_range = (hole <= next) ? (home > hole && home <= next)
+                                           : (home > hole || home <= next);
+            if (!in_range) {
+                table.buckets[hole] = table.buckets[next];
+                node_at(table.buckets[hole].node).bucket = static_cast<uint32_t>(hole);
+                hole = next;
+            }
+            next = (next + 1) & table.mask;
+        }
+
+        table.buckets[hole] = {INVALID_NODE, 0};
+    }
+
+public:
+    explicit L1CacheIndex(size_t initial_capacity) {
+        // Fattore di carico massimo 0.5
+        size_t table_size = 16;
+        while (table_size < initial_capacity * 2) {
+            table_size <<= 1;
+        }
+        table = make_table(table_size);
+
+        while (chunks.size() * NODE_CHUNK_SIZE < initial_capacity) {
+            grow_pool();
+        }
+    }
+
+    // Mescola l'indirizzo guest in un hash a 64 bit (finalizzatore fmix64)
+    static uint64_t key_hash(uint64_t x86_addr) {
+        uint64_t h = x86_addr * PRIME64_1;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Metadati per entrata: nodo più la quota di tabella (due bucket a carico 0.5)
+    static constexpr size_t ENTRY_OVERHEAD = sizeof(Node) + 2 * sizeof(Bucket);
+
+    size_t size() const { return count; }
+    size_t size(L1Segment segment) const { return lists[static_cast<size_t>(segment)].count; }
+    size_t weight(L1Segment segment) const { return lists[static_cast<size_t>(segment)].weight; }
+    size_t total_weight() const {
+        size_t total = 0;
+        for (const auto& list : lists) {
+            total += list.weight;
+        }
+        return total;
+    }
+    bool rehashing() const { return !old_table.buckets.empty(); }
+
+    // Memoria effettivamente allocata dall'indice (pool di nodi e tabelle)
+    size_t memory_usage() const {
+        return chunks.size() * NODE_CHUNK_SIZE * sizeof(Node) +
+               (table.buckets.size() + old_table.buckets.size()) * sizeof(Bucket);
+    }
+
+    // Nodi agli estremi della lista LRU di un segmento
+    uint32_t most_recent(L1Segment segment = L1Segment::WINDOW) const {
+        return lists[static_cast<size_t>(segment)].head;
+    }
+    uint32_t least_recent(L1Segment segment = L1Segment::WINDOW) const {
+        return lists[static_cast<size_t>(segment)].tail;
+    }
+    uint32_t newer(uint32_t n) const { return node_at(n).prev; }
+    uint32_t older(uint32_t n) const { return node_at(n).next; }
+    L1Segment segment_of(uint32_t n) const { return node_at(n).segment; }
+    uint32_t weight_of(uint32_t n) const { return node_at(n).weight; }
+
+    EnhancedTranslationEntry& at(uint32_t n) { return node_at(n).entry; }
+    const EnhancedTranslationEntry& at(uint32_t n) const { return node_at(n).entry; }
+
+    // Cerca un nodo per chiave; non modifica l'ordine LRU
+    uint32_t find(uint64_t x86_addr) const {
+        uint64_t h = key_hash(x86_addr);
+        uint32_t n = probe(table, h, x86_addr);
+        if (n == INVALID_NODE && rehashing()) {
+            n = probe(old_table, h, x86_addr);
+        }
+        return n;
+    }
+
+    // Cerca un nodo dall'hash della chiave, ad es. per gli accessi registrati
+    // dai lettori lock-free; il bit 0 dell'hash non viene confrontato
+    uint32_t find_hashed(uint64_t h) const {
+        uint32_t n = probe_hashed(table, h);
+        if (n == INVALID_NODE && rehashing()) {
+            n = probe_hashed(old_table, h);
+        }
+        return n;
+    }
     
-    std::mutex cache_mutex; // Mutex per proteggere gli accessi concorrenti alla cache
+    // Sposta un nodo in testa alla lista LRU del suo segmento
+    void touch(uint32_t n) {
+        if (n == list_of(n).head) {
+            return;
+        }
+        lru_unlink(n);
+        lru_push_front(n);
+    }
+
+    // Sposta un nodo in testa alla lista di un altro segmento
+    void move_to(uint32_t n, L1Segment segment) {
+        lru_unlink(n);
+        node_at(n).segment = segment;
+        lru_push_front(n);
+    }
+
+    // Aggiorna il peso di un nodo (ad es. dopo una nuova traduzione)
+    void set_weight(uint32_t n, uint32_t weight) {
+        LruList& list = list_of(n);
+        list.weight = list.weight - node_at(n).weight + weight;
+        node_at(n).weight = weight;
+    }
+
+    // Inserisce una nuova entrata in testa al segmento; la chiave non deve
+    // essere già presente. Il pool e la tabella crescono se necessario.
+    uint32_t insert(const EnhancedTranslationEntry& entry, uint32_t weight,
+                    L1Segment segment = L1Segment::WINDOW) {
+        rehash_step(REHASH_STEP);
+        maybe_grow_table();
+
+        if (free_head == INVALID_NODE) {
+            grow_pool();
+        }
+
+        uint32_t n = free_head;
+        Node& node = node_at(n);
+        free_head = node.next;
+        node.entry = entry;
+        node.weight = weight;
+        node.segment = segment;
+        place(n);
+
+        lru_push_front(n);
+        count++;
+        return n;
+    }
+
+    // Rimuove un nodo dall'indice e lo restituisce al pool
+    void erase(uint32_t n) {
+        Node& node = node_at(n);
+        if (node.table_generation != table_generation) {
+            old_table.buckets[node.bucket].node = TOMBSTONE;
+        } else {
+            erase_bucket(node.bucket);
+        }
+        lru_unlink(n);
+        node.next = free_head;
+        free_head = n;
+        count--;
+
+        rehash_step(REHASH_STEP);
+    }
+
+    void clear() {
+        std::fill(table.buckets.begin(), table.buckets.end(), Bucket{INVALID_NODE, 0});
+        old_table = HashTable();
+        rehash_cursor = 0;
+
+        // Ricostruisce la free list su tutto il pool
+        free_head = INVALID_NODE;
+        for (size_t c = chunks.size(); c-- > 0; ) {
+            for (size_t i = NODE_CHUNK_SIZE; i-- > 0; ) {
+                uint32_t n = static_cast<uint32_t>(c * NODE_CHUNK_SIZE + i);
+                Node& node = chunks[c][i];
+                node.prev = INVALID_NODE;
+                node.next = free_head;
+                free_head = n;
+            }
+        }
+        for (auto& list : lists) {
+            list = LruList();
+        }
+        count = 0;
+    }
+
+    // Copia le entrate segmento per segmento, dalla più recente
+    std::vector<EnhancedTranslationEntry> snapshot() const {
+        std::vector<EnhancedTranslationEntry> result;
+        result.reserve(count);
+        for (const auto& list : lists) {
+            for (uint32_t n = list.head; n != INVALID_NODE; n = node_at(n).next) {
+                result.push_back(node_at(n).entry);
+            }
+        }
+        return result;
+    }
+};
+
+// Tabella di lettura di uno shard L1: open addressing con puntatori atomici a
+// copie immutabili delle entrate. I lettori la consultano senza lock dentro una
+// EpochGuard; le modifiche avvengono solo sotto il lock dello shard e le copie
+// sostituite o rimosse vengono ritirate tramite EpochManager.
+class L1ReadTable {
+private:
+    using Slot = std::atomic<const EnhancedTranslationEntry*>;
+
+    // Array di slot pubblicato; sostituito per intero quando va ricostruito
+    struct Slots {
+        uint64_t mask;
+        std::unique_ptr<Slot[]> slots;
+
+        explicit Slots(size_t size) : mask(size - 1), slots(new Slot[size]) {
+            for (size_t i = 0; i < size; i++) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::atomic<Slots*> current;
+    size_t live = 0;   // Entrate pubblicate (solo scrittori)
+    size_t used = 0;   // Slot non vuoti, tombstone incluse (solo scrittori)
+
+    // Marcatore di slot rimosso: non interrompe le catene di probing
+    static const EnhancedTranslationEntry* tombstone() {
+        static const EnhancedTranslationEntry marker{};
+        return &marker;
+    }
+
+    static size_t table_size_for(size_t entries) {
+        size_t size = 16;
+        while (size < entries * 4) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    // Posizione della chiave o del primo slot vuoto della sua catena
+    static uint64_t locate(const Slots& s, uint64_t x86_addr, uint64_t& reusable) {
+        reusable = UINT64_MAX;
+        for (uint64_t pos = L1CacheIndex::key_hash(x86_addr) & s.mask; ; pos = (pos + 1) & s.mask) {
+            const EnhancedTranslationEntry* e = s.slots[pos].load(std::memory_order_relaxed);
+            if (e == nullptr) {
+                return pos;
+            }
+            if (e == tombstone()) {
+                if (reusable == UINT64_MAX) reusable = pos;
+            } else if (e->x86_addr == x86_addr) {
+                return pos;
+            }
+        }
+    }
+
+    // Ricostruisce gli slot eliminando le tombstone; la tabella precedente
+    // resta valida per i lettori finché non viene recuperata
+    void rebuild() {
+        Slots* old_slots = current.load(std::memory_order_relaxed);
+        Slots* new_slots = new Slots(table_size_for(live));
+
+        for (uint64_t i = 0; i <= old_slots->mask; i++) {
+            const EnhancedTranslationEntry* e = old_slots->slots[i].load(std::memory_order_relaxed);
+            if (e == nullptr || e == tombstone()) {
+                continue;
+            }
+            uint64_t pos = L1CacheIndex::key_hash(e->x86_addr) & new_slots->mask;
+            while (new_slots->slots[pos].load(std::memory_order_relaxed) != nullptr) {
+                pos = (pos + 1) & new_slots->mask;
+            }
+            new_slots->slots[pos].store(e, std::memory_order_relaxed);
+        }
+
+        current.store(new_slots, std::memory_order_release);
+        used = live;
+        EpochManager::instance().retire(old_slots);
+    }
+
+public:
+    // Metadati per entrata: copia pubblicata più la quota di slot (carico massimo 0.5)
+    static constexpr size_t ENTRY_OVERHEAD = sizeof(EnhancedTranslationEntry) + 2 * sizeof(Slot);
+
+    explicit L1ReadTable(size_t initial_capacity)
+        : current(new Slots(table_size_for(initial_capacity))) {}
+
+    // Distrutta solo quando non possono esserci lettori
+    ~L1ReadTable() {
+        Slots* s = current.load(std::memory_order_relaxed);
+        for (uint64_t i = 0; i <= s->mask; i++) {
+            const EnhancedTranslationEntry* e = s->slots[i].load(std::memory_order_relaxed);
+            if (e != nullptr && e != tombstone()) {
+                delete e;
+            }
+        }
+        delete s;
+    }
+
+    L1ReadTable(const L1ReadTable&) = delete;
+    L1ReadTable& operator=(const L1ReadTable&) = delete;
+
+    // Lettura senza lock: da chiamare dentro una EpochGuard attiva.
+    // Il puntatore restituito resta valido fino all'uscita dalla guardia.
+    const EnhancedTranslationEntry* find(uint64_t x86_addr) const {
+        const Slots* s = current.load(std::memory_order_acquire);
+        for (uint64_t pos = L1CacheIndex::key_hash(x86_addr) & s->mask; ; pos = (pos + 1) & s->mask) {
+            const EnhancedTranslationEntry* e = s->slots[pos].load(std::memory_order_acquire);
+            if (e == nullptr) {
+                return nullptr;
+            }
+            if (e != tombstone() && e->x86_addr == x86_addr) {
+                return e;
+            }
+        }
+    }
+
+    // Pubblica (o sostituisce) la copia di un'entrata; solo sotto il lock dello shard
+    void publish(const EnhancedTranslationEntry& entry) {
+        Slots* s = current.load(std::memory_order_relaxed);
+        uint64_t reusable;
+        uint64_t pos = locate(*s, entry.x86_addr, reusable);
+        const EnhancedTranslationEntry* existing = s->slots[pos].load(std::memory_order_relaxed);
+
+        if (existing != nullptr) {
+            s->slots[pos].store(new EnhancedTranslationEntry(entry), std::memory_order_release);
+            EpochManager::instance().retire(existing);
+            return;
+        }
+
+        if (reusable != UINT64_MAX) {
+            pos = reusable;
+        } else {
+            used++;
+        }
+        s->slots[pos].store(new EnhancedTranslationEntry(entry), std::memory_order_release);
+        live++;
+
+        // Carico massimo 0.5: resta sempre uno slot vuoto che chiude le catene
+        if (used * 2 > s->mask + 1) {
+            rebuild();
+        }
+    }
+
+    // Rimuove la copia pubblicata di un'entrata; solo sotto il lock dello shard
+    void unpublish(uint64_t x86_addr) {
+        Slots* s = current.load(std::memory_order_relaxed);
+        uint64_t reusable;
+        uint64_t pos = locate(*s, x86_addr, reusable);
+        const EnhancedTranslationEntry* existing = s->slots[pos].load(std::memory_order_relaxed);
+        if (existing == nullptr) {
+            return;
+        }
+
+        s->slots[pos].store(tombstone(), std::memory_order_release);
+        live--;
+        EpochManager::instance().retire(existing);
+    }
+
+    // Svuota la tabella pubblicando un array nuovo; solo sotto il lock dello shard
+    void clear() {
+        Slots* old_slots = current.load(std::memory_order_relaxed);
+        current.store(new Slots(table_size_for(0)), std::memory_order_release);
+
+        for (uint64_t i = 0; i <= old_slots->mask; i++) {
+            const EnhancedTranslationEntry* e = old_slots->slots[i].load(std::memory_order_relaxed);
+            if (e != nullptr && e != tombstone()) {
+                EpochManager::instance().retire(e);
+            }
+        }
+        EpochManager::instance().retire(old_slots);
+        live = used = 0;
+    }
+
+    size_t memory_usage() const {
+        return (current.load(std::memory_order_relaxed)->mask + 1) * sizeof(Slot) +
+               live * sizeof(EnhancedTranslationEntry);
+    }
+};
+
+// Politica di ammissione/rimozione della cache L1
+enum class L1EvictionPolicy {
+    LRU,        // LRU semplice (riferimento per i confronti)
+    W_TINYLFU   // Finestra LRU + SLRU principale con ammissione TinyLFU
+};
+
+// Contatori della politica L1, per confrontare le politiche sulle stesse tracce
+struct L1PolicyStats {
+    L1EvictionPolicy policy;
+    size_t lookups;             // Ricerche in L1
+    size_t hits;                // Ricerche risolte in L1
+    size_t admissions;          // Candidati della finestra ammessi nella parte principale
+    size_t rejections;          // Candidati della finestra scartati dal filtro TinyLFU
+    size_t evictions;           // Entrate rimosse per far posto
+};
+
+// Configurazione della cache di traduzione (sezione "cache_settings" di config.json).
+// La cache L1 è limitata in byte (codice ARM più metadati), non in numero di entrate.
+struct TranslationCacheConfig {
+    size_t initial_entries = 1024;                 // translation_cache_entries: dimensionamento iniziale dell'indice
+    size_t budget_bytes = 4 * 1024 * 1024;         // translation_cache_bytes: budget iniziale
+    size_t min_budget_bytes = 512 * 1024;          // translation_cache_min_bytes
+    size_t max_budget_bytes = 32 * 1024 * 1024;    // translation_cache_max_bytes: budget di memoria del processo
+    bool adaptive = true;                          // translation_cache_adaptive
+    L1EvictionPolicy policy = L1EvictionPolicy::W_TINYLFU; // translation_cache_policy: "lru" o "w-tinylfu"
+    size_t shard_count = 16;                       // translation_cache_shards: arrotondato a potenza di 2
+    bool l2_compression = false;                   // l2_cache_compression: file L2 nel formato compresso
+    bool l2_shared_objects = false;                // l2_cache_shared_objects: codice comune ai binari in objects.pack
+    size_t shared_code_bytes = 0;                  // shared_code_cache_bytes: regione condivisa tra i processi (0 = disabilitata)
+    std::string daemon_socket;                     // translation_daemon_socket: socket del daemon di traduzione (vuoto = nessuno)
+    
+    // Estrae il valore grezzo di una chiave ("chiave": valore) dal testo di configurazione.
+    // config.json contiene commenti //, quindi non è JSON valido per un parser rigoroso.
+    static bool find_value(const std::string& text, const std::string& key, std::string& value) {
+        size_t pos = text.find("\"" + key + "\"");
+        if (pos == std::string::npos) {
+            return false;
+        }
+        pos = text.find(':', pos);
+        if (pos == std::string::npos) {
+            return false;
+        }
+        
+        size_t start = text.find_first_not_of(" \t\"", pos + 1);
+        size_t end = text.find_first_of(",\"\n}/ \t", start);
+        if (start == std::string::npos || end == std::string::npos || end == start) {
+            return false;
+        }
+        
+        value = text.substr(start, end - start);
+        return true;
+    }
     
-    // Statistiche
+    // Estrae il valore stringa di una chiave ("chiave": "valore"), che può contenere '/' e spazi
+    static bool find_string(const std::string& text, const std::string& key, std::string& value) {
+        size_t pos = text.find("\"" + key + "\"");
+        if (pos == std::string::npos) {
+            return false;
+        }
+        pos = text.find(':', pos);
+        size_t start = (pos == std::string::npos) ? pos : text.find('"', pos);
+        size_t end = (start == std::string::npos) ? start : text.find('"', start + 1);
+        if (end == std::string::npos) {
+            return false;
+        }
+        
+        value = text.substr(start + 1, end - start - 1);
+        return true;
+    }
+    
+    // Carica la configurazione; le chiavi mancanti mantengono i valori predefiniti
+    static TranslationCacheConfig load(const std::string& filename) {
+        TranslationCacheConfig config;
+        
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            return config;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string text = buffer.str();
+        
+        std::string value;
+        try {
+            if (find_value(text, "translation_cache_entries", value)) {
+                config.initial_entries = std::stoull(value);
+            }
+            if (find_value(text, "translation_cache_bytes", value)) {
+                config.budget_bytes = std::stoull(value);
+            }
+            if (find_value(text, "translation_cache_min_bytes", value)) {
+                config.min_budget_bytes = std::stoull(value);
+            }
+            if (find_value(text, "translation_cache_max_bytes", value)) {
+                config.max_budget_bytes = std::stoull(value);
+            }
+            if (find_value(text, "translation_cache_shards", value)) {
+                config.shard_count = std::max<size_t>(1, std::stoull(value));
+            }
+            if (find_value(text, "shared_code_cache_bytes", value)) {
+                config.shared_code_bytes = std::stoull(value);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Valore non valido nella configurazione della cache: " << e.what() << std::endl;
+        }
+        if (find_value(text, "translation_cache_adaptive", value)) {
+            config.adaptive = (value == "true");
+        }
+        if (find_value(text, "translation_cache_policy", value)) {
+            config.policy = (value == "lru") ? L1EvictionPolicy::LRU : L1EvictionPolicy::W_TINYLFU;
+        }
+        if (find_value(text, "l2_cache_compression", value)) {
+            config.l2_compression = (value == "true");
+        }
+        if (find_value(text, "l2_cache_shared_objects", value)) {
+            config.l2_shared_objects = (value == "true");
+        }
+        if (find_string(text, "translation_daemon_socket", value)) {
+            config.daemon_socket = value;
+        }
+        
+        // Mantiene i limiti coerenti
+        config.max_budget_bytes = std::max(config.max_budget_bytes, config.min_budget_bytes);
+        config.budget_bytes = std::clamp(config.budget_bytes, config.min_budget_bytes, config.max_budget_bytes);
+        return config;
+    }
+};
+
+// Contatori statistici globali della cache
+struct CacheStatsCounters {
+    std::atomic<size_t> l1_hits{0};
+    std::atomic<size_t> l2_hits{0};
+    std::atomic<size_t> misses{0};
+};
+
+// Buffer per thread dei contatori statistici: gli incrementi restano locali al
+// thread e vengono riversati nei contatori condivisi ogni STATS_BATCH eventi,
+// così il percorso di ricerca non contende una linea di cache tra i thread.
+class ThreadStatsBuffer {
+public:
+    static constexpr size_t STATS_BATCH = 64;
+
+private:
+    std::shared_ptr<CacheStatsCounters> target; // Mantiene vivi i contatori anche dopo la cache
     size_t l1_hits = 0;
     size_t l2_hits = 0;
     size_t misses = 0;
+    size_t pending = 0;
+
+public:
+    ~ThreadStatsBuffer() {
+        flush();
+    }
+
+    // Buffer del thread corrente
+    static ThreadStatsBuffer& local() {
+        thread_local ThreadStatsBuffer buffer;
+        return buffer;
+    }
+
+    void record(const std::shared_ptr<CacheStatsCounters>& counters, size_t l1, size_t l2, size_t miss) {
+        if (target != counters) {
+            flush();
+            target = counters;
+        }
+        l1_hits += l1;
+        l2_hits += l2;
+        misses += miss;
+        if (++pending >= STATS_BATCH) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (target && pending > 0) {
+            target->l1_hits.fetch_add(l1_hits, std::memory_order_relaxed);
+            target->l2_hits.fetch_add(l2_hits, std::memory_order_relaxed);
+            target->misses.fetch_add(misses, std::memory_order_relaxed);
+        }
+        l1_hits = l2_hits = misses = pending = 0;
+    }
+};
+
+// Shard della cache L1: indice, politica di ammissione e budget propri,
+// protetti da un lock dedicato. Allineato per evitare false sharing tra shard.
+// Le ricerche non prendono il lock: leggono la tabella pubblicata e registrano
+// l'accesso in un buffer con perdita, applicato alla politica dagli scrittori.
+class alignas(64) L1CacheShard {
+private:
+    static constexpr size_t READ_BUFFER_SIZE = 256;      // Accessi registrati in attesa (potenza di 2)
+    static constexpr size_t READ_DRAIN_INTERVAL = 64;    // Accessi per thread tra due tentativi di svuotamento
+    static constexpr size_t L1_WINDOW_PERCENT = 1;       // Finestra di ammissione (% del budget)
+    static constexpr size_t L1_PROTECTED_PERCENT = 80;   // Segmento protected (% della parte principale)
+    static constexpr size_t L1_TRIM_BATCH = 32;          // Rimozioni massime per operazione dopo una riduzione
+    static constexpr size_t L1_ADAPT_INTERVAL = 4096;    // Ricerche tra due valutazioni del budget
+    static constexpr double L1_GROW_MISS_RATE = 0.05;    // Sopra questo miss rate il budget cresce
+    static constexpr double L1_SHRINK_MISS_RATE = 0.01;  // Sotto questo miss rate il budget si riduce
+
+    std::mutex mutex;
+    TranslationCacheConfig config;  // Limiti di budget già ripartiti per shard
+    L1CacheIndex index;             // Hash + LRU segmentate
+    L1ReadTable read_table;         // Copie pubblicate per i lettori lock-free
+    
+    // Politica di ammissione/rimozione
+    L1EvictionPolicy policy;
+    FrequencySketch sketch;
+    
+    // Budget in byte dello shard e sue suddivisioni
+    size_t budget = 0;
+    size_t window_budget = 0;
+    size_t protected_budget = 0;
+    size_t code_bytes = 0;
+    
+    // Finestra di osservazione per il dimensionamento adattivo
+    size_t adapt_lookups = 0;
+    size_t adapt_misses = 0;
+    
+    // Contatori della politica (ricerche e hit sono contati da TranslationCache)
+    size_t admissions = 0;
+    size_t rejections = 0;
+    size_t evictions = 0;
+    
+    // Accessi dei lettori: hash della chiave con il bit 0 che indica un hit.
+    // Uno slot sovrascritto prima dello svuotamento è un campione perso.
+    alignas(64) std::atomic<uint64_t> read_buffer[READ_BUFFER_SIZE];
+    
+    // Peso di un'entrata: codice ARM più metadati dell'indice e della tabella di lettura
+    static uint32_t entry_weight(const EnhancedTranslationEntry& entry) {
+        return static_cast<uint32_t>(entry.arm_size + L1CacheIndex::ENTRY_OVERHEAD + L1ReadTable::ENTRY_OVERHEAD);
+    }
+    
+    // Hash usato dalla politica; il bit 0 è riservato al flag di hit del buffer
+    static uint64_t policy_hash(uint64_t x86_addr) {
+        return L1CacheIndex::key_hash(x86_addr) & ~1ULL;
+    }
+    
+    // Imposta il budget e ricalcola i budget dei segmenti
+    void set_budget(size_t new_budget) {
+        budget = std::clamp(new_budget, config.min_budget_bytes, config.max_budget_bytes);
+        window_budget = std::max<size_t>(L1CacheIndex::ENTRY_OVERHEAD, budget * L1_WINDOW_PERCENT / 100);
+        protected_budget = (budget - std::min(budget, window_budget)) * L1_PROTECTED_PERCENT / 100;
+    }
+    
+    // Rimuove un nodo aggiornando il conteggio dei byte di codice
+    void erase_node(uint32_t node) {
+        const EnhancedTranslationEntry& entry = index.at(node);
+        read_table.unpublish(entry.x86_addr);
+        code_bytes -= entry.arm_size;
+        index.erase(node);
+        evictions++;
+    }
+    
+    // Libera un nodo secondo la politica corrente; lo shard non deve essere vuoto
+    void evict_entry() {
+        if (policy == L1EvictionPolicy::LRU) {
+            erase_node(index.least_recent(L1Segment::WINDOW));
+            return;
+        }
+        
+        // W-TinyLFU: il candidato è l'entrata in uscita dalla finestra, la vittima
+        // è la meno recente della parte principale (probation, poi protected)
+        uint32_t candidate = L1CacheIndex::INVALID_NODE;
+        if (index.weight(L1Segment::WINDOW) >= window_budget) {
+            candidate = index.least_recent(L1Segment::WINDOW);
+        }
+        
+        uint32_t victim = index.least_recent(L1Segment::PROBATION);
+        if (victim == L1CacheIndex::INVALID_NODE) {
+            victim = index.least_recent(L1Segment::PROTECTED);
+        }
+        
+        if (candidate == L1CacheIndex::INVALID_NODE || victim == L1CacheIndex::INVALID_NODE) {
+            // Un solo segmento occupato: rimuovi la sua entrata meno recente
+            erase_node((victim != L1CacheIndex::INVALID_NODE) ? victim : index.least_recent(L1Segment::WINDOW));
+            return;
+        }
+        
+        // Filtro di ammissione: il candidato entra solo se più frequente della vittima
+        const EnhancedTranslationEntry& c = index.at(candidate);
+        const EnhancedTranslationEntry& v = index.at(victim);
+        uint32_t candidate_freq = sketch.frequency(policy_hash(c.x86_addr));
+        uint32_t victim_freq = sketch.frequency(policy_hash(v.x86_addr));
+        
+        if (candidate_freq > victim_freq) {
+            erase_node(victim);
+            index.move_to(candidate, L1Segment::PROBATION);
+            admissions++;
+        } else {
+            erase_node(candidate);
+            rejections++;
+        }
+    }
+    
+    // Riporta lo shard sotto il budget dopo una riduzione, con un numero
+    // limitato di rimozioni per operazione (nessuna pausa globale)
+    void trim_step() {
+        for (size_t i = 0; i < L1_TRIM_BATCH && index.size() > 0 &&
+                           index.total_weight() > budget; i++) {
+            evict_entry();
+        }
+    }
+    
+    // Rivaluta il budget in base al miss rate dell'ultimo intervallo
+    void adapt_budget() {
+        double miss_rate = static_cast<double>(adapt_misses) / adapt_lookups;
+        adapt_lookups = 0;
+        adapt_misses = 0;
+        
+        // Cresce solo se lo shard è davvero pieno: un budget inutilizzato non riduce i miss
+        bool saturated = index.total_weight() + window_budget >= budget;
+        if (miss_rate > L1_GROW_MISS_RATE && saturated && budget < config.max_budget_bytes) {
+            set_budget(budget + budget / 4);
+            sketch.ensure_capacity(index.size() * 2);
+        } else if (miss_rate < L1_SHRINK_MISS_RATE && budget > config.min_budget_bytes) {
+            set_budget(budget - budget / 8);
+        }
+    }
+    
+    // Aggiorna la posizione di un'entrata dopo un accesso
+    void on_access(uint32_t node) {
+        if (policy == L1EvictionPolicy::LRU || index.segment_of(node) != L1Segment::PROBATION) {
+            index.touch(node);
+            return;
+        }
+        
+        // Un accesso in probation promuove in protected; l'eccedenza torna in probation
+        index.move_to(node, L1Segment::PROTECTED);
+        while (index.weight(L1Segment::PROTECTED) > protected_budget &&
+               index.size(L1Segment::PROTECTED) > 1) {
+            index.move_to(index.least_recent(L1Segment::PROTECTED), L1Segment::PROBATION);
+        }
+    }
+    
+    // Applica alla politica un accesso registrato (lock acquisito)
+    void apply_access(uint64_t sample) {
+        uint64_t h = sample & ~1ULL;
+        bool hit = (sample & 1) != 0;
+        
+        // Ogni accesso, anche mancato, alimenta lo stimatore di frequenza
+        if (policy == L1EvictionPolicy::W_TINYLFU) {
+            sketch.increment(h);
+        }
+        
+        // Dimensionamento adattivo del budget
+        adapt_lookups++;
+        if (!hit) {
+            adapt_misses++;
+        }
+        if (config.adaptive && adapt_lookups >= L1_ADAPT_INTERVAL) {
+            adapt_budget();
+        }
+        
+        if (hit) {
+            // L'entrata può essere stata rimossa dopo la lettura
+            uint32_t node = index.find_hashed(h);
+            if (node != L1CacheIndex::INVALID_NODE) {
+                EnhancedTranslationEntry& entry = index.at(node);
+                entry.last_access = std::chrono::system_clock::now();
+                entry.access_count++;
+                entry.is_hot = (entry.access_count > 10);
+                on_access(node);
+            }
+        }
+    }
+    
+    // Svuota il buffer degli accessi dei lettori (lock acquisito)
+    void drain_read_buffer() {
+        for (auto& slot : read_buffer) {
+            if (slot.load(std::memory_order_relaxed) != 0) {
+                uint64_t sample = slot.exchange(0, std::memory_order_relaxed);
+                if (sample != 0) {
+                    apply_access(sample);
+                }
+            }
+        }
+    }
+    
+    // Registra un accesso senza bloccare: se il lock è libero ogni
+    // READ_DRAIN_INTERVAL accessi il lettore svuota anche il buffer
+    void record_access(uint64_t x86_addr, bool hit) {
+        thread_local uint32_t cursor = static_cast<uint32_t>(
+            std::hash<std::thread::id>()(std::this_thread::get_id()));
+        
+        uint64_t sample = policy_hash(x86_addr) | (hit ? 1 : 0);
+        read_buffer[cursor++ & (READ_BUFFER_SIZE - 1)].store(sample, std::memory_order_relaxed);
+        
+        if ((cursor & (READ_DRAIN_INTERVAL - 1)) == 0 && mutex.try_lock()) {
+            drain_read_buffer();
+            trim_step();
+            mutex.unlock();
+        }
+    }
+    
+    // Ricerca sotto lock, per i thread senza slot lettore nell'EpochManager
+    bool lookup_locked(uint64_t x86_addr, EnhancedTranslationEntry& result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        uint32_t node = index.find(x86_addr);
+        bool hit = (node != L1CacheIndex::INVALID_NODE);
+        if (hit) {
+            result = index.at(node);
+        }
+        apply_access(policy_hash(x86_addr) | (hit ? 1 : 0));
+        trim_step();
+        return hit;
+    }
+    
+public:
+    explicit L1CacheShard(const TranslationCacheConfig& shard_config)
+        : config(shard_config), index(shard_config.initial_entries),
+          read_table(shard_config.initial_entries),
+          policy(shard_config.policy), sketch(shard_config.initial_entries) {
+        set_budget(config.budget_bytes);
+        for (auto& slot : read_buffer) {
+            slot.store(0, std::memory_order_relaxed);
+        }
+    }
+    
+    // Salva un'entrata nello shard
+    void save(const EnhancedTranslationEntry& entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        drain_read_buffer();
+        
+        // Controlla se esiste già
+        uint32_t node = index.find(entry.x86_addr);
+        
+        if (node != L1CacheIndex::INVALID_NODE) {
+            // Aggiorna l'entrata esistente
+            EnhancedTranslationEntry& existing = index.at(node);
+            code_bytes = code_bytes - existing.arm_size + entry.arm_size;
+            existing.arm_addr = entry.arm_addr;
+            existing.arm_size = entry.arm_size;
+            existing.x86_size = entry.x86_size;
+            existing.x86_hash = entry.x86_hash;
+            existing.code_generation = entry.code_generation;
+            existing.last_access = std::chrono::system_clock::now();
+            existing.access_count++;
+            existing.is_hot = (existing.access_count > 10); // Segna come "hot" se usato più di 10 volte
+            index.set_weight(node, entry_weight(existing));
+            read_table.publish(existing);
+            
+            on_access(node);
+        } else {
+            // Aggiungi una nuova entrata
+            EnhancedTranslationEntry new_entry = entry;
+            new_entry.last_access = std::chrono::system_clock::now();
+            new_entry.access_count = 1;
+            uint32_t weight = entry_weight(new_entry);
+            
+            // Blocchi più grandi dell'intero budget non vengono messi in cache
+            if (weight > budget) {
+                return;
+            }
+            
+            // Libera spazio finché il nuovo blocco rientra nel budget (costo ammortizzato O(1))
+            while (index.size() > 0 && index.total_weight() + weight > budget) {
+                evict_entry();
+            }
+            
+            // Le nuove entrate entrano sempre dalla finestra
+            index.insert(new_entry, weight, L1Segment::WINDOW);
+            read_table.publish(new_entry);
+            code_bytes += new_entry.arm_size;
+            
+            // Con W-TinyLFU la finestra in eccesso scivola in probation finché c'è posto
+            if (policy == L1EvictionPolicy::W_TINYLFU) {
+                while (index.weight(L1Segment::WINDOW) > window_budget &&
+                       index.size(L1Segment::WINDOW) > 1) {
+                    index.move_to(index.least_recent(L1Segment::WINDOW), L1Segment::PROBATION);
+                }
+            }
+        }
+        
+        trim_step();
+    }
+    
+    // Cerca un'entrata nello shard senza bloccare sugli scrittori. Il risultato
+    // è la copia pubblicata all'ultimo salvataggio: access_count può essere indietro.
+    bool lookup(uint64_t x86_addr, EnhancedTranslationEntry& result) {
+        bool hit;
+        {
+            EpochGuard guard;
+            if (!guard.active()) {
+                return lookup_locked(x86_addr, result);
+            }
+            
+            const EnhancedTranslationEntry* published = read_table.find(x86_addr);
+            hit = (published != nullptr);
+            if (hit) {
+                result = *published;
+            }
+        }
+        
+        record_access(x86_addr, hit);
+        return hit;
+    }
+    
+    // Legge un'entrata senza contarla come accesso (per i checkpoint)
+    bool peek(uint64_t x86_addr, EnhancedTranslationEntry& result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t node = index.find(x86_addr);
+        if (node == L1CacheIndex::INVALID_NODE) {
+            return false;
+        }
+        result = index.at(node);
+        return true;
+    }
+    
+    // Copia le entrate dello shard
+    std::vector<EnhancedTranslationEntry> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return index.snapshot();
+    }
+    
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return index.size();
+    }
+    
+    // Somma l'occupazione di memoria dello shard ai totali
+    void add_memory_stats(size_t& total_code, size_t& total_metadata, size_t& total_budget) {
+        std::lock_guard<std::mutex> lock(mutex);
+        total_code += code_bytes;
+        total_metadata += index.memory_usage() + read_table.memory_usage();
+        total_budget += budget;
+    }
+    
+    // Somma i contatori della politica dello shard ai totali
+    void add_policy_stats(L1PolicyStats& total) {
+        std::lock_guard<std::mutex> lock(mutex);
+        total.admissions += admissions;
+        total.rejections += rejections;
+        total.evictions += evictions;
+    }
+    
+    // Ridimensiona lo shard: il nuovo valore diventa anche il tetto del budget
+    void resize(size_t budget_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        config.max_budget_bytes = std::max(budget_bytes, L1CacheIndex::ENTRY_OVERHEAD);
+        config.min_budget_bytes = std::min(config.min_budget_bytes, config.max_budget_bytes);
+        set_budget(budget_bytes);
+        trim_step();
+    }
+    
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        index.clear();
+        read_table.clear();
+        sketch.clear();
+        for (auto& slot : read_buffer) {
+            slot.store(0, std::memory_order_relaxed);
+        }
+        code_bytes = 0;
+        adapt_lookups = adapt_misses = 0;
+        admissions = rejections = evictions = 0;
+    }
+};
+
+// Contatori di generazione delle pagine di codice guest. Ogni scrittura in una
+// pagina registrata incrementa la sua generazione: un blocco tradotto resta
+// valido finché la somma delle generazioni delle sue pagine non cambia (i
+// contatori crescono soltanto). Le letture sono senza lock; le regioni vengono
+// solo aggiunte e la lista è sostituita per copia sotto lock.
+class CodePageTracker {
+public:
+    static constexpr uint64_t PAGE_SHIFT = 12;  // Pagine guest da 4 KB
+
+private:
+    struct Region {
+        uint64_t first_page;
+        uint64_t page_count;
+        std::unique_ptr<std::atomic<uint32_t>[]> generations;
+
+        Region(uint64_t first, uint64_t count)
+            : first_page(first), page_count(count), generations(new std::atomic<uint32_t>[count]) {
+            for (uint64_t i = 0; i < count; i++) {
+                generations[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    using RegionList = std::vector<Region*>;
+
+    std::mutex regions_mutex;                       // Serializza le registrazioni
+    std::vector<std::unique_ptr<Region>> owned;     // Le regioni vivono quanto il tracker
+    std::atomic<const RegionList*> regions{new RegionList()};
+
+    static const Region* region_for(const RegionList& list, uint64_t page) {
+        for (const Region* r : list) {
+            if (page >= r->first_page && page - r->first_page < r->page_count) {
+                return r;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    CodePageTracker() = default;
+    CodePageTracker(const CodePageTracker&) = delete;
+    CodePageTracker& operator=(const CodePageTracker&) = delete;
+
+    ~CodePageTracker() {
+        delete regions.load(std::memory_order_relaxed);
+    }
+
+    // Registra un intervallo di codice guest (ad es. un modulo caricato)
+    void register_region(uint64_t base, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(regions_mutex);
+        uint64_t first = base >> PAGE_SHIFT;
+        uint64_t last = (base + size - 1) >> PAGE_SHIFT;
+        for (const auto& r : owned) {
+            if (r->first_page == first && r->page_count == last - first + 1) {
+                return; // Già registrata
+            }
+        }
+        owned.push_back(std::make_unique<Region>(first, last - first + 1));
+
+        const RegionList* old_list = regions.load(std::memory_order_relaxed);
+        RegionList* new_list = new RegionList(*old_list);
+        new_list->push_back(owned.back().get());
+        regions.store(new_list, std::memory_order_release);
+        EpochManager::instance().retire(old_list);
+    }
+
+    // Segnala una scrittura nel codice guest: invalida i blocchi tradotti delle pagine toccate
+    void notify_write(uint64_t addr, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        EpochGuard guard;
+        std::unique_lock<std::mutex> fallback;
+        if (!guard.active()) {
+            fallback = std::unique_lock<std::mutex>(regions_mutex);
+        }
+
+        const RegionList& list = *regions.load(std::memory_order_acquire);
+        for (uint64_t page = addr >> PAGE_SHIFT; page <= (addr + size - 1) >> PAGE_SHIFT; page++) {
+            const Region* r = region_for(list, page);
+            if (r) {
+                r->generations[page - r->first_page].fetch_add(1, std::memory_order_release);
+            }
+        }
+    }
+
+    // Generazione di un blocco [addr, addr + size). Restituisce false se il
+    // blocco non è interamente in pagine registrate.
+    bool generation(uint64_t addr, size_t size, uint64_t& result) {
+        EpochGuard guard;
+        std::unique_lock<std::mutex> fallback;
+        if (!guard.active()) {
+            fallback = std::unique_lock<std::mutex>(regions_mutex);
+        }
+
+        const RegionList& list = *regions.load(std::memory_order_acquire);
+        result = 0;
+        uint64_t last = (addr + std::max<size_t>(size, 1) - 1) >> PAGE_SHIFT;
+        for (uint64_t page = addr >> PAGE_SHIFT; page <= last; page++) {
+            const Region* r = region_for(list, page);
+            if (!r) {
+                return false;
+            }
+            result += r->generations[page - r->first_page].load(std::memory_order_acquire);
+        }
+        return true;
+    }
+};
+
+// Classe gestore della cache
+class TranslationCache {
+public:
+    // Versioni incluse nell'ID dei binari: cambiarle invalida tutte le cache esistenti
+    static constexpr uint32_t TRANSLATOR_VERSION = 1;      // Codice generato dal traduttore
+    static constexpr uint32_t RULESET_FORMAT_VERSION = 1;  // Formato e semantica dei file di regole
+
+private:
+    static constexpr size_t MAX_L2_CACHE_SIZE = 100 * 1024 * 1024; // 100MB
+    static constexpr const char* MANIFEST_FILE = "manifest.txt";
+
+    std::string cache_directory;
+    TranslationCacheConfig config;
+    uint64_t rules_fingerprint;  // Impronta di regole e traduttore correnti
+    
+    // Archivio degli oggetti della directory (nullptr se disabilitato): i checkpoint
+    // completi vi salvano il codice condivisibile tra i binari
+    std::shared_ptr<L2ObjectStore> shared_objects;
+    
+    // Cache L1 divisa in shard per indirizzo guest, ognuno con il proprio lock
+    std::vector<std::unique_ptr<L1CacheShard>> l1_shards;
+    uint32_t l1_shard_shift = 64;
+    
+    // Modulo guest di un binario: le entrate L2 sono relative alla sua base
+    struct BinaryModule {
+        std::string cache_file;
+        uint64_t image_hash = 0; // Hash dell'immagine completa, registrato nell'header L2
+        uint64_t base = 0;      // Indirizzo di caricamento nel processo corrente
+        size_t size = 0;
+        std::shared_ptr<SharedCodeCache> shared_code; // Regione condivisa con gli altri processi (se abilitata)
+        bool served = false;    // File L2 e regione ricevuti dal daemon, che ne scrive il log
+    };
+    
+    // Voce del manifest: file di cache di un ID binario
+    struct ManifestEntry {
+        std::string cache_file;  // Nome del file, relativo alla directory della cache
+        uint64_t image_hash = 0;
+        size_t size = 0;
+    };
+    
+    std::unordered_map<std::string, BinaryModule> binary_modules; // Mappa binary_id -> modulo e file di cache
+    std::unordered_map<std::string, std::shared_ptr<L2CacheFile>> l2_files; // Mappa binary_id -> file L2 mappato
+    std::unordered_map<std::string, ManifestEntry> manifest; // Mappa binary_id -> file, persistita su disco
+    std::shared_mutex binary_map_mutex; // Protegge binary_modules, l2_files e manifest
+    std::mutex manifest_write_mutex;    // Serializza le riscritture del manifest
+    
+    // Rilocazioni del codice ARM per indirizzo guest, scritte in L2 al checkpoint
+    std::unordered_map<uint64_t, std::vector<CacheFileRelocation>> code_relocations;
+    std::mutex relocations_mutex;
+    
+    // Blocchi salvati dopo l'ultimo checkpoint, da aggiungere al log L2
+    std::unordered_set<uint64_t> dirty_blocks;
+    std::mutex dirty_mutex;
+    
+    // Destinazione asincrona dei record L2 (vuota: i blocchi attendono il checkpoint)
+    L2RecordSink l2_record_sink;
+    
+    // Daemon di traduzione (nullptr se assente): i binari collegati tramite il
+    // daemon non scrivono nella directory di cache
+    std::shared_ptr<TranslationDaemonClient> daemon;
+    
+    // File L2 da cui è stato ceduto codice eseguibile: le entrate L1 vi puntano,
+    // quindi restano mappati anche dopo la sostituzione con un checkpoint
+    std::vector<std::shared_ptr<L2CacheFile>> executable_l2_files;
+    std::mutex executable_files_mutex;
+    
+    // Statistiche globali, aggiornate a lotti dai buffer per thread
+    std::shared_ptr<CacheStatsCounters> stats = std::make_shared<CacheStatsCounters>();
+    
+    // Generazioni delle pagine di codice guest, per validare le traduzioni senza rehash
+    CodePageTracker code_pages;
+    
+    // Shard responsabile di un indirizzo guest (bit alti dell'hash dell'indirizzo)
+    L1CacheShard& shard_for(uint64_t x86_addr) {
+        if (l1_shards.size() == 1) {
+            return *l1_shards[0];
+        }
+        return *l1_shards[L1CacheIndex::key_hash(x86_addr) >> l1_shard_shift];
+    }
+    
+    // Salva un'entrata nella cache L1 (in-memory)
+    void save_to_l1_cache(const EnhancedTranslationEntry& entry) {
+        shard_for(entry.x86_addr).save(entry);
+    }
+    
+    // Cerca nella cache L1 (in-memory) e verifica che il codice guest non sia cambiato
+    bool lookup_l1_cache(uint64_t x86_addr, const byte* x86_code, size_t available_size,
+                         EnhancedTranslationEntry& result) {
+        if (!shard_for(x86_addr).lookup(x86_addr, result)) {
+            return false;
+        }
+        return is_translation_current(result, x86_code, available_size);
+    }
+    
+    // Una traduzione è valida se le sue pagine hanno ancora la generazione registrata;
+    // fuori dalle regioni tracciate si ricorre all'hash del blocco
+    bool is_translation_current(const EnhancedTranslationEntry& entry, const byte* x86_code, size_t available_size) {
+        uint64_t generation;
+        if (code_pages.generation(entry.x86_addr, entry.x86_size, generation)) {
+            return generation == entry.code_generation;
+        }
+        return entry.x86_size <= available_size && hash_block(x86_code, entry.x86_size) == entry.x86_hash;
+    }
+    
+    // Generazione corrente di un blocco (0 se fuori dalle regioni tracciate)
+    uint64_t current_generation(uint64_t x86_addr, size_t x86_size) {
+        uint64_t generation;
+        return code_pages.generation(x86_addr, x86_size, generation) ? generation : 0;
+    }
     
     // Genera un ID unico per un binario
-    std::string generate_binary_id(const byte* binary, size_t size) {
-        // Usa xxHash per generare un hash veloce
-        uint64_t hash = XXH64(binary, size, 0);
+    // L'ID dipende solo dal contenuto (hash e dimensione dell'immagine) e dalle
+    // versioni di traduttore e regole: ogni esecuzione dello stesso binario ritrova la sua cache
+    static std::string generate_binary_id(uint64_t image_hash, size_t size) {
         std::stringstream ss;
-        ss << std::hex << hash;
+        ss << std::hex << std::setw(16) << std::setfill('0') << image_hash
+           << std::dec << "_" << size
+           << "_v" << TRANSLATOR_VERSION << "." << RULESET_FORMAT_VERSION;
+        return ss.str();
+    }
+    
+    // Legge il manifest della directory di cache. Formato di una riga:
+    // <binary_id> <file> <hash immagine esadecimale> <dimensione>
+    static std::unordered_map<std::string, ManifestEntry> read_manifest(const std::string& path) {
+        std::unordered_map<std::string, ManifestEntry> entries;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            
+            std::istringstream iss(line);
+            std::string binary_id;
+            ManifestEntry entry;
+            if (iss >> binary_id >> entry.cache_file >> std::hex >> entry.image_hash >> std::dec >> entry.size) {
+                entries[binary_id] = entry;
+            }
+        }
+        return entries;
+    }
+    
+    // Scrive il manifest unendo le voci già su disco (altri processi possono
+    // condividere la directory). Sostituito con file temporaneo + rename.
+    bool save_manifest() {
+        std::lock_guard<std::mutex> write_lock(manifest_write_mutex);
+        std::string path = cache_directory + "/" + MANIFEST_FILE;
+        std::unordered_map<std::string, ManifestEntry> entries = read_manifest(path);
+        {
+            std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+            for (const auto& [binary_id, entry] : manifest) {
+                entries[binary_id] = entry;
+            }
+        }
         
-        // Aggiungi un timestamp per evitare collisioni
-        ss << "_" << std::chrono::system_clock::now().time_since_epoch().count();
+        std::string temp_path = path + ".tmp." + std::to_string(getpid());
+        {
+            std::ofstream file(temp_path, std::ios::trunc);
+            if (!file.is_open()) {
+                std::cerr << "Impossibile scrivere il manifest della cache: " << temp_path << std::endl;
+                return false;
+            }
+            
+            file << "# binary_id file hash_immagine dimensione\n";
+            for (const auto& [binary_id, entry] : entries) {
+                file << binary_id << " " << entry.cache_file << " " << std::hex << entry.image_hash
+                     << std::dec << " " << entry.size << "\n";
+            }
+            if (!file.good()) {
+                std::remove(temp_path.c_str());
+                return false;
+            }
+        }
         
-        return ss.str();
+        std::error_code ec;
+        std::filesystem::rename(temp_path, path, ec);
+        if (ec) {
+            std::cerr << "Impossibile sostituire il manifest della cache: " << ec.message() << std::endl;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
     }
     
     // Calcola l'hash di un blocco di codice
@@ -108,318 +1578,663 @@ private:
         return XXH64(code, size, 0);
     }
     
-    // Salva un'entrata nella cache L1 (in-memory)
-    void save_to_l1_cache(const EnhancedTranslationEntry& entry) {
-        std::lock_guard<std::mutex> lock(cache_mutex);
+    // Converte un'entrata L1 del modulo nel formato su disco e ne copia le
+    // rilocazioni (relocations_mutex acquisito). arm_offset e reloc_first restano a 0.
+    // Restituisce false se l'entrata è fuori dal modulo o senza codice collocato.
+    bool make_file_entry(const EnhancedTranslationEntry& entry, const BinaryModule& module,
+                         CacheFileEntry& file_entry, std::vector<CacheFileRelocation>& relocations) {
+        if (entry.arm_addr == 0 || entry.x86_addr < module.base || entry.x86_addr - module.base >= module.size) {
+            return false;
+        }
         
-        // Controlla se esiste già
-        auto it = std::find_if(l1_cache.begin(), l1_cache.end(), 
-                             [&entry](const EnhancedTranslationEntry& e) {
-                                 return e.x86_addr == entry.x86_addr && e.x86_hash == entry.x86_hash;
-                             });
+        memset(&file_entry, 0, sizeof(file_entry));
+        file_entry.x86_offset = entry.x86_addr - module.base;
+        file_entry.x86_size = static_cast<uint32_t>(entry.x86_size);
+        file_entry.x86_hash = entry.x86_hash;
+        file_entry.arm_size = static_cast<uint32_t>(entry.arm_size);
+        file_entry.execution_count = entry.access_count;
+        file_entry.last_execution = std::chrono::system_clock::now().time_since_epoch().count();
+        file_entry.flags = entry.flags & ~(CACHE_ENTRY_NEEDS_PATCH | CACHE_ENTRY_SHARED);
+        file_entry.rules_tag = L2CacheFile::rules_tag(rules_fingerprint);
+        
+        // I campi rilocati vengono riscritti al caricamento: il codice si salva così com'è
+        relocations.clear();
+        auto relocs = code_relocations.find(entry.x86_addr);
+        if (relocs != code_relocations.end() && !relocs->second.empty()) {
+            relocations = relocs->second;
+            file_entry.reloc_count = static_cast<uint32_t>(relocations.size());
+            file_entry.flags |= CACHE_ENTRY_NEEDS_PATCH;
+        }
+        return true;
+    }
+    
+    // Salva una cache L2 su disco. Sono salvate solo le entrate del modulo con
+    // codice collocato in memoria: il codice è letto da arm_addr e gli indirizzi
+    // guest sono convertiti in offset dalla base del modulo. Le entrate del file
+    // precedente (base e log) per blocchi non presenti in L1 vengono conservate,
+    // comprese quelle tradotte con regole più vecchie: si riscrivono solo quando ritradotte.
+    bool save_l2_cache(const std::string& cache_file, const std::vector<EnhancedTranslationEntry>& entries,
+                     const BinaryModule& module, uint64_t x86_hash, const L2CacheFile* previous) {
+        std::vector<CacheFileEntry> file_entries;
+        std::vector<CacheFileRelocation> file_relocations;
+        std::vector<byte> arm_code;
+        file_entries.reserve(entries.size());
+        
+        {
+            std::lock_guard<std::mutex> lock(relocations_mutex);
+            CacheFileEntry file_entry;
+            std::vector<CacheFileRelocation> relocs;
+            for (const auto& entry : entries) {
+                if (!make_file_entry(entry, module, file_entry, relocs)) {
+                    continue;
+                }
+                
+                file_entry.arm_offset = arm_code.size();
+                file_entry.reloc_first = static_cast<uint32_t>(file_relocations.size());
+                file_relocations.insert(file_relocations.end(), relocs.begin(), relocs.end());
+                
+                const byte* code = reinterpret_cast<const byte*>(entry.arm_addr);
+                arm_code.insert(arm_code.end(), code, code + entry.arm_size);
+                file_entries.push_back(file_entry);
+            }
+        }
         
-        if (it != l1_cache.end()) {
-            // Aggiorna l'entrata esistente
-            it->arm_addr = entry.arm_addr;
-            it->arm_size = entry.arm_size;
-            it->last_access = std::chrono::system_clock::now();
-            it->access_count++;
-            it->is_hot = (it->access_count > 10); // Segna come "hot" se usato più di 10 volte
-            
-            // Sposta in testa (LRU)
-            std::rotate(l1_cache.begin(), it, it + 1);
-        } else {
-            // Aggiungi una nuova entrata
-            EnhancedTranslationEntry new_entry = entry;
-            new_entry.last_access = std::chrono::system_clock::now();
-            new_entry.access_count = 1;
+        if (previous) {
+            std::unordered_set<uint64_t> saved;
+            for (const auto& file_entry : file_entries) {
+                saved.insert(file_entry.x86_offset);
+            }
             
-            // Se la cache è piena, rimuovi l'entrata meno recente
-            if (l1_cache.size() >= MAX_L1_CACHE_ENTRIES) {
-                // Prova a rimuovere un'entrata non "hot"
-                auto cold_it = std::find_if(l1_cache.rbegin(), l1_cache.rend(),
-                                         [](const EnhancedTranslationEntry& e) {
-                                             return !e.is_hot;
-                                         });
+            // Le entrate conservate mantengono codice, rilocazioni e stato delle regole;
+            // per ogni blocco vale la versione più recente (il log precede il file base)
+            uint32_t current_tag = L2CacheFile::rules_tag(rules_fingerprint);
+            previous->for_each_entry([&](const CacheFileEntry& previous_entry) {
+                const byte* code = previous->code_of(previous_entry);
+                const CacheFileRelocation* relocs = previous->relocations_of(previous_entry);
+                if (!code || !relocs || saved.count(previous_entry.x86_offset) ||
+                    arm_code.size() + previous_entry.arm_size > MAX_L2_CACHE_SIZE) {
+                    return;
+                }
+                saved.insert(previous_entry.x86_offset);
                 
-                if (cold_it != l1_cache.rend()) {
-                    // Rimuovi l'entrata "cold" trovata
-                    l1_cache.erase((cold_it + 1).base());
-                } else {
-                    // Se sono tutte "hot", rimuovi la meno recente
-                    l1_cache.pop_back();
+                // Nel nuovo file l'etichetta coincide con quella corrente solo se
+                // l'entrata era già corrente
+                CacheFileEntry file_entry = previous_entry;
+                if (previous->is_current(previous_entry, rules_fingerprint)) {
+                    file_entry.rules_tag = current_tag;
+                } else if (file_entry.rules_tag == current_tag) {
+                    file_entry.rules_tag ^= 1;
                 }
+                
+                file_entry.arm_offset = arm_code.size();
+                file_entry.reloc_first = static_cast<uint32_t>(file_relocations.size());
+                file_relocations.insert(file_relocations.end(), relocs, relocs + file_entry.reloc_count);
+                arm_code.insert(arm_code.end(), code, code + file_entry.arm_size);
+                file_entries.push_back(file_entry);
+            });
+        }
+        
+        return L2CacheFile::write(cache_file, x86_hash, rules_fingerprint, 0, file_entries, file_relocations, arm_code,
+                                  config.l2_compression, shared_objects.get());
+    }
+    
+    // Estrae i blocchi del modulo salvati dopo l'ultimo checkpoint
+    std::vector<uint64_t> take_dirty_blocks(const BinaryModule& module) {
+        std::vector<uint64_t> addresses;
+        std::lock_guard<std::mutex> lock(dirty_mutex);
+        for (auto it = dirty_blocks.begin(); it != dirty_blocks.end(); ) {
+            if (*it >= module.base && *it - module.base < module.size) {
+                addresses.push_back(*it);
+                it = dirty_blocks.erase(it);
+            } else {
+                ++it;
             }
-            
-            // Inserisci in testa
-            l1_cache.insert(l1_cache.begin(), new_entry);
         }
+        return addresses;
     }
     
-    // Cerca nella cache L1 (in-memory)
-    bool lookup_l1_cache(uint64_t x86_addr, uint64_t block_hash, EnhancedTranslationEntry& result) {
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        
-        auto it = std::find_if(l1_cache.begin(), l1_cache.end(),
-                             [x86_addr, block_hash](const EnhancedTranslationEntry& e) {
-                                 return e.x86_addr == x86_addr && e.x86_hash == block_hash;
-                             });
-        
-        if (it != l1_cache.end()) {
-            // Trovato nella cache L1
-            result = *it;
-            
-            // Aggiorna le statistiche di accesso
-            it->last_access = std::chrono::system_clock::now();
-            it->access_count++;
-            it->is_hot = (it->access_count > 10);
-            
-            // Sposta in testa (LRU)
-            std::rotate(l1_cache.begin(), it, it + 1);
-            
-            l1_hits++;
-            return true;
+    // Costruisce il record del log L2 di un'entrata (relocations_mutex acquisito)
+    bool make_log_record(const EnhancedTranslationEntry& entry, const BinaryModule& module, L2LogRecord& record) {
+        if (!make_file_entry(entry, module, record.entry, record.relocations)) {
+            return false;
+        }
+        record.rules_fingerprint = rules_fingerprint;
+        const byte* code = reinterpret_cast<const byte*>(entry.arm_addr);
+        record.code.assign(code, code + entry.arm_size);
+        return true;
+    }
+    
+    // Record del log L2 per le entrate L1 dei blocchi indicati. Quelle già
+    // rimosse da L1 vanno perse e saranno ritradotte.
+    std::vector<L2LogRecord> collect_log_records(const BinaryModule& module, const std::vector<uint64_t>& addresses) {
+        std::vector<L2LogRecord> records;
+        records.reserve(addresses.size());
+        std::lock_guard<std::mutex> lock(relocations_mutex);
+        for (uint64_t x86_addr : addresses) {
+            EnhancedTranslationEntry entry;
+            L2LogRecord record;
+            if (shard_for(x86_addr).peek(x86_addr, entry) && make_log_record(entry, module, record)) {
+                records.push_back(std::move(record));
+            }
+        }
+        return records;
+    }
+    
+    // Aggiunge al log del file L2 le entrate L1 dei blocchi indicati
+    bool append_l2_log(L2CacheFile& file, const BinaryModule& module, const std::vector<uint64_t>& addresses) {
+        std::vector<L2LogRecord> records = collect_log_records(module, addresses);
+        return file.log_segment().append(records);
+    }
+    
+    // Invia al daemon le entrate L1 dei blocchi indicati e attende che siano nel log
+    bool send_to_daemon(const std::string& binary_id, const BinaryModule& module, const std::vector<uint64_t>& addresses) {
+        bool sent = true;
+        for (auto& record : collect_log_records(module, addresses)) {
+            sent = sent && daemon->queue_record(binary_id, record);
+        }
+        return sent && daemon->flush();
+    }
+    
+    // Converte un'entrata su disco nel formato interno per un modulo caricato in module_base
+    static EnhancedTranslationEntry from_file_entry(const CacheFileEntry& file_entry, uint64_t module_base) {
+        EnhancedTranslationEntry entry;
+        entry.x86_addr = module_base + file_entry.x86_offset;
+        entry.arm_addr = 0; // Sarà inizializzato dopo il caricamento in memoria
+        entry.x86_size = file_entry.x86_size;
+        entry.arm_size = file_entry.arm_size;
+        entry.x86_hash = file_entry.x86_hash;
+        entry.last_access = std::chrono::system_clock::time_point(
+            std::chrono::duration<uint64_t>(file_entry.last_execution));
+        entry.access_count = file_entry.execution_count;
+        entry.is_hot = (file_entry.execution_count > 10);
+        entry.flags = file_entry.flags;
+        entry.code_generation = 0; // Da validare con l'hash prima dell'uso
+        return entry;
+    }
+    
+    // Copia il codice di un'entrata L2 applicando le rilocazioni per module_base
+    bool copy_relocated_code(const L2CacheFile& file, const CacheFileEntry& file_entry,
+                             uint64_t module_base, std::vector<byte>& arm_code) {
+        const byte* code = file.code_of(file_entry);
+        const CacheFileRelocation* relocs = file.relocations_of(file_entry);
+        if (!code || !relocs) {
+            return false;
         }
         
-        return false;
+        arm_code.assign(code, code + file_entry.arm_size);
+        for (uint32_t i = 0; i < file_entry.reloc_count; i++) {
+            if (!apply_relocation(arm_code.data(), arm_code.size(), relocs[i], module_base)) {
+                std::cerr << "Rilocazione non valida per il blocco all'offset 0x" << std::hex
+                          << file_entry.x86_offset << std::dec << std::endl;
+                return false;
+            }
+        }
+        return true;
     }
     
-    // Salva una cache L2 su disco
-    bool save_l2_cache(const std::string& cache_file, const std::vector<EnhancedTranslationEntry>& entries,
-                     const std::vector<byte>& arm_code, uint64_t x86_hash) {
-        std::ofstream file(cache_file, std::ios::binary);
-        if (!file.is_open()) {
-            std::cerr << "Errore nell'apertura del file di cache per scrittura: " << cache_file << std::endl;
+    // Carica una cache L2 da disco per un modulo caricato in module_base
+    bool load_l2_cache(const std::string& cache_file, uint64_t module_base,
+                     std::vector<EnhancedTranslationEntry>& entries,
+                     std::vector<byte>& arm_code, uint64_t expected_hash) {
+        L2CacheFile file;
+        if (!file.open(cache_file, expected_hash)) {
             return false;
         }
         
-        // Scrivi l'header
-        CacheFileHeader header;
-        header.magic = CACHE_MAGIC;
-        header.version = CACHE_VERSION;
-        header.entry_count = static_cast<uint32_t>(entries.size());
-        header.x86_hash = x86_hash;
-        header.creation_time = std::chrono::system_clock::now().time_since_epoch().count();
-        header.last_access = header.creation_time;
-        header.hit_count = 0;
-        memset(header.reserved, 0, sizeof(header.reserved));
+        entries.clear();
+        arm_code.clear();
+        std::vector<byte> block_code;
+        std::unordered_set<uint64_t> loaded;
+        file.for_each_entry([&](const CacheFileEntry& file_entry) {
+            if (loaded.count(file_entry.x86_offset) || !file.is_current(file_entry, rules_fingerprint) ||
+                !copy_relocated_code(file, file_entry, module_base, block_code)) {
+                return;
+            }
+            loaded.insert(file_entry.x86_offset);
+            
+            // Il codice viene ricompattato nell'ordine delle entrate
+            arm_code.insert(arm_code.end(), block_code.begin(), block_code.end());
+            entries.push_back(from_file_entry(file_entry, module_base));
+        });
+        return true;
+    }
+    
+    // Mappa il file L2 di un binario, se esiste; sostituisce la mappatura precedente
+    void map_l2_file(const std::string& binary_id, const std::string& cache_file, uint64_t image_hash) {
+        auto file = std::make_shared<L2CacheFile>();
+        if (!std::filesystem::exists(cache_file) || !file->open(cache_file, image_hash)) {
+            file.reset();
+        }
         
-        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        std::unique_lock<std::shared_mutex> lock(binary_map_mutex);
+        if (file) {
+            l2_files[binary_id] = file;
+        } else {
+            l2_files.erase(binary_id);
+        }
+    }
+    
+    // Cerca in un file L2 mappato. L'entrata è accettata solo se l'hash del
+    // codice guest corrente coincide: è l'unico punto in cui si rehasha.
+    // Il codice senza patch viene eseguito dalla mappatura del file (mapped = true);
+    // altrimenti è copiato in arm_code.
+    bool lookup_l2_cache(const std::shared_ptr<L2CacheFile>& l2_file, uint64_t module_base, uint64_t x86_addr,
+                       const byte* x86_code, size_t available_size,
+                       EnhancedTranslationEntry& result, std::vector<byte>& arm_code, bool& mapped) {
+        L2CacheFile& file = *l2_file;
+        
+        // Le entrate tradotte con regole diverse sono ignorate: il blocco
+        // viene ritradotto solo quando eseguito.
+        // L'hash è calcolato solo per le entrate con lo stesso indirizzo.
+        // La generazione è letta prima dell'hash: una scrittura concorrente la rende obsoleta.
+        uint64_t generation = 0;
+        const CacheFileEntry* found = file.find(x86_addr - module_base, [&](const CacheFileEntry& e) {
+            if (e.x86_size > available_size || !file.is_current(e, rules_fingerprint) || !file.code_of(e)) {
+                return false;
+            }
+            generation = current_generation(x86_addr, e.x86_size);
+            return hash_block(x86_code, e.x86_size) == e.x86_hash;
+        });
         
-        // Calcola l'offset iniziale dei dati ARM
-        uint64_t data_start = sizeof(header) + entries.size() * sizeof(CacheFileEntry);
-        uint64_t current_arm_offset = 0;
+        if (!found || !load_l2_entry(l2_file, *found, module_base, x86_addr, result, arm_code, mapped)) {
+            return false;
+        }
+        result.code_generation = generation;
         
-        // Scrivi le entry
-        for (const auto& entry : entries) {
-            CacheFileEntry file_entry;
-            file_entry.x86_addr = entry.x86_addr;
-            file_entry.x86_size = static_cast<uint32_t>(entry.x86_size);
-            file_entry.x86_hash = entry.x86_hash;
-            file_entry.arm_offset = current_arm_offset;
-            file_entry.arm_size = static_cast<uint32_t>(entry.arm_size);
-            file_entry.execution_count = entry.access_count;
-            file_entry.last_execution = std::chrono::system_clock::now().time_since_epoch().count();
-            file_entry.flags = entry.flags;
-            memset(file_entry.reserved, 0, sizeof(file_entry.reserved));
+        // Aggiorna le statistiche direttamente nella mappatura condivisa
+        file.record_hit(*found);
+        return true;
+    }
+    
+    // Prepara l'entrata L1 di un'entrata L2 già validata: il codice senza patch
+    // resta nella mappatura (mapped = true), altrimenti è copiato in arm_code
+    bool load_l2_entry(const std::shared_ptr<L2CacheFile>& l2_file, const CacheFileEntry& found,
+                       uint64_t module_base, uint64_t x86_addr,
+                       EnhancedTranslationEntry& result, std::vector<byte>& arm_code, bool& mapped) {
+        L2CacheFile& file = *l2_file;
+        result = from_file_entry(found, module_base);
+        
+        const byte* executable = file.executable_code_of(found);
+        mapped = (executable != nullptr);
+        if (mapped) {
+            // Nessuna copia: l'entrata punta direttamente alla mappatura eseguibile
+            result.arm_addr = reinterpret_cast<uint64_t>(executable);
+            arm_code.clear();
             
-            file.write(reinterpret_cast<const char*>(&file_entry), sizeof(file_entry));
+            std::lock_guard<std::mutex> lock(executable_files_mutex);
+            if (std::find(executable_l2_files.begin(), executable_l2_files.end(), l2_file) ==
+                executable_l2_files.end()) {
+                executable_l2_files.push_back(l2_file);
+            }
+        } else {
+            // Copia il codice ARM dalla mappatura e applica le rilocazioni
+            if (!copy_relocated_code(file, found, module_base, arm_code)) {
+                arm_code.clear();
+                return false;
+            }
             
-            // Aggiorna l'offset per il prossimo blocco ARM
-            current_arm_offset += entry.arm_size;
+            // Le rilocazioni seguono l'entrata nei checkpoint successivi
+            if (found.reloc_count > 0) {
+                const CacheFileRelocation* relocs = file.relocations_of(found);
+                std::lock_guard<std::mutex> lock(relocations_mutex);
+                code_relocations[x86_addr].assign(relocs, relocs + found.reloc_count);
+            }
         }
-        
-        // Scrivi il codice ARM
-        file.write(reinterpret_cast<const char*>(arm_code.data()), arm_code.size());
-        
         return true;
     }
     
-    // Carica una cache L2 da disco
-    bool load_l2_cache(const std::string& cache_file, std::vector<EnhancedTranslationEntry>& entries,
-                     std::vector<byte>& arm_code, uint64_t expected_hash) {
-        std::ifstream file(cache_file, std::ios::binary);
-        if (!file.is_open()) {
+    // Cerca nella regione condivisa del modulo, verificando l'hash del codice
+    // guest corrente come per L2. Se la regione è eseguibile result.arm_addr
+    // punta al codice nella regione; altrimenti il codice è copiato in arm_code
+    // e result.arm_addr è 0.
+    bool lookup_shared_code(const SharedCodeCache& shared_code, uint64_t module_base, uint64_t x86_addr,
+                            const byte* x86_code, size_t available_size,
+                            EnhancedTranslationEntry& result, std::vector<byte>& arm_code) {
+        uint64_t generation = 0;
+        SharedCodeHit hit;
+        bool found = shared_code.find(x86_addr - module_base, rules_fingerprint, [&](uint32_t x86_size, uint64_t x86_hash) {
+            if (x86_size > available_size) {
+                return false;
+            }
+            generation = current_generation(x86_addr, x86_size);
+            return hash_block(x86_code, x86_size) == x86_hash;
+        }, hit);
+        if (!found) {
             return false;
         }
         
-        // Leggi l'header
-        CacheFileHeader header;
-        file.read(reinterpret_cast<char*>(&header), sizeof(header));
-        
-        // Verifica l'header
-        if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
-            std::cerr << "File di cache non valido o versione non supportata: " << cache_file << std::endl;
-            return false;
+        result.x86_addr = x86_addr;
+        result.x86_size = hit.x86_size;
+        result.arm_size = hit.code_size;
+        result.x86_hash = hit.x86_hash;
+        result.last_access = std::chrono::system_clock::now();
+        result.access_count = 1;
+        result.is_hot = false;
+        result.flags = 0;
+        result.code_generation = generation;
+        if (shared_code.is_executable()) {
+            result.arm_addr = reinterpret_cast<uint64_t>(hit.code);
+            arm_code.clear();
+        } else {
+            result.arm_addr = 0;
+            arm_code.assign(hit.code, hit.code + hit.code_size);
         }
-        
-        // Verifica l'hash
-        if (expected_hash != 0 && header.x86_hash != expected_hash) {
-            std::cerr << "Hash del binario non corrispondente per la cache: " << cache_file << std::endl;
-            return false;
+        return true;
+    }
+    
+public:
+    TranslationCache(const std::string& cache_dir = "./cache",
+                     const TranslationCacheConfig& cache_config = TranslationCacheConfig())
+        : cache_directory(cache_dir), config(cache_config),
+          rules_fingerprint(fingerprint_rule_files({})),
+          l1_shards() {
+        // Numero di shard arrotondato a potenza di 2; il budget è ripartito tra gli shard
+        size_t shard_count = 1;
+        while (shard_count < config.shard_count) {
+            shard_count <<= 1;
         }
+        config.shard_count = shard_count;
         
-        // Leggi le entrate
-        std::vector<CacheFileEntry> file_entries(header.entry_count);
-        file.read(reinterpret_cast<char*>(file_entries.data()), header.entry_count * sizeof(CacheFileEntry));
+        TranslationCacheConfig shard_config = config;
+        shard_config.initial_entries = std::max<size_t>(1, config.initial_entries / shard_count);
+        shard_config.budget_bytes = config.budget_bytes / shard_count;
+        shard_config.min_budget_bytes = config.min_budget_bytes / shard_count;
+        shard_config.max_budget_bytes = config.max_budget_bytes / shard_count;
         
-        // Trova la dimensione totale del codice ARM
-        size_t total_arm_size = 0;
-        for (const auto& entry : file_entries) {
-            total_arm_size = std::max(total_arm_size, static_cast<size_t>(entry.arm_offset + entry.arm_size));
+        for (size_t i = 0; i < shard_count; i++) {
+            l1_shards.push_back(std::make_unique<L1CacheShard>(shard_config));
+        }
+        while ((size_t(1) << (64 - l1_shard_shift)) < shard_count) {
+            l1_shard_shift--;
         }
         
-        // Leggi il codice ARM
-        arm_code.resize(total_arm_size);
-        file.read(reinterpret_cast<char*>(arm_code.data()), total_arm_size);
-        
-        // Converti le entrate nel formato interno
-        entries.clear();
-        for (const auto& file_entry : file_entries) {
-            EnhancedTranslationEntry entry;
-            entry.x86_addr = file_entry.x86_addr;
-            entry.arm_addr = 0; // Sarà inizializzato dopo il caricamento in memoria
-            entry.x86_size = file_entry.x86_size;
-            entry.arm_size = file_entry.arm_size;
-            entry.x86_hash = file_entry.x86_hash;
-            entry.last_access = std::chrono::system_clock::time_point(
-                std::chrono::duration<uint64_t>(file_entry.last_execution));
-            entry.access_count = file_entry.execution_count;
-            entry.is_hot = (file_entry.execution_count > 10);
-            entry.flags = file_entry.flags;
-            entries.push_back(entry);
-        }
-        
-        // Aggiorna le statistiche di accesso
-        header.hit_count++;
-        header.last_access = std::chrono::system_clock::now().time_since_epoch().count();
-        
-        // Riscrivi l'header aggiornato
-        file.seekp(0);
-        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        // Crea la directory cache se non esiste
+        std::filesystem::create_directories(cache_directory);
         
-        return true;
+        manifest = read_manifest(cache_directory + "/" + MANIFEST_FILE);
+        if (config.l2_shared_objects) {
+            shared_objects = L2ObjectStore::shared(cache_directory + "/" + L2ObjectStore::FILE_NAME);
+            if (!shared_objects) {
+                std::cerr << "Archivio degli oggetti non disponibile: il codice resta nei file L2" << std::endl;
+            }
+        }
     }
     
-    // Cerca in una specifica cache L2 su disco
-    bool lookup_l2_cache(const std::string& cache_file, uint64_t x86_addr, uint64_t block_hash,
-                       EnhancedTranslationEntry& result, std::vector<byte>& arm_code) {
-        std::ifstream file(cache_file, std::ios::binary);
-        if (!file.is_open()) {
-            return false;
+    // Inizializza la cache per un nuovo binario caricato all'indirizzo guest load_base.
+    // Le entrate L2 sono relative alla base, quindi valgono per qualunque indirizzo di caricamento.
+    std::string initialize_for_binary(const byte* binary, size_t size, uint64_t load_base = 0) {
+        uint64_t image_hash = XXH64(binary, size, 0);
+        std::string binary_id = generate_binary_id(image_hash, size);
+        std::string cache_file;
+        
+        // Con il daemon file L2 e regione condivisa arrivano come descrittori
+        if (daemon && attach_through_daemon(binary_id, image_hash, size, load_base)) {
+            return binary_id;
         }
         
-        // Leggi l'header
-        CacheFileHeader header;
-        file.read(reinterpret_cast<char*>(&header), sizeof(header));
-        
-        // Verifica l'header
-        if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
-            return false;
+        // La regione condivisa ha il nome dell'ID e delle regole: i processi dello stesso binario la ritrovano
+        std::shared_ptr<SharedCodeCache> shared_code;
+        if (config.shared_code_bytes > 0) {
+            shared_code = std::make_shared<SharedCodeCache>();
+            if (!shared_code->attach(SharedCodeCache::name_for(binary_id, rules_fingerprint), config.shared_code_bytes)) {
+                shared_code.reset();
+            }
         }
         
-        // Leggi le entrate
-        std::vector<CacheFileEntry> entries(header.entry_count);
-        file.read(reinterpret_cast<char*>(entries.data()), header.entry_count * sizeof(CacheFileEntry));
+        // Memorizza la mappatura ID -> modulo e file cache; il file registrato
+        // nel manifest ha la precedenza sul nome predefinito
+        {
+            std::unique_lock<std::shared_mutex> lock(binary_map_mutex);
+            auto known = manifest.find(binary_id);
+            if (known != manifest.end() && known->second.image_hash == image_hash && known->second.size == size) {
+                cache_file = cache_directory + "/" + known->second.cache_file;
+            } else {
+                cache_file = cache_directory + "/" + binary_id + ".cache";
+            }
+            
+            BinaryModule& module = binary_modules[binary_id];
+            module.cache_file = cache_file;
+            module.image_hash = image_hash;
+            module.base = load_base;
+            module.size = size;
+            module.shared_code = shared_code;
+        }
         
-        // Cerca l'entrata
-        auto it = std::find_if(entries.begin(), entries.end(),
-                            [x86_addr, block_hash](const CacheFileEntry& e) {
-                                return e.x86_addr == x86_addr && e.x86_hash == block_hash;
-                            });
+        // Mappa il file L2 una sola volta per binario
+        map_l2_file(binary_id, cache_file, image_hash);
         
-        if (it == entries.end()) {
+        return binary_id;
+    }
+    
+    // Collega un binario tramite il daemon: il file L2 e il suo log sono mappati in
+    // sola lettura e le nuove traduzioni gli vengono inviate. Se il daemon non
+    // risponde il binario usa la directory di cache come senza daemon.
+    bool attach_through_daemon(const std::string& binary_id, uint64_t image_hash, size_t size, uint64_t load_base) {
+        DaemonAttachment attachment;
+        if (!daemon->attach(binary_id, image_hash, size, rules_fingerprint, attachment)) {
+            std::cerr << "Daemon di traduzione non disponibile: cache locale per " << binary_id << std::endl;
             return false;
         }
         
-        // Calcola l'offset nel file
-        uint64_t data_start = sizeof(header) + header.entry_count * sizeof(CacheFileEntry);
-        uint64_t arm_offset = data_start + it->arm_offset;
-        
-        // Leggi il codice ARM
-        file.seekg(arm_offset);
-        arm_code.resize(it->arm_size);
-        file.read(reinterpret_cast<char*>(arm_code.data()), it->arm_size);
-        
-        // Popola il risultato
-        result.x86_addr = it->x86_addr;
-        result.arm_addr = 0; // Sarà inizializzato dopo il caricamento in memoria
-        result.x86_size = it->x86_size;
-        result.arm_size = it->arm_size;
-        result.x86_hash = it->x86_hash;
-        result.last_access = std::chrono::system_clock::time_point(
-            std::chrono::duration<uint64_t>(it->last_execution));
-        result.access_count = it->execution_count;
-        result.is_hot = (it->execution_count > 10);
-        result.flags = it->flags;
-        
-        // Aggiorna le statistiche
-        l2_hits++;
-        
-        // Aggiorna l'entrata su disco
-        it->execution_count++;
-        it->last_execution = std::chrono::system_clock::now().time_since_epoch().count();
-        
-        // Aggiorna l'header
-        header.hit_count++;
-        header.last_access = it->last_execution;
-        
-        // Riscrivi l'header e l'entrata
-        std::ofstream update_file(cache_file, std::ios::binary | std::ios::in | std::ios::out);
-        if (update_file.is_open()) {
-            update_file.seekp(0);
-            update_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
-            
-            size_t entry_offset = sizeof(header) + (it - entries.begin()) * sizeof(CacheFileEntry);
-            update_file.seekp(entry_offset);
-            update_file.write(reinterpret_cast<const char*>(&(*it)), sizeof(CacheFileEntry));
+        auto file = std::make_shared<L2CacheFile>();
+        if (attachment.cache_fd < 0) {
+            if (attachment.log_fd >= 0) {
+                ::close(attachment.log_fd);
+            }
+            file.reset();
+        } else if (!file->open_fd(attachment.cache_fd, attachment.log_fd, attachment.cache_file, image_hash)) {
+            file.reset();
+        }
+        
+        std::shared_ptr<SharedCodeCache> shared_code;
+        if (attachment.shared_code_fd >= 0) {
+            shared_code = std::make_shared<SharedCodeCache>();
+            if (!shared_code->attach_fd(attachment.shared_code_fd,
+                                      SharedCodeCache::name_for(binary_id, rules_fingerprint))) {
+                shared_code.reset();
+            }
         }
         
+        std::unique_lock<std::shared_mutex> lock(binary_map_mutex);
+        BinaryModule& module = binary_modules[binary_id];
+        module.cache_file = attachment.cache_file;
+        module.image_hash = image_hash;
+        module.base = load_base;
+        module.size = size;
+        module.shared_code = shared_code;
+        module.served = true;
+        if (file) {
+            l2_files[binary_id] = file;
+        } else {
+            l2_files.erase(binary_id);
+        }
         return true;
     }
     
-public:
-    TranslationCache(const std::string& cache_dir = "./cache") : cache_directory(cache_dir) {
-        // Crea la directory cache se non esiste
-        std::filesystem::create_directories(cache_directory);
+    // Collega la cache a un daemon di traduzione (prima di inizializzare i binari)
+    void use_daemon(std::shared_ptr<TranslationDaemonClient> client) {
+        daemon = std::move(client);
+    }
+    
+    bool has_daemon() const {
+        return daemon != nullptr;
+    }
+    
+    // Scrive i contatori L2 accumulati (o li invia al daemon) e invia al daemon
+    // i record in attesa
+    void flush_pending_writes() {
+        flush_l2_stats();
+        if (daemon) {
+            daemon->flush();
+        }
     }
     
-    // Inizializza la cache per un nuovo binario
-    std::string initialize_for_binary(const byte* binary, size_t size) {
-        std::string binary_id = generate_binary_id(binary, size);
-        std::string cache_file = cache_directory + "/" + binary_id + ".cache";
+    // Da chiamare prima di un fork: i contatori L2 accumulati e i record per il
+    // daemon vengono scritti dal padre, invece di essere ereditati da ogni figlio
+    void prepare_fork() {
+        flush_pending_writes();
+    }
+    
+    // Da chiamare nel figlio dopo un fork. L1 e regioni condivise sono ereditate
+    // così come sono; i file L2 scritti dal processo vengono rimappati, perché
+    // i loro flock (sul log e sull'archivio degli oggetti) sono legati al
+    // descrittore condiviso con il padre. Il daemon riceve una connessione propria.
+    void after_fork_child() {
+        if (daemon && !daemon->reconnect()) {
+            std::cerr << "Daemon di traduzione non raggiungibile dal processo figlio" << std::endl;
+        }
         
-        // Memorizza la mappatura ID -> file cache
-        binary_cache_map[binary_id] = cache_file;
+        std::vector<std::pair<std::string, BinaryModule>> local_modules;
+        {
+            std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+            for (const auto& [binary_id, module] : binary_modules) {
+                if (!module.served && l2_files.count(binary_id)) {
+                    local_modules.emplace_back(binary_id, module);
+                }
+            }
+        }
+        for (const auto& [binary_id, module] : local_modules) {
+            map_l2_file(binary_id, module.cache_file, module.image_hash);
+        }
         
-        return binary_id;
+        std::unordered_set<L2ObjectStore*> stores;
+        if (shared_objects) {
+            stores.insert(shared_objects.get());
+        }
+        {
+            std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+            for (const auto& [binary_id, file] : l2_files) {
+                if (file->object_store()) {
+                    stores.insert(file->object_store().get());
+                }
+            }
+        }
+        for (L2ObjectStore* store : stores) {
+            store->reopen_descriptor();
+        }
+    }
+    
+    // Impronta del traduttore e del contenuto dei file di regole. Un file mancante
+    // contribuisce solo con il nome: le definizioni predefinite dipendono dal traduttore.
+    static uint64_t fingerprint_rule_files(const std::vector<std::string>& files) {
+        uint64_t fingerprint = XXH64(&TRANSLATOR_VERSION, sizeof(TRANSLATOR_VERSION), RULESET_FORMAT_VERSION);
+        for (const auto& path : files) {
+            fingerprint = XXH64(path.data(), path.size(), fingerprint);
+            
+            std::ifstream file(path, std::ios::binary);
+            if (file.is_open()) {
+                std::stringstream buffer;
+                buffer << file.rdbuf();
+                std::string content = buffer.str();
+                fingerprint = XXH64(content.data(), content.size(), fingerprint);
+            }
+        }
+        return fingerprint;
+    }
+    
+    // Imposta l'impronta delle regole con cui vengono tradotti i nuovi blocchi
+    // (prima di inizializzare i binari). Le entrate L2 con un'impronta diversa
+    // sono ritradotte quando vengono eseguite.
+    void set_rules_fingerprint(uint64_t fingerprint) {
+        rules_fingerprint = fingerprint;
     }
     
-    // Cerca un blocco in tutte le cache (L1 poi L2)
+    uint64_t get_rules_fingerprint() const {
+        return rules_fingerprint;
+    }
+    
+    // Registra un intervallo di codice guest le cui scritture vanno tracciate
+    void register_code_region(uint64_t base, size_t size) {
+        code_pages.register_region(base, size);
+    }
+    
+    // Segnala una scrittura nel codice guest (codice automodificante, caricamento, ecc.)
+    void notify_code_write(uint64_t addr, size_t size) {
+        code_pages.notify_write(addr, size);
+    }
+    
+    // Cerca un blocco in tutte le cache (L1 poi L2). x86_code punta al codice guest
+    // all'indirizzo x86_addr e available_size è il numero di byte leggibili: la
+    // dimensione del blocco è quella registrata nell'entrata, quindi non serve
+    // analizzare il blocco prima della ricerca. Un hit L1 costa un confronto di
+    // generazione; l'hash del blocco si calcola solo per le entrate lette da L2.
     CacheLookupResult lookup(const std::string& binary_id, uint64_t x86_addr, 
-                           const byte* x86_code, size_t x86_size,
+                           const byte* x86_code, size_t available_size,
                            std::vector<byte>& arm_code) {
         CacheLookupResult result;
         result.found = false;
-        
-        // Calcola l'hash del blocco x86
-        uint64_t block_hash = hash_block(x86_code, x86_size);
+        result.mapped = false;
         
         // Cerca nella cache L1 (memoria)
         EnhancedTranslationEntry entry;
-        if (lookup_l1_cache(x86_addr, block_hash, entry)) {
+        ThreadStatsBuffer& thread_stats = ThreadStatsBuffer::local();
+        if (lookup_l1_cache(x86_addr, x86_code, available_size, entry)) {
+            thread_stats.record(stats, 1, 0, 0);
             result.found = true;
             result.level = CacheLevel::L1_MEMORY;
             result.entry = entry;
             return result;
         }
         
-        // Cerca nella cache L2 (disco)
-        auto it = binary_cache_map.find(binary_id);
-        if (it != binary_cache_map.end()) {
-            if (lookup_l2_cache(it->second, x86_addr, block_hash, entry, arm_code)) {
-                // Trovato in L2, aggiungi anche a L1
+        // Regione condivisa e file L2 del modulo, solo per indirizzi interni al modulo
+        std::shared_ptr<L2CacheFile> l2_file;
+        std::shared_ptr<SharedCodeCache> shared_code;
+        uint64_t module_base = 0;
+        {
+            std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+            auto it = l2_files.find(binary_id);
+            auto module = binary_modules.find(binary_id);
+            if (module != binary_modules.end() &&
+                x86_addr >= module->second.base && x86_addr - module->second.base < module->second.size) {
+                l2_file = (it != l2_files.end()) ? it->second : nullptr;
+                shared_code = module->second.shared_code;
+                module_base = module->second.base;
+            }
+        }
+        
+        // Cerca nella regione condivisa: traduzioni di qualunque processo del binario.
+        // I suoi hit sono contati come hit L2, anche nei contatori del file.
+        if (shared_code && lookup_shared_code(*shared_code, module_base, x86_addr, x86_code, available_size,
+                                              entry, arm_code)) {
+            if (l2_file) {
+                l2_file->record_hit_at(x86_addr - module_base, entry.x86_hash);
+            }
+            result.mapped = (entry.arm_addr != 0);
+            if (result.mapped) {
                 save_to_l1_cache(entry);
+            }
+            thread_stats.record(stats, 0, 1, 0);
+            
+            result.found = true;
+            result.level = CacheLevel::SHARED_MEMORY;
+            result.entry = entry;
+            return result;
+        }
+        
+        // Il filtro di Bloom del file scarta i miss certi prima del probing
+        if (l2_file && l2_file->may_contain(x86_addr - module_base)) {
+            if (lookup_l2_cache(l2_file, module_base, x86_addr, x86_code, available_size, entry, arm_code, result.mapped)) {
+                // Il codice copiato senza rilocazioni passa nella regione condivisa:
+                // eseguibile da lì in questo e negli altri processi
+                if (!result.mapped && shared_code && !(entry.flags & CACHE_ENTRY_NEEDS_PATCH) &&
+                    shared_code->is_executable()) {
+                    const byte* published = shared_code->publish(x86_addr - module_base, entry.x86_hash,
+                                                                 static_cast<uint32_t>(entry.x86_size), rules_fingerprint,
+                                                                 arm_code.data(), static_cast<uint32_t>(arm_code.size()));
+                    if (published) {
+                        entry.arm_addr = reinterpret_cast<uint64_t>(published);
+                        arm_code.clear();
+                        result.mapped = true;
+                    }
+                }
+                
+                // Trovato in L2: se il codice è mappato l'entrata è già eseguibile e
+                // va in L1; se è stato copiato, sarà il chiamante a registrarla con
+                // promote_to_l1 dopo averlo collocato in memoria
+                if (result.mapped) {
+                    save_to_l1_cache(entry);
+                }
+                thread_stats.record(stats, 0, 1, 0);
                 
                 result.found = true;
                 result.level = CacheLevel::L2_PERSISTENT;
@@ -429,15 +2244,127 @@ public:
         }
         
         // Non trovato
-        misses++;
+        thread_stats.record(stats, 0, 0, 1);
         result.level = CacheLevel::NOT_FOUND;
         return result;
     }
     
-    // Salva un blocco tradotto in cache
+    // Applica ai file L2 mappati le statistiche di esecuzione accumulate dalle
+    // ricerche (chiamata periodicamente dal PersistenceManager, vedi
+    // PersistenceManager::set_stats_flusher, e da flush_pending_writes). I file
+    // serviti dal daemon sono mappati in sola lettura: i loro contatori sono
+    // inviati al daemon. Restituisce le entrate aggiornate.
+    size_t flush_l2_stats() {
+        std::vector<std::pair<std::string, std::shared_ptr<L2CacheFile>>> files;
+        {
+            std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+            for (const auto& [binary_id, file] : l2_files) {
+                files.emplace_back(binary_id, file);
+            }
+        }
+        
+        size_t updated = 0;
+        for (const auto& [binary_id, file] : files) {
+            updated += file->flush_stats();
+            if (daemon) {
+                std::vector<L2HitRecord> hits;
+                uint64_t file_hits = file->take_hits(hits);
+                if (file_hits > 0 && daemon->send_hits(binary_id, hits, file_hits)) {
+                    updated += hits.size();
+                }
+            }
+        }
+        return updated;
+    }
+    
+    // Warm start: porta in L1 le entrate L2 più eseguite del binario (per
+    // execution_count, poi last_execution), prima che l'esecuzione le richieda.
+    // image è il codice guest caricato alla base del modulo e serve a verificare
+    // gli hash. Le entrate eseguibili dalla mappatura entrano in L1 direttamente;
+    // le altre sono collocate da place, che restituisce l'indirizzo del codice
+    // copiato (0 = spazio esaurito). Non aggiorna le statistiche di esecuzione.
+    // Restituisce il numero di entrate caricate.
+    size_t preload_hot_entries(const std::string& binary_id, const byte* image, size_t image_size,
+                               size_t max_entries, const std::function<uint64_t(const std::vector<byte>&)>& place,
+                               const std::atomic<bool>* cancel = nullptr) {
+        std::shared_ptr<L2CacheFile> l2_file;
+        uint64_t module_base = 0;
+        {
+            std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+            auto it = l2_files.find(binary_id);
+            auto module = binary_modules.find(binary_id);
+            if (it == l2_files.end() || module == binary_modules.end()) {
+                return 0;
+            }
+            l2_file = it->second;
+            module_base = module->second.base;
+        }
+        
+        // Versione più recente e corrente di ogni blocco (il log precede il file base)
+        std::vector<const CacheFileEntry*> candidates;
+        std::unordered_set<uint64_t> seen;
+        l2_file->for_each_entry([&](const CacheFileEntry& e) {
+            if (seen.insert(e.x86_offset).second && l2_file->is_current(e, rules_fingerprint) &&
+                e.x86_offset < image_size && e.x86_size <= image_size - e.x86_offset) {
+                candidates.push_back(&e);
+            }
+        });
+        
+        size_t count = std::min(max_entries, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                          [](const CacheFileEntry* a, const CacheFileEntry* b) {
+            if (a->execution_count != b->execution_count) {
+                return a->execution_count > b->execution_count;
+            }
+            return a->last_execution > b->last_execution;
+        });
+        
+        size_t loaded = 0;
+        std::vector<byte> arm_code;
+        for (size_t i = 0; i < count && !(cancel && cancel->load()); i++) {
+            const CacheFileEntry& e = *candidates[i];
+            uint64_t x86_addr = module_base + e.x86_offset;
+            
+            // Già in L1: l'esecuzione è arrivata prima del warm start
+            EnhancedTranslationEntry existing;
+            if (shard_for(x86_addr).peek(x86_addr, existing)) {
+                continue;
+            }
+            
+            // La generazione precede l'hash, come in lookup_l2_cache
+            uint64_t generation = current_generation(x86_addr, e.x86_size);
+            if (hash_block(image + e.x86_offset, e.x86_size) != e.x86_hash) {
+                continue;
+            }
+            
+            EnhancedTranslationEntry entry;
+            bool mapped = false;
+            if (!load_l2_entry(l2_file, e, module_base, x86_addr, entry, arm_code, mapped)) {
+                continue;
+            }
+            if (!mapped) {
+                entry.arm_addr = place(arm_code);
+                if (entry.arm_addr == 0) {
+                    break;
+                }
+            }
+            entry.code_generation = generation;
+            save_to_l1_cache(entry);
+            loaded++;
+        }
+        return loaded;
+    }
+    
+    // Salva un blocco tradotto in cache. relocations descrive i riferimenti a
+    // indirizzi guest del modulo emessi nel codice ARM (offset dalla base del modulo);
+    // un codice senza riferimenti assoluti non ne ha e può essere eseguito dalla mappatura L2.
     void store(const std::string& binary_id, uint64_t x86_addr, const byte* x86_code, size_t x86_size,
-             uint64_t arm_addr, const byte* arm_code, size_t arm_size) {
-        // Calcola l'hash del blocco x86
+             uint64_t arm_addr, const byte* arm_code, size_t arm_size,
+             const std::vector<CacheFileRelocation>& relocations = {}) {
+        // La generazione precede l'hash: una scrittura concorrente invalida l'entrata
+        uint64_t generation = current_generation(x86_addr, x86_size);
+        
+        // Calcola l'hash del blocco x86 (serve per la validazione in L2)
         uint64_t block_hash = hash_block(x86_code, x86_size);
         
         // Crea l'entrata
@@ -451,59 +2378,223 @@ public:
         entry.access_count = 1;
         entry.is_hot = false;
         entry.flags = 0;
+        entry.code_generation = generation;
+        
+        {
+            std::lock_guard<std::mutex> lock(relocations_mutex);
+            if (relocations.empty()) {
+                code_relocations.erase(x86_addr);
+            } else {
+                code_relocations[x86_addr] = relocations;
+            }
+        }
+        
+        // Il codice senza rilocazioni è pubblicato per gli altri processi del binario
+        if (relocations.empty()) {
+            std::shared_ptr<SharedCodeCache> shared_code;
+            uint64_t module_base = 0;
+            {
+                std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+                auto module = binary_modules.find(binary_id);
+                if (module != binary_modules.end() &&
+                    x86_addr >= module->second.base && x86_addr - module->second.base < module->second.size) {
+                    shared_code = module->second.shared_code;
+                    module_base = module->second.base;
+                }
+            }
+            if (shared_code) {
+                shared_code->publish(x86_addr - module_base, block_hash, static_cast<uint32_t>(x86_size), rules_fingerprint,
+                                     arm_code, static_cast<uint32_t>(arm_size));
+            }
+        }
         
         // Salva in L1
         save_to_l1_cache(entry);
         
         // Programmata la scrittura in L2 (asincrona)
-        schedule_l2_write(binary_id, block_hash);
+        schedule_l2_write(binary_id, entry);
+    }
+    
+    // Registra in L1 un'entrata letta da L2 il cui codice è stato collocato in arm_addr
+    void promote_to_l1(const EnhancedTranslationEntry& entry) {
+        save_to_l1_cache(entry);
+    }
+    
+    // Imposta la destinazione asincrona dei record L2 (prima di salvare blocchi)
+    void set_l2_record_sink(L2RecordSink sink) {
+        l2_record_sink = std::move(sink);
     }
     
-    // Programma una scrittura asincrona in cache L2
-    void schedule_l2_write(const std::string& binary_id, uint64_t block_hash) {
-        // In una implementazione reale, questo metodo aggiungerebbe la scrittura a una coda
-        // che verrebbe processata da un thread separato.
-        // Per semplicità, qui assumiamo che la scrittura avvenga in modo sincrono al prossimo
-        // checkpoint o alla chiusura del programma.
+    // Programma una scrittura asincrona in cache L2: il record dell'entrata è
+    // consegnato al sink, che lo aggiunge al log del file L2 senza bloccare il
+    // chiamante. Senza sink o senza file L2 mappato il blocco viene salvato al
+    // prossimo checkpoint. Per i binari collegati al daemon il record gli viene inviato.
+    void schedule_l2_write(const std::string& binary_id, const EnhancedTranslationEntry& entry) {
+        std::shared_ptr<L2CacheFile> file;
+        BinaryModule module;
+        bool served = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+            auto it = l2_files.find(binary_id);
+            auto known = binary_modules.find(binary_id);
+            if (known != binary_modules.end() && known->second.served) {
+                module = known->second;
+                served = true;
+            } else if (l2_record_sink && it != l2_files.end() && known != binary_modules.end() &&
+                       it->second->log_segment().is_open()) {
+                file = it->second;
+                module = known->second;
+            }
+        }
+        
+        // I binari collegati al daemon gli inviano il record, a lotti
+        if (served || file) {
+            L2LogRecord record;
+            bool valid;
+            {
+                std::lock_guard<std::mutex> lock(relocations_mutex);
+                valid = make_log_record(entry, module, record);
+            }
+            if (valid && served && daemon->queue_record(binary_id, record)) {
+                return;
+            }
+            if (valid && file) {
+                l2_record_sink(binary_id, file, std::move(record));
+                return;
+            }
+        }
+        
+        std::lock_guard<std::mutex> lock(dirty_mutex);
+        dirty_blocks.insert(entry.x86_addr);
     }
     
     // Preleva tutte le entrate dalla cache L1
     std::vector<EnhancedTranslationEntry> get_all_l1_entries() {
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        return l1_cache;
+        std::vector<EnhancedTranslationEntry> entries;
+        for (auto& shard : l1_shards) {
+            auto shard_entries = shard->snapshot();
+            entries.insert(entries.end(), shard_entries.begin(), shard_entries.end());
+        }
+        return entries;
     }
     
-    // Esegue il checkpoint della cache su disco
-    void checkpoint(const std::string& binary_id, const std::vector<byte>& full_arm_code) {
-        std::lock_guard<std::mutex> lock(cache_mutex);
+    // Esegue il checkpoint della cache su disco: il codice delle entrate è letto
+    // direttamente dai loro arm_addr. Se il file L2 esiste, al suo log vengono
+    // aggiunti solo i blocchi salvati dopo l'ultimo checkpoint; altrimenti il
+    // file viene scritto per intero. Per i binari collegati al daemon i blocchi
+    // gli vengono inviati e il checkpoint attende che siano nel log.
+    void checkpoint(const std::string& binary_id) {
+        BinaryModule module;
+        std::shared_ptr<L2CacheFile> previous;
+        {
+            std::shared_lock<std::shared_mutex> lock(binary_map_mutex);
+            auto it = binary_modules.find(binary_id);
+            if (it == binary_modules.end()) {
+                return;
+            }
+            module = it->second;
+            
+            auto file = l2_files.find(binary_id);
+            if (file != l2_files.end()) {
+                previous = file->second;
+            }
+        }
         
-        auto it = binary_cache_map.find(binary_id);
-        if (it == binary_cache_map.end()) {
-            return;
+        // Estratti prima della copia di L1: i blocchi salvati nel frattempo
+        // restano marcati per il checkpoint successivo
+        std::vector<uint64_t> dirty = take_dirty_blocks(module);
+        
+        bool saved;
+        if (module.served) {
+            saved = send_to_daemon(binary_id, module, dirty);
+        } else if (previous && previous->log_segment().is_open()) {
+            saved = append_l2_log(*previous, module, dirty);
+        } else {
+            // Salva le entrate L1 del modulo su disco, più quelle del file precedente non ancora in L1;
+            // i contatori accumulati del file precedente passano al nuovo file
+            if (previous) {
+                previous->flush_stats();
+            }
+            saved = save_l2_cache(module.cache_file, get_all_l1_entries(), module, module.image_hash, previous.get());
+            if (saved) {
+                // Il file è stato sostituito: i lettori in corso mantengono la mappatura precedente
+                map_l2_file(binary_id, module.cache_file, module.image_hash);
+                
+                {
+                    std::unique_lock<std::shared_mutex> lock(binary_map_mutex);
+                    ManifestEntry& entry = manifest[binary_id];
+                    entry.cache_file = std::filesystem::path(module.cache_file).filename().string();
+                    entry.image_hash = module.image_hash;
+                    entry.size = module.size;
+                }
+                save_manifest();
+            }
         }
         
-        // Salva tutte le entrate della cache L1 su disco
-        save_l2_cache(it->second, l1_cache, full_arm_code, XXH64(nullptr, 0, 0)); // Placeholder per l'hash completo
+        if (!saved) {
+            // I blocchi restano da salvare al prossimo checkpoint
+            std::lock_guard<std::mutex> lock(dirty_mutex);
+            dirty_blocks.insert(dirty.begin(), dirty.end());
+        }
     }
     
-    // Ottiene statistiche sulla cache
+    // Ottiene statistiche sulla cache. I contatori degli altri thread possono
+    // essere in ritardo di al più ThreadStatsBuffer::STATS_BATCH eventi ciascuno.
     void get_stats(size_t& l1_hit_count, size_t& l2_hit_count, size_t& miss_count, size_t& entry_count) {
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        
-        l1_hit_count = l1_hits;
-        l2_hit_count = l2_hits;
-        miss_count = misses;
-        entry_count = l1_cache.size();
+        ThreadStatsBuffer::local().flush();
+        
+        l1_hit_count = stats->l1_hits.load(std::memory_order_relaxed);
+        l2_hit_count = stats->l2_hits.load(std::memory_order_relaxed);
+        miss_count = stats->misses.load(std::memory_order_relaxed);
+        entry_count = 0;
+        for (auto& shard : l1_shards) {
+            entry_count += shard->size();
+        }
+    }
+    
+    // Ottiene l'occupazione di memoria della cache L1. I metadati includono il pool
+    // di nodi, che non si riduce: il suo massimo è limitato da max_budget_bytes.
+    void get_memory_stats(size_t& code_bytes, size_t& metadata_bytes, size_t& budget_bytes) {
+        code_bytes = metadata_bytes = budget_bytes = 0;
+        for (auto& shard : l1_shards) {
+            shard->add_memory_stats(code_bytes, metadata_bytes, budget_bytes);
+        }
+    }
+    
+    // Ridimensiona la cache L1: il nuovo valore diventa anche il tetto del budget
+    // di memoria del processo, sotto il quale continua il dimensionamento adattivo.
+    // La riduzione avviene in modo incrementale sulle operazioni successive.
+    void resize(size_t budget_bytes) {
+        for (auto& shard : l1_shards) {
+            shard->resize(budget_bytes / l1_shards.size());
+        }
+    }
+    
+    // Ottiene i contatori della politica L1
+    L1PolicyStats get_policy_stats() {
+        // Ogni ricerca passa prima da L1
+        ThreadStatsBuffer::local().flush();
+        size_t l1_hits = stats->l1_hits.load(std::memory_order_relaxed);
+        size_t lookups = l1_hits + stats->l2_hits.load(std::memory_order_relaxed) +
+                         stats->misses.load(std::memory_order_relaxed);
+        
+        L1PolicyStats total = {config.policy, lookups, l1_hits, 0, 0, 0};
+        for (auto& shard : l1_shards) {
+            shard->add_policy_stats(total);
+        }
+        return total;
     }
     
     // Pulisce la cache
     void clear() {
-        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (auto& shard : l1_shards) {
+            shard->clear();
+        }
         
-        l1_cache.clear();
-        l1_hits = 0;
-        l2_hits = 0;
-        misses = 0;
+        ThreadStatsBuffer::local().flush();
+        stats->l1_hits = 0;
+        stats->l2_hits = 0;
+        stats->misses = 0;
     }
 };
 
@@ -637,7 +2728,7 @@ public:
     
     // Esegue un checkpoint della cache
     void checkpoint() {
-        translation_cache.checkpoint(current_binary_id, arm_memory);
+        translation_cache.checkpoint(current_binary_id);
     }
     
     // Identifica e ottimizza i blocchi caldi
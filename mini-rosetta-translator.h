@@ -16,6 +16,8 @@
  #include <sys/mman.h>
  #include <cstring>
  
+ #include "rules-blob.h"
+ 
  // Tipi di utilità
  using byte = uint8_t;
  using arm_inst = uint32_t;
@@ -157,6 +159,9 @@
      std::unordered_map<uint32_t, ARMInstructionDef> arm_defs;
      std::vector<TranslationRule> translation_rules;
      
+     // Regole precompilate (rules.bin): se mappate sostituiscono le tre tabelle sopra
+     RuleSetBlob rule_blob;
+     
      // Stato
      CPUState cpu_state;
      std::vector<byte> x86_memory;
@@ -164,6 +169,43 @@
      std::vector<TranslationEntry> translation_cache;
      size_t next_arm_offset = 0;
      
+     // Flag RULE_X86_* di un opcode; false se l'opcode non è definito
+     bool x86_def_flags(uint8_t opcode, uint8_t& flags) const {
+ #ifdef ROTHECA_STATIC_RULES
+         flags = static_rules::X86_DEFS[opcode].flags;
+         return static_rules::X86_DEFS[opcode].present;
+ #else
+         if (rule_blob.is_open()) {
+             const RuleBlobX86Def* def = rule_blob.x86_def(opcode);
+             if (def) {
+                 flags = def->flags;
+             }
+             return def != nullptr;
+         }
+         auto it = x86_defs.find(opcode);
+         if (it == x86_defs.end()) {
+             return false;
+         }
+         const auto& def = it->second;
+         flags = (def.has_modrm ? RULE_X86_MODRM : 0) | (def.has_sib ? RULE_X86_SIB : 0) |
+                 (def.has_displacement ? RULE_X86_DISPLACEMENT : 0) | (def.has_immediate ? RULE_X86_IMMEDIATE : 0);
+         return true;
+ #endif
+     }
+     
+     const char* x86_mnemonic(uint8_t opcode) const {
+ #ifdef ROTHECA_STATIC_RULES
+         return static_rules::X86_DEFS[opcode].mnemonic;
+ #else
+         if (rule_blob.is_open()) {
+             const RuleBlobX86Def* def = rule_blob.x86_def(opcode);
+             return def ? rule_blob.string_at(def->mnemonic) : "UNKNOWN";
+         }
+         auto it = x86_defs.find(opcode);
+         return it != x86_defs.end() ? it->second.mnemonic.c_str() : "UNKNOWN";
+ #endif
+     }
+     
      // Funzioni di decodifica e traduzione
      X86DecodedInst decode_x86_instruction(const byte* code, size_t offset, size_t max_length) {
          X86DecodedInst inst = {0};
@@ -175,25 +217,23 @@
          inst.opcode = code[offset];
          inst.length = 1;
          
-         auto it = x86_defs.find(inst.opcode);
-         if (it != x86_defs.end()) {
-             const auto& def = it->second;
-             
+         uint8_t flags = 0;
+         if (x86_def_flags(inst.opcode, flags)) {
              // Controlla se c'è un byte ModR/M
-             if (def.has_modrm && offset + inst.length < max_length) {
+             if ((flags & RULE_X86_MODRM) && offset + inst.length < max_length) {
                  inst.modrm = code[offset + inst.length];
                  inst.length++;
                  
                  // Controlla se c'è un byte SIB
                  int mod = (inst.modrm >> 6) & 0x3;
                  int rm = inst.modrm & 0x7;
-                 if (def.has_sib && mod != 3 && rm == 4 && offset + inst.length < max_length) {
+                 if ((flags & RULE_X86_SIB) && mod != 3 && rm == 4 && offset + inst.length < max_length) {
                      inst.sib = code[offset + inst.length];
                      inst.length++;
                  }
                  
                  // Controlla se c'è un displacement
-                 if (def.has_displacement) {
+                 if (flags & RULE_X86_DISPLACEMENT) {
                      if ((mod == 1) && offset + inst.length < max_length) {
                          inst.displacement = static_cast<int8_t>(code[offset + inst.length]);
                          inst.length++;
@@ -205,7 +245,7 @@
              }
              
              // Controlla se c'è un immediato
-             if (def.has_immediate && offset + inst.length + 3 < max_length) {
+             if ((flags & RULE_X86_IMMEDIATE) && offset + inst.length + 3 < max_length) {
                  inst.immediate = *reinterpret_cast<const int32_t*>(&code[offset + inst.length]);
                  inst.length += 4;
              }
@@ -238,6 +278,22 @@
      std::vector<arm_inst> translate_x86_instruction(const X86DecodedInst& x86_inst) {
          std::vector<arm_inst> arm_code;
          
+ #ifdef ROTHECA_STATIC_RULES
+         arm_inst emitted[static_rules::MAX_RULE_LENGTH];
+         size_t emitted_count = static_rules::emit_translation(x86_inst.opcode, emitted);
+         if (emitted_count > 0) {
+             arm_code.assign(emitted, emitted + emitted_count);
+             return arm_code;
+         }
+ #else
+         // Con il blob la regola è indicizzata direttamente per opcode
+         const uint32_t* blob_opcodes = nullptr;
+         uint32_t blob_count = 0;
+         if (rule_blob.is_open() && rule_blob.translation(x86_inst.opcode, blob_opcodes, blob_count)) {
+             arm_code.assign(blob_opcodes, blob_opcodes + blob_count);
+             return arm_code;
+         }
+         
          // Trova nella tabella delle regole di traduzione
          for (const auto& rule : translation_rules) {
              if (rule.x86_opcode == x86_inst.opcode) {
@@ -248,6 +304,7 @@
                  return arm_code;
              }
          }
+ #endif
          
          // Se non troviamo una regola, inseriamo un NOP
          arm_code.push_back(0xD503201F); // NOP
@@ -409,6 +466,14 @@
          // Inizializza lo stato della CPU
          memset(&cpu_state, 0, sizeof(CPUState));
          
+ #ifdef ROTHECA_STATIC_RULES
+         // Regole compilate nel binario: nessun file da leggere
+ #else
+         // Il blob precompilato, se aggiornato, evita il parsing dei file di testo
+         if (rule_blob.open(RULE_BLOB_FILE)) {
+             return;
+         }
+         
          // Carica le definizioni
          load_definitions("x86_defs.txt", "x86");
          load_definitions("arm_defs.txt", "arm");
@@ -429,6 +494,7 @@
              create_default_definitions("translation");
              save_definitions_to_file("translation_rules.txt", "translation");
          }
+ #endif
      }
      
      TranslationEntry* find_in_cache(uint64_t x86_addr) {
@@ -461,14 +527,20 @@
                  break;
              }
              
-             std::string mnemonic = "UNKNOWN";
-             auto it = x86_defs.find(inst.opcode);
-             if (it != x86_defs.end()) {
-                 mnemonic = it->second.mnemonic;
-             }
-             
              std::cout << "Traduzione istruzione x86: 0x" << std::hex << static_cast<int>(inst.opcode)
-                       << " (" << mnemonic << ")" << std::dec << std::endl;
+                       << " (" << x86_mnemonic(inst.opcode) << ")" << std::dec << std::endl;
+             
+ #ifdef ROTHECA_STATIC_RULES
+             // Con spazio sufficiente la regola scrive direttamente nel buffer di destinazione
+             if (max_arm_inst - arm_offset >= static_rules::MAX_RULE_LENGTH) {
+                 size_t emitted = static_rules::emit_translation(inst.opcode, arm_code + arm_offset);
+                 if (emitted > 0) {
+                     arm_offset += emitted;
+                     x86_offset += inst.length;
+                     continue;
+                 }
+             }
+ #endif
              
              auto arm_instructions = translate_x86_instruction(inst);
              
@@ -6,14 +6,23 @@
 #include <memory>
 #include <chrono>
 #include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include <fenv.h>
 #include <stdio.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "xxhash.h"
 #include "mini-rosetta-translator.h"
 #include "cache.h"
 #include "cache-signatures.h"
-#include "cache-persitence.h"
+#include "cache-persistence.h"
+#include "cache-daemon.h"
+#include "rules-blob.h"
 
 
 // Includi i componenti sviluppati
@@ -27,17 +36,29 @@ private:
     // Configurazione
     static constexpr int MAX_CACHE_ENTRIES = 4096;
     static constexpr int TRANSLATION_BLOCK_SIZE = 4096;
+    static constexpr size_t WARM_START_ENTRIES = 512;  // Blocchi più eseguiti precaricati all'avvio
     
     // Componenti esistenti
     std::unordered_map<uint8_t, X86InstructionDef> x86_defs;
     std::unordered_map<uint32_t, ARMInstructionDef> arm_defs;
     std::vector<TranslationRule> translation_rules;
     
+    // Regole precompilate (rules.bin): se mappate sostituiscono le tre tabelle sopra
+    RuleSetBlob rule_blob;
+    
     // Stato
     CPUState cpu_state;
     std::vector<byte> x86_memory;
     std::vector<byte> arm_memory;
     size_t next_arm_offset = 0;
+    std::mutex arm_memory_mutex;  // Protegge next_arm_offset: il warm start colloca codice in parallelo
+    // Codice già collocato per contenuto (XXH64 -> indirizzi in arm_memory): le
+    // traduzioni identiche di blocchi diversi condividono una sola copia
+    std::unordered_multimap<uint64_t, uint64_t> placed_code;
+    
+    // Warm start: precarica i blocchi caldi della cache L2 mentre l'esecuzione parte
+    std::thread warm_start_thread;
+    std::atomic<bool> warm_start_cancel{false};
     
     // Sistema di cache
     std::unique_ptr<TranslationCache> translation_cache;
@@ -51,6 +72,44 @@ private:
     std::string current_binary_id;
     
     // Componenti originali per la decodifica e traduzione
+    
+    // Flag RULE_X86_* di un opcode; false se l'opcode non è definito
+    bool x86_def_flags(uint8_t opcode, uint8_t& flags) const {
+#ifdef ROTHECA_STATIC_RULES
+        flags = static_rules::X86_DEFS[opcode].flags;
+        return static_rules::X86_DEFS[opcode].present;
+#else
+        if (rule_blob.is_open()) {
+            const RuleBlobX86Def* def = rule_blob.x86_def(opcode);
+            if (def) {
+                flags = def->flags;
+            }
+            return def != nullptr;
+        }
+        auto it = x86_defs.find(opcode);
+        if (it == x86_defs.end()) {
+            return false;
+        }
+        const auto& def = it->second;
+        flags = (def.has_modrm ? RULE_X86_MODRM : 0) | (def.has_sib ? RULE_X86_SIB : 0) |
+                (def.has_displacement ? RULE_X86_DISPLACEMENT : 0) | (def.has_immediate ? RULE_X86_IMMEDIATE : 0);
+        return true;
+#endif
+    }
+    
+    const char* x86_mnemonic(uint8_t opcode) const {
+#ifdef ROTHECA_STATIC_RULES
+        return static_rules::X86_DEFS[opcode].mnemonic;
+#else
+        if (rule_blob.is_open()) {
+            const RuleBlobX86Def* def = rule_blob.x86_def(opcode);
+            return def ? rule_blob.string_at(def->mnemonic) : "UNKNOWN";
+        }
+        auto it = x86_defs.find(opcode);
+        return it != x86_defs.end() ? it->second.mnemonic.c_str() : "UNKNOWN";
+#endif
+    }
+    
     // Funzioni di decodifica e traduzione
     X86DecodedInst decode_x86_instruction(const byte* code, size_t offset, size_t max_length) {
         X86DecodedInst inst = {0};
@@ -62,25 +121,23 @@ private:
         inst.opcode = code[offset];
         inst.length = 1;
         
-        auto it = x86_defs.find(inst.opcode);
-        if (it != x86_defs.end()) {
-            const auto& def = it->second;
-            
+        uint8_t flags = 0;
+        if (x86_def_flags(inst.opcode, flags)) {
             // Controlla se c'è un byte ModR/M
-            if (def.has_modrm && offset + inst.length < max_length) {
+            if ((flags & RULE_X86_MODRM) && offset + inst.length < max_length) {
                 inst.modrm = code[offset + inst.length];
                 inst.length++;
                 
                 // Controlla se c'è un byte SIB
                 int mod = (inst.modrm >> 6) & 0x3;
                 int rm = inst.modrm & 0x7;
-                if (def.has_sib && mod != 3 && rm == 4 && offset + inst.length < max_length) {
+                if ((flags & RULE_X86_SIB) && mod != 3 && rm == 4 && offset + inst.length < max_length) {
                     inst.sib = code[offset + inst.length];
                     inst.length++;
                 }
                 
                 // Controlla se c'è un displacement
-                if (def.has_displacement) {
+                if (flags & RULE_X86_DISPLACEMENT) {
                     if ((mod == 1) && offset + inst.length < max_length) {
                         inst.displacement = static_cast<int8_t>(code[offset + inst.length]);
                         inst.length++;
@@ -92,7 +149,7 @@ private:
             }
             
             // Controlla se c'è un immediato
-            if (def.has_immediate && offset + inst.length + 3 < max_length) {
+            if ((flags & RULE_X86_IMMEDIATE) && offset + inst.length + 3 < max_length) {
                 inst.immediate = *reinterpret_cast<const int32_t*>(&code[offset + inst.length]);
                 inst.length += 4;
             }
@@ -125,6 +182,22 @@ private:
     std::vector<arm_inst> translate_x86_instruction(const X86DecodedInst& x86_inst) {
         std::vector<arm_inst> arm_code;
         
+#ifdef ROTHECA_STATIC_RULES
+        arm_inst emitted[static_rules::MAX_RULE_LENGTH];
+        size_t emitted_count = static_rules::emit_translation(x86_inst.opcode, emitted);
+        if (emitted_count > 0) {
+            arm_code.assign(emitted, emitted + emitted_count);
+            return arm_code;
+        }
+#else
+        // Con il blob la regola è indicizzata direttamente per opcode
+        const uint32_t* blob_opcodes = nullptr;
+        uint32_t blob_count = 0;
+        if (rule_blob.is_open() && rule_blob.translation(x86_inst.opcode, blob_opcodes, blob_count)) {
+            arm_code.assign(blob_opcodes, blob_opcodes + blob_count);
+            return arm_code;
+        }
+        
         // Trova nella tabella delle regole di traduzione
         for (const auto& rule : translation_rules) {
             if (rule.x86_opcode == x86_inst.opcode) {
@@ -135,6 +208,7 @@ private:
                 return arm_code;
             }
         }
+#endif
         
         // Se non troviamo una regola, inseriamo un NOP
         arm_code.push_back(0xD503201F); // NOP
@@ -145,25 +219,18 @@ private:
     
     // Funzioni per la cache migliorata
     
-    // Genera un ID unico per un binario
-    std::string generate_binary_id(const byte* binary, size_t size) {
-        // Usa xxHash per generare un hash
-        uint64_t hash = XXH64(binary, size, 0);
-        std::stringstream ss;
-        ss << std::hex << hash;
-        
-        // Aggiungi timestamp per evitare collisioni
-        ss << "_" << std::chrono::system_clock::now().time_since_epoch().count();
-        
-        return ss.str();
-    }
-    
     // Calcola l'hash di un blocco di codice
     uint64_t hash_block(const byte* code, size_t size) {
         return XXH64(code, size, 0);
     }
     
 public:
+    // Impronta dei file di regole: le traduzioni in cache valgono solo per queste regole
+    static uint64_t rule_set_fingerprint() {
+        return TranslationCache::fingerprint_rule_files(
+            {"x86_defs.txt", "arm_defs.txt", "translation_rules.txt", "optimization_patterns.txt"});
+    }
+    
     MiniRosettaTranslator(size_t memory_size = 1024 * 1024, const std::string& cache_dir = "./cache")
         : x86_memory(memory_size), arm_memory(memory_size) {
         
@@ -171,22 +238,64 @@ public:
         memset(&cpu_state, 0, sizeof(CPUState));
         
         // Inizializza i componenti del sistema di cache
-        translation_cache = std::make_unique<TranslationCache>(cache_dir);
-        persistence_manager = std::make_unique<PersistenceManager>(cache_dir);
+        TranslationCacheConfig cache_config = TranslationCacheConfig::load("config.json");
+        translation_cache = std::make_unique<TranslationCache>(cache_dir, cache_config);
+        
+        // Con un daemon di traduzione attivo log, manutenzione e compattazione
+        // sono sue: il processo non crea il proprio PersistenceManager
+        if (!cache_config.daemon_socket.empty()) {
+            auto daemon = std::make_shared<TranslationDaemonClient>();
+            if (daemon->connect(cache_config.daemon_socket)) {
+                translation_cache->use_daemon(daemon);
+            } else {
+                std::cerr << "Daemon di traduzione non raggiungibile: " << cache_config.daemon_socket << std::endl;
+            }
+        }
+        if (!translation_cache->has_daemon()) {
+            persistence_manager = std::make_unique<PersistenceManager>(cache_dir);
+        }
         signature_manager = std::make_unique<SignatureManager>();
         
-        // Carica le definizioni
-        load_definitions("x86_defs.txt", "x86");
-        load_definitions("arm_defs.txt", "arm");
-        load_definitions("translation_rules.txt", "translation");
+        // Carica le definizioni: il blob precompilato, se aggiornato, evita il parsing dei file di testo
+        uint64_t rules_fingerprint;
+#ifdef ROTHECA_STATIC_RULES
+        // Regole compilate nel binario: nessun file da leggere
+        rules_fingerprint = static_rules::RULES_FINGERPRINT;
+#else
+        if (rule_blob.open(RULE_BLOB_FILE)) {
+            rules_fingerprint = rule_blob.rules_fingerprint();
+        } else {
+            load_definitions("x86_defs.txt", "x86");
+            load_definitions("arm_defs.txt", "arm");
+            load_definitions("translation_rules.txt", "translation");
+            
+            // Le traduzioni in cache valgono solo per queste regole
+            rules_fingerprint = rule_set_fingerprint();
+        }
+#endif
+        translation_cache->set_rules_fingerprint(rules_fingerprint);
+        
+        // Le nuove traduzioni raggiungono il log L2 tramite il worker di persistenza
+        if (persistence_manager) {
+            translation_cache->set_l2_record_sink(persistence_manager->record_sink());
+            persistence_manager->set_stats_flusher([cache = translation_cache.get()] { return cache->flush_l2_stats(); });
+        }
         
         // Carica le firme dei blocchi comuni
         signature_manager->load_signatures(cache_dir + "/signatures.db");
     }
     
     ~MiniRosettaTranslator() {
+        stop_warm_start();
+        
         // Assicura che tutte le scritture nella cache siano completate
-        persistence_manager->flush();
+        translation_cache->set_l2_record_sink(nullptr);
+        if (persistence_manager) {
+            persistence_manager->flush();
+            persistence_manager->set_stats_flusher(nullptr);
+        }
+        // Contatori L2 in attesa; con il daemon sono inviati a lui insieme ai record
+        translation_cache->flush_pending_writes();
         
         // Salva le statistiche e lo stato del sistema
         save_stats("stats.json");
@@ -205,12 +314,15 @@ public:
         // Imposta il punto di ingresso
         cpu_state.rip = entry_point;
         
-        // Genera un ID per questo binario e inizializza la cache
-        current_binary_id = generate_binary_id(binary, size);
+        // Inizializza la cache per questo binario: l'ID deriva dal contenuto,
+        // quindi le esecuzioni successive ritrovano la cache L2
+        current_binary_id = translation_cache->initialize_for_binary(binary, size, entry_point);
         std::cout << "ID binario: " << current_binary_id << std::endl;
         
-        // Inizializza la cache per questo binario
-        translation_cache->initialize_for_binary(binary, size);
+        // Traccia le scritture nel codice guest; le traduzioni della memoria
+        // sovrascritta da questo caricamento non sono più valide
+        translation_cache->register_code_region(entry_point, x86_memory.size());
+        translation_cache->notify_code_write(entry_point, size);
         
         // Analisi statica del binario per generare firme
         X86StaticAnalyzer analyzer(std::vector<uint8_t>(binary, binary + size), entry_point);
@@ -222,6 +334,123 @@ public:
         }
         
         std::cout << "Analisi statica completata. Trovate " << signatures.size() << " firme." << std::endl;
+        
+        start_warm_start(entry_point);
+    }
+    
+    // Indirizzo di una copia già collocata dello stesso codice (0 = nessuna);
+    // altrimenti registra address come copia del contenuto (arm_memory_mutex acquisito)
+    uint64_t share_placed_code_locked(const byte* code, size_t size, uint64_t address) {
+        if (size == 0) {
+            return 0;
+        }
+        uint64_t h = XXH64(code, size, 0);
+        auto range = placed_code.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it) {
+            const byte* placed = reinterpret_cast<const byte*>(it->second);
+            if (memcmp(placed, code, size) == 0) {
+                return it->second;
+            }
+        }
+        placed_code.emplace(h, address);
+        return 0;
+    }
+    
+    // Copia codice ARM nella memoria ARM; restituisce il suo indirizzo (0 = memoria esaurita).
+    // Il codice già presente non viene copiato di nuovo.
+    uint64_t place_arm_code(const std::vector<byte>& code) {
+        std::lock_guard<std::mutex> lock(arm_memory_mutex);
+        if (next_arm_offset + code.size() >= arm_memory.size()) {
+            return 0;
+        }
+        uint64_t address = reinterpret_cast<uint64_t>(&arm_memory[next_arm_offset]);
+        if (uint64_t shared = share_placed_code_locked(code.data(), code.size(), address)) {
+            return shared;
+        }
+        std::copy(code.begin(), code.end(), arm_memory.begin() + next_arm_offset);
+        next_arm_offset += code.size();
+        return address;
+    }
+    
+    // Avvia in background il precaricamento in L1 dei blocchi più eseguiti nelle
+    // esecuzioni precedenti: i primi blocchi richiesti trovano già il codice pronto
+    void start_warm_start(uint64_t load_base) {
+        stop_warm_start();
+        std::string binary_id = current_binary_id;
+        warm_start_thread = std::thread([this, binary_id, load_base] {
+            auto start = std::chrono::steady_clock::now();
+            size_t loaded = translation_cache->preload_hot_entries(
+                binary_id, x86_memory.data(), x86_memory.size(), WARM_START_ENTRIES,
+                [this](const std::vector<byte>& code) { return place_arm_code(code); }, &warm_start_cancel);
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            if (loaded > 0) {
+                std::cout << "Warm start: " << loaded << " blocchi precaricati in " << elapsed.count()
+                          << " ms (base 0x" << std::hex << load_base << std::dec << ")" << std::endl;
+            }
+        });
+    }
+    
+    void stop_warm_start() {
+        if (warm_start_thread.joinable()) {
+            warm_start_cancel = true;
+            warm_start_thread.join();
+        }
+        warm_start_cancel = false;
+    }
+    
+    // Modalità zygote: carica e scalda il traduttore per un binario prima di
+    // generare i processi che lo eseguono. Il warm start viene completato e i
+    // blocchi incontrati scorrendo il codice dall'entry point sono tradotti in anticipo.
+    void prepare_zygote(const byte* binary, size_t size, uint64_t entry_point) {
+        load_binary(binary, size, entry_point);
+        if (warm_start_thread.joinable()) {
+            warm_start_thread.join();
+        }
+        
+        size_t translated = 0;
+        for (size_t offset = 0; offset < size; ) {
+            std::unique_ptr<TranslationEntry> entry(find_or_translate_block(entry_point + offset, entry_point));
+            size_t length = analyze_x86_block(&x86_memory[offset], size - offset);
+            if (!entry || length == 0) {
+                break;
+            }
+            offset += length;
+            translated++;
+        }
+        checkpoint_cache();
+        std::cout << "Zygote pronto: " << translated << " blocchi tradotti" << std::endl;
+    }
+    
+    // Genera un processo dal traduttore già caldo: memoria ARM, cache L1 e
+    // mappature sono ereditate copy-on-write. Nessun thread attraversa il fork:
+    // il worker di persistenza viene fermato e riavviato nei due processi.
+    // Restituisce il pid del figlio nel padre, 0 nel figlio, -1 in caso di errore.
+    pid_t fork_worker() {
+        stop_warm_start();
+        translation_cache->prepare_fork();
+        if (persistence_manager) {
+            persistence_manager->stop_worker();
+        }
+        
+        pid_t pid = fork();
+        if (pid == 0) {
+            translation_cache->after_fork_child();
+        }
+        if (persistence_manager) {
+            persistence_manager->start_worker();
+        }
+        return pid;
+    }
+    
+    // Conclude un processo generato da fork_worker, che termina con _exit senza
+    // distruggere il traduttore: scrive le traduzioni e i contatori L2 in attesa
+    // ma non stats.json, che i figli concorrenti sovrascriverebbero a vicenda
+    void finish_worker() {
+        stop_warm_start();
+        if (persistence_manager) {
+            persistence_manager->flush();
+        }
+        translation_cache->flush_pending_writes();
     }
     
     // Esegue il programma x86
@@ -272,7 +501,9 @@ public:
         identify_and_optimize_hot_blocks();
         
         // Salva lo stato finale della cache
-        persistence_manager->flush();
+        if (persistence_manager) {
+            persistence_manager->flush();
+        }
     }
     
     // Trova o traduce un blocco di codice
@@ -287,39 +518,35 @@ public:
         // Ottieni il puntatore al codice x86
         const byte* x86_block = &x86_memory[offset];
         
-        // Analizza il blocco per trovare la dimensione
-        size_t block_size = analyze_x86_block(x86_block, 1024);  // Max 1K di codice
-        
-        // Cerca nella cache
+        // Cerca nella cache: la dimensione del blocco è nota all'entrata, quindi
+        // l'analisi del blocco serve solo in caso di traduzione
         std::vector<byte> cached_arm_code;
         auto cache_result = translation_cache->lookup(current_binary_id, x86_addr, 
-                                                  x86_block, block_size, cached_arm_code);
+                                                  x86_block, x86_memory.size() - offset, cached_arm_code);
         
         if (cache_result.found) {
             // Blocco trovato in cache
-            if (cache_result.level == CacheLevel::L2_PERSISTENT) {
-                // Se trovato nella cache persistente, carica in memoria
-                if (next_arm_offset + cached_arm_code.size() >= arm_memory.size()) {
+            if (cache_result.level != CacheLevel::L1_MEMORY && !cache_result.mapped) {
+                // Se trovato nella cache persistente o condivisa ma non eseguibile in place, carica in memoria
+                uint64_t arm_addr = place_arm_code(cached_arm_code);
+                if (arm_addr == 0) {
                     std::cerr << "Memoria ARM esaurita" << std::endl;
                     return nullptr;
                 }
                 
-                // Copia il codice ARM dalla cache
-                std::copy(cached_arm_code.begin(), cached_arm_code.end(), 
-                        arm_memory.begin() + next_arm_offset);
-                
                 // Crea una nuova entrata
                 TranslationEntry* entry = new TranslationEntry();
                 entry->x86_addr = x86_addr;
-                entry->arm_addr = reinterpret_cast<uint64_t>(&arm_memory[next_arm_offset]);
+                entry->arm_addr = arm_addr;
                 entry->length = cached_arm_code.size();
                 
-                // Aggiorna l'offset
-                next_arm_offset += cached_arm_code.size();
+                // Le ricerche successive trovano il codice già collocato
+                cache_result.entry.arm_addr = entry->arm_addr;
+                translation_cache->promote_to_l1(cache_result.entry);
                 
                 return entry;
             } else {
-                // Se trovato nella cache in memoria
+                // Trovato in memoria o eseguibile dalla mappatura L2 o dalla regione condivisa (nessuna copia)
                 TranslationEntry* entry = new TranslationEntry();
                 entry->x86_addr = cache_result.entry.x86_addr;
                 entry->arm_addr = cache_result.entry.arm_addr;
@@ -331,6 +558,9 @@ public:
         
         // Non trovato in cache, traduci il blocco
         
+        // Analizza il blocco per trovare la dimensione
+        size_t block_size = analyze_x86_block(x86_block, 1024);  // Max 1K di codice
+        
         // Cerca firme di blocchi noti
         std::vector<uint8_t> block_vec(x86_block, x86_block + block_size);
         auto signature_match = signature_manager->find_match(block_vec);
@@ -349,8 +579,19 @@ public:
             }
         }
         
-        // Ottieni il prossimo blocco di memoria disponibile
-        arm_inst* arm_block = reinterpret_cast<arm_inst*>(&arm_memory[next_arm_offset]);
+        // Riserva un blocco di memoria ARM sotto il lock (il warm start può collocare
+        // codice in parallelo); traduzione e memorizzazione in cache avvengono fuori
+        size_t reserved_offset;
+        {
+            std::lock_guard<std::mutex> arm_lock(arm_memory_mutex);
+            if (next_arm_offset + TRANSLATION_BLOCK_SIZE > arm_memory.size()) {
+                std::cerr << "Memoria ARM esaurita" << std::endl;
+                return nullptr;
+            }
+            reserved_offset = next_arm_offset;
+            next_arm_offset += TRANSLATION_BLOCK_SIZE;
+        }
+        arm_inst* arm_block = reinterpret_cast<arm_inst*>(&arm_memory[reserved_offset]);
         
         // Traduci il blocco
         size_t arm_inst_count = translate_x86_block(x86_block, block_size, 
@@ -362,28 +603,31 @@ public:
         entry->arm_addr = reinterpret_cast<uint64_t>(arm_block);
         entry->length = arm_inst_count * 4;
         
+        {
+            std::lock_guard<std::mutex> arm_lock(arm_memory_mutex);
+            // Una traduzione identica a codice già collocato lo riusa
+            uint64_t shared = share_placed_code_locked(reinterpret_cast<const byte*>(arm_block), entry->length,
+                                                       entry->arm_addr);
+            if (shared != 0) {
+                entry->arm_addr = shared;
+            }
+            // La parte non usata della riserva torna libera se nessuno ha collocato codice dopo
+            if (next_arm_offset == reserved_offset + TRANSLATION_BLOCK_SIZE) {
+                next_arm_offset = reserved_offset + (shared != 0 ? 0 : entry->length);
+            }
+        }
+        
         // Memorizza nella cache
         translation_cache->store(current_binary_id, x86_addr, x86_block, block_size,
-                              entry->arm_addr, reinterpret_cast<const byte*>(arm_block), entry->length);
-        
-        // Aggiorna l'offset
-        next_arm_offset += arm_inst_count * 4;
-        if (next_arm_offset >= arm_memory.size()) {
-            std::cerr << "Memoria ARM esaurita" << std::endl;
-        }
+                              entry->arm_addr, reinterpret_cast<const byte*>(entry->arm_addr), entry->length);
         
         return entry;
     }
     
     // Esegue un checkpoint della cache
     void checkpoint_cache() {
-        // Programma un salvataggio asincrono della cache
-        persistence_manager->queue_write(
-            "cache/" + current_binary_id + ".cache",
-            std::vector<byte>(reinterpret_cast<byte*>(&arm_memory[0]),
-                           reinterpret_cast<byte*>(&arm_memory[next_arm_offset])),
-            0  // Offset 0
-        );
+        // Scrive solo i blocchi tradotti dall'ultimo checkpoint (log L2 append-only)
+        translation_cache->checkpoint(current_binary_id);
     }
     
     // Identifica e ottimizza i blocchi caldi
@@ -473,7 +717,24 @@ public:
         file << "      \"misses\": " << misses << ",\n";
         file << "      \"cache_entries\": " << entries << ",\n";
         file << "      \"hit_rate\": " << (static_cast<double>(l1_hits + l2_hits) / 
-                                        (l1_hits + l2_hits + misses)) << "\n";
+                                        (l1_hits + l2_hits + misses)) << ",\n";
+        
+        // Contatori della politica L1 (per confrontare LRU e W-TinyLFU sulle stesse tracce)
+        L1PolicyStats policy_stats = translation_cache->get_policy_stats();
+        file << "      \"l1_policy\": \"" 
+             << (policy_stats.policy == L1EvictionPolicy::W_TINYLFU ? "w-tinylfu" : "lru") << "\",\n";
+        file << "      \"l1_lookups\": " << policy_stats.lookups << ",\n";
+        file << "      \"l1_hit_rate\": " << (policy_stats.lookups > 0 ?
+                                           static_cast<double>(policy_stats.hits) / policy_stats.lookups : 0.0) << ",\n";
+        file << "      \"l1_admissions\": " << policy_stats.admissions << ",\n";
+        file << "      \"l1_rejections\": " << policy_stats.rejections << ",\n";
+        file << "      \"l1_evictions\": " << policy_stats.evictions << ",\n";
+        
+        size_t code_bytes, metadata_bytes, budget_bytes;
+        translation_cache->get_memory_stats(code_bytes, metadata_bytes, budget_bytes);
+        file << "      \"l1_code_bytes\": " << code_bytes << ",\n";
+        file << "      \"l1_metadata_bytes\": " << metadata_bytes << ",\n";
+        file << "      \"l1_budget_bytes\": " << budget_bytes << "\n";
         file << "    },\n";
         
         // Statistiche sulle firme
@@ -551,14 +812,20 @@ public:
                 break;
             }
             
-            std::string mnemonic = "UNKNOWN";
-            auto it = x86_defs.find(inst.opcode);
-            if (it != x86_defs.end()) {
-                mnemonic = it->second.mnemonic;
-            }
-            
             std::cout << "Traduzione istruzione x86: 0x" << std::hex << static_cast<int>(inst.opcode)
-                      << " (" << mnemonic << ")" << std::dec << std::endl;
+                      << " (" << x86_mnemonic(inst.opcode) << ")" << std::dec << std::endl;
+            
+#ifdef ROTHECA_STATIC_RULES
+            // Con spazio sufficiente la regola scrive direttamente nel buffer di destinazione
+            if (max_arm_inst - arm_offset >= static_rules::MAX_RULE_LENGTH) {
+                size_t emitted = static_rules::emit_translation(inst.opcode, arm_code + arm_offset);
+                if (emitted > 0) {
+                    arm_offset += emitted;
+                    x86_offset += inst.length;
+                    continue;
+                }
+            }
+#endif
             
             auto arm_instructions = translate_x86_instruction(inst);
             
@@ -648,10 +915,149 @@ public:
     }
 };
 
-// Esempio di utilizzo
-int main() {
-    std::cout << "Mini-Rosetta: Sistema di Cache Integrato" << std::endl << std::endl;
+// Daemon di traduzione: serve la directory di cache sul socket indicato fino a SIGINT o SIGTERM
+int run_translation_daemon(const std::string& socket_path, const std::string& cache_dir) {
+    // I segnali sono attesi con sigwait: bloccati prima di creare i thread del daemon
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
     
+    TranslationCacheConfig config = TranslationCacheConfig::load("config.json");
+    TranslationDaemon daemon(cache_dir, socket_path, config.shared_code_bytes);
+    if (!daemon.start()) {
+        return 1;
+    }
+    
+    int received = 0;
+    sigwait(&signals, &received);
+    std::cout << "Arresto del daemon di traduzione" << std::endl;
+    daemon.stop();
+    return 0;
+}
+
+// Zygote: prepara il traduttore per il programma e, per ogni connessione al
+// socket, genera un processo che lo esegue con l'output inviato alla connessione.
+// Termina con SIGINT o SIGTERM. Restituisce il codice di uscita dello zygote;
+// i processi generati terminano con _exit.
+int run_zygote(const std::string& socket_path, const byte* program, size_t size, uint64_t entry_point) {
+    // I segnali di arresto sono attesi con sigwait: bloccati prima che il
+    // traduttore crei i suoi thread, così nessun altro thread li riceve
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Percorso del socket troppo lungo: " << socket_path << std::endl;
+        return 1;
+    }
+    memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    
+    MiniRosettaTranslator translator(1024 * 1024, "./cache");
+    translator.prepare_zygote(program, size, entry_point);
+    
+    int listen_fd = DaemonChannel::open_socket();
+    ::unlink(socket_path.c_str());
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+        chmod(socket_path.c_str(), 0600) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "Impossibile avviare lo zygote sul socket: " << socket_path << std::endl;
+        if (listen_fd >= 0) {
+            ::close(listen_fd);
+        }
+        return 1;
+    }
+    
+    // I figli terminati sono raccolti dal kernel. Il thread dei segnali non
+    // attraversa i fork (non possiede lock) e sblocca accept collegandosi al socket.
+    signal(SIGCHLD, SIG_IGN);
+    std::atomic<bool> stop_requested{false};
+    std::thread signal_thread([&signals, &stop_requested, &address] {
+        int received = 0;
+        sigwait(&signals, &received);
+        stop_requested = true;
+        int wake_fd = DaemonChannel::open_socket();
+        if (wake_fd >= 0) {
+            ::connect(wake_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+            ::close(wake_fd);
+        }
+    });
+    std::cout << "Zygote in ascolto su " << socket_path << std::endl;
+    
+    while (!stop_requested) {
+        int client_fd = DaemonChannel::accept_connection(listen_fd);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // Risorse esaurite (descrittori, memoria): si riprova dopo una pausa
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                std::cerr << "Connessione allo zygote rifiutata: risorse esaurite" << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            std::cerr << "Errore del socket dello zygote" << std::endl;
+            break;
+        }
+        if (stop_requested) {
+            ::close(client_fd);
+            break;
+        }
+        
+        pid_t pid = translator.fork_worker();
+        if (pid == 0) {
+            ::close(listen_fd);
+            signal(SIGCHLD, SIG_DFL);
+            pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+            std::cout.flush();
+            dup2(client_fd, STDOUT_FILENO);
+            dup2(client_fd, STDERR_FILENO);
+            ::close(client_fd);
+            
+            translator.run_x86_program(program, size, entry_point);
+            translator.finish_worker();
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(0);
+        }
+        if (pid < 0) {
+            std::cerr << "Impossibile generare il processo per la richiesta" << std::endl;
+        }
+        ::close(client_fd);
+    }
+    
+    // Con un errore del socket il thread dei segnali è ancora in attesa
+    if (!stop_requested) {
+        pthread_kill(signal_thread.native_handle(), SIGTERM);
+    }
+    signal_thread.join();
+    ::close(listen_fd);
+    ::unlink(socket_path.c_str());
+    std::cout << "Arresto dello zygote" << std::endl;
+    return 0;
+}
+
+// Compila i file di regole nel blob caricato dai traduttori all'avvio
+int compile_rule_set(const std::string& output) {
+    return RuleSetCompiler::compile(RuleSourceFiles(), MiniRosettaTranslator::rule_set_fingerprint(), output) ? 0 : 1;
+}
+
+// Genera le tabelle constexpr usate compilando con ROTHECA_STATIC_RULES
+int generate_rule_tables(const std::string& output) {
+    return RuleSetCompiler::generate_static_tables(RuleSourceFiles(), MiniRosettaTranslator::rule_set_fingerprint(),
+                                                   output) ? 0 : 1;
+}
+
+// Esempio di utilizzo; con --daemon <socket> avvia il daemon di traduzione,
+// con --zygote <socket> esegue l'esempio in processi generati da uno zygote,
+// con --compile-rules [file] precompila le regole (predefinito rules.bin),
+// con --generate-rule-tables [file] genera le regole statiche (rules-static.h)
+int main(int argc, char** argv) {
     // Programma x86 di esempio
     const byte example_program[] = {
         0x90,           // NOP
@@ -662,6 +1068,21 @@ int main() {
         0xC3            // RET
     };
     
+    if (argc >= 3 && std::string(argv[1]) == "--daemon") {
+        return run_translation_daemon(argv[2], "./cache");
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--zygote") {
+        return run_zygote(argv[2], example_program, sizeof(example_program), 0x1000);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--compile-rules") {
+        return compile_rule_set(argc >= 3 ? argv[2] : RULE_BLOB_FILE);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--generate-rule-tables") {
+        return generate_rule_tables(argc >= 3 ? argv[2] : RULE_STATIC_TABLES_FILE);
+    }
+    
+    std::cout << "Mini-Rosetta: Sistema di Cache Integrato" << std::endl << std::endl;
+    
     // Crea il traduttore con cache avanzato
     MiniRosettaTranslator translator(1024 * 1024, "./cache");
     
@@ -0,0 +1,813 @@
+/**
+ * rules-blob.h - Set di regole precompilato di Mini-Rosetta
+ *
+ * All'avvio il traduttore leggeva x86_defs.txt, arm_defs.txt e
+ * translation_rules.txt riga per riga (istringstream + stoi), costruendo
+ * mappe e vettori a ogni esecuzione. RuleSetCompiler trasforma offline i file
+ * di testo (più register_mapping.txt e optimization_patterns.txt) in un blob
+ * binario versionato; RuleSetBlob lo mappa in sola lettura e lo usa così
+ * com'è, senza parsing: le tabelle sono indicizzate direttamente per opcode.
+ *
+ * Layout: [RuleBlobHeader][sezioni allineate a 8 byte]
+ *   X86_DEFS      RuleBlobX86Def * 256, indicizzate per opcode
+ *   ARM_DEFS      RuleBlobArmDef, ordinate per opcode
+ *   TRANSLATIONS  RuleBlobTranslation * 256, indicizzate per opcode x86
+ *   ARM_OPCODES   uint32_t: sequenze ARM di regole e pattern
+ *   REGISTERS     RuleBlobRegister
+ *   PATTERNS      RuleBlobPattern
+ *   PATTERN_BYTES byte x86 dei pattern, seguiti dalla loro maschera (0 = XX)
+ *   STRINGS       stringhe terminate da zero; l'offset 0 è la stringa vuota
+ *
+ * Il blob contiene solo offset relativi all'inizio del file, quindi è
+ * rilocabile e può essere mappato a qualunque indirizzo o condiviso tra
+ * processi. La semantica è quella del caricatore testuale: per x86 e ARM vale
+ * l'ultima definizione di un opcode, per le regole la prima (l'opcode x86 è
+ * troncato a 8 bit come in load_definitions). L'header registra un hash del
+ * contenuto dei file sorgente: se un file presente cambia il blob è scartato
+ * e il traduttore torna ai file di testo; senza i file il blob è usato così
+ * com'è.
+ *
+ * Per le installazioni con regole fisse RuleSetCompiler genera anche un header
+ * C++ (rules-static.h) con le stesse regole come tabelle constexpr e funzioni
+ * di emissione specializzate per opcode: compilando con ROTHECA_STATIC_RULES i
+ * traduttori le usano al posto di blob e file di testo.
+ */
+
+#ifndef RULES_BLOB_H
+#define RULES_BLOB_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <xxhash.h>
+
+using byte = uint8_t;
+
+constexpr uint8_t RULE_X86_MODRM = 1u << 0;
+constexpr uint8_t RULE_X86_SIB = 1u << 1;
+constexpr uint8_t RULE_X86_DISPLACEMENT = 1u << 2;
+constexpr uint8_t RULE_X86_IMMEDIATE = 1u << 3;
+
+enum RuleBlobSectionId : uint32_t {
+    RULE_SECTION_X86_DEFS = 0,
+    RULE_SECTION_ARM_DEFS,
+    RULE_SECTION_TRANSLATIONS,
+    RULE_SECTION_ARM_OPCODES,
+    RULE_SECTION_REGISTERS,
+    RULE_SECTION_PATTERNS,
+    RULE_SECTION_PATTERN_BYTES,
+    RULE_SECTION_STRINGS,
+    RULE_SECTION_COUNT
+};
+
+struct RuleBlobSection {
+    uint32_t offset;          // Dall'inizio del blob
+    uint32_t count;           // Elementi (byte per PATTERN_BYTES e STRINGS)
+};
+
+// File sorgente da cui è stato compilato il blob
+struct RuleBlobSource {
+    uint64_t content_hash;    // XXH64 del contenuto
+    uint32_t name;            // Offset nella sezione STRINGS
+    uint32_t present;         // 0 = file assente alla compilazione
+};
+
+constexpr size_t RULE_BLOB_SOURCES = 5;
+
+struct RuleBlobHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t total_size;
+    uint64_t checksum;        // XXH64 di tutto ciò che segue l'header
+    uint64_t rules_fingerprint; // Impronta delle regole per la cache di traduzione
+    RuleBlobSection sections[RULE_SECTION_COUNT];
+    RuleBlobSource sources[RULE_BLOB_SOURCES];
+};
+
+struct RuleBlobX86Def {
+    uint8_t present;
+    uint8_t size;
+    uint8_t flags;            // RULE_X86_*
+    uint8_t reserved;
+    uint32_t mnemonic;
+};
+
+struct RuleBlobArmDef {
+    uint32_t opcode;
+    uint32_t opcode_mask;
+    uint32_t opcode_value;
+    uint32_t mnemonic;
+};
+
+struct RuleBlobTranslation {
+    uint32_t first_opcode;    // Indice in ARM_OPCODES
+    uint32_t opcode_count;    // 0 = nessuna regola
+    uint32_t description;
+    uint32_t reserved;
+};
+
+struct RuleBlobRegister {
+    uint32_t x86_name;
+    uint32_t arm_name;
+    uint32_t description;
+    uint32_t reserved;
+};
+
+struct RuleBlobPattern {
+    uint32_t id;
+    uint32_t x86_bytes;       // Offset in PATTERN_BYTES; la maschera segue i byte
+    uint32_t x86_length;
+    uint32_t first_opcode;    // Indice in ARM_OPCODES
+    uint32_t opcode_count;
+    uint32_t description;
+};
+
+// Percorsi dei file di testo delle regole
+struct RuleSourceFiles {
+    std::string x86_defs = "x86_defs.txt";
+    std::string arm_defs = "arm_defs.txt";
+    std::string translation_rules = "translation_rules.txt";
+    std::string register_mapping = "register_mapping.txt";
+    std::string optimization_patterns = "optimization_patterns.txt";
+
+    std::vector<std::string> all() const {
+        return {x86_defs, arm_defs, translation_rules, register_mapping, optimization_patterns};
+    }
+};
+
+constexpr uint64_t RULE_BLOB_MAGIC = 0x454C5552534F5243; // "CROSRULE" in hex
+constexpr uint32_t RULE_BLOB_VERSION = 2;
+constexpr const char* RULE_BLOB_FILE = "rules.bin";
+constexpr const char* RULE_STATIC_TABLES_FILE = "rules-static.h";
+
+// Blob delle regole mappato in memoria
+class RuleSetBlob {
+private:
+    const byte* base = nullptr;
+    size_t mapped_size = 0;
+    const RuleBlobHeader* header = nullptr;
+    const RuleBlobX86Def* x86_defs = nullptr;
+    const RuleBlobArmDef* arm_defs = nullptr;
+    const RuleBlobTranslation* translations = nullptr;
+    const uint32_t* arm_opcodes = nullptr;
+    const RuleBlobRegister* registers = nullptr;
+    const RuleBlobPattern* patterns = nullptr;
+    const byte* pattern_bytes = nullptr;
+    const char* strings = nullptr;
+
+    // Verifica che ogni sezione stia nel blob
+    bool sections_valid() const {
+        static constexpr size_t element_size[RULE_SECTION_COUNT] = {
+            sizeof(RuleBlobX86Def), sizeof(RuleBlobArmDef), sizeof(RuleBlobTranslation), sizeof(uint32_t),
+            sizeof(RuleBlobRegister), sizeof(RuleBlobPattern), 1, 1};
+        for (size_t i = 0; i < RULE_SECTION_COUNT; i++) {
+            const RuleBlobSection& section = header->sections[i];
+            if (section.offset < sizeof(RuleBlobHeader) || section.offset % 8 != 0 || section.offset > mapped_size ||
+                uint64_t(section.count) * element_size[i] > mapped_size - section.offset) {
+                return false;
+            }
+        }
+        const RuleBlobSection& strings_section = header->sections[RULE_SECTION_STRINGS];
+        return header->sections[RULE_SECTION_X86_DEFS].count == 256 &&
+               header->sections[RULE_SECTION_TRANSLATIONS].count == 256 &&
+               strings_section.count > 0 && base[strings_section.offset + strings_section.count - 1] == 0;
+    }
+
+    // Vero se i file sorgente presenti hanno ancora il contenuto registrato.
+    // Il confronto è sul contenuto e non sulla data, che copie, checkout e
+    // pacchetti non conservano; un file assente non invalida il blob
+    // (installazioni che distribuiscono solo rules.bin).
+    bool sources_current() const {
+        for (size_t i = 0; i < RULE_BLOB_SOURCES; i++) {
+            const RuleBlobSource& source = header->sources[i];
+            uint64_t hash;
+            if (!content_hash(string_at(source.name), hash)) {
+                continue;
+            }
+            if (!source.present || source.content_hash != hash) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    RuleSetBlob() = default;
+    RuleSetBlob(const RuleSetBlob&) = delete;
+    RuleSetBlob& operator=(const RuleSetBlob&) = delete;
+
+    ~RuleSetBlob() {
+        close();
+    }
+
+    // XXH64 del contenuto di un file; falso se non è leggibile
+    static bool content_hash(const std::string& path, uint64_t& hash) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string content = buffer.str();
+        hash = XXH64(content.data(), content.size(), 0);
+        return true;
+    }
+
+    // Mappa il blob; con check_sources è scartato se i file di testo sono cambiati
+    bool open(const std::string& path, bool check_sources = true) {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(RuleBlobHeader))) {
+            ::close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<const byte*>(mapping);
+        mapped_size = st.st_size;
+        header = reinterpret_cast<const RuleBlobHeader*>(base);
+
+        if (header->magic != RULE_BLOB_MAGIC || header->version != RULE_BLOB_VERSION ||
+            header->header_size != sizeof(RuleBlobHeader) || header->total_size != mapped_size ||
+            XXH64(base + sizeof(RuleBlobHeader), mapped_size - sizeof(RuleBlobHeader), 0) != header->checksum ||
+            !sections_valid()) {
+            std::cerr << "Blob delle regole non valido o versione non supportata: " << path << std::endl;
+            close();
+            return false;
+        }
+
+        auto section = [this](RuleBlobSectionId id) { return base + header->sections[id].offset; };
+        x86_defs = reinterpret_cast<const RuleBlobX86Def*>(section(RULE_SECTION_X86_DEFS));
+        arm_defs = reinterpret_cast<const RuleBlobArmDef*>(section(RULE_SECTION_ARM_DEFS));
+        translations = reinterpret_cast<const RuleBlobTranslation*>(section(RULE_SECTION_TRANSLATIONS));
+        arm_opcodes = reinterpret_cast<const uint32_t*>(section(RULE_SECTION_ARM_OPCODES));
+        registers = reinterpret_cast<const RuleBlobRegister*>(section(RULE_SECTION_REGISTERS));
+        patterns = reinterpret_cast<const RuleBlobPattern*>(section(RULE_SECTION_PATTERNS));
+        pattern_bytes = section(RULE_SECTION_PATTERN_BYTES);
+        strings = reinterpret_cast<const char*>(section(RULE_SECTION_STRINGS));
+
+        // Indici di sequenze e stringhe fuori dalle sezioni rendono il blob inutilizzabile
+        uint32_t opcode_count = header->sections[RULE_SECTION_ARM_OPCODES].count;
+        uint32_t string_bytes = header->sections[RULE_SECTION_STRINGS].count;
+        uint32_t byte_count = header->sections[RULE_SECTION_PATTERN_BYTES].count;
+        bool valid = true;
+        for (size_t i = 0; i < 256 && valid; i++) {
+            valid = x86_defs[i].mnemonic < string_bytes && translations[i].description < string_bytes &&
+                    translations[i].first_opcode <= opcode_count &&
+                    translations[i].opcode_count <= opcode_count - translations[i].first_opcode;
+        }
+        for (size_t i = 0; i < pattern_count() && valid; i++) {
+            const RuleBlobPattern& p = patterns[i];
+            valid = p.id < string_bytes && p.description < string_bytes && p.first_opcode <= opcode_count &&
+                    p.opcode_count <= opcode_count - p.first_opcode && p.x86_bytes <= byte_count &&
+                    uint64_t(p.x86_length) * 2 <= byte_count - p.x86_bytes;
+        }
+        for (size_t i = 0; i < arm_def_count() && valid; i++) {
+            valid = arm_defs[i].mnemonic < string_bytes;
+        }
+        for (size_t i = 0; i < register_count() && valid; i++) {
+            valid = registers[i].x86_name < string_bytes && registers[i].arm_name < string_bytes &&
+                    registers[i].description < string_bytes;
+        }
+        for (size_t i = 0; i < RULE_BLOB_SOURCES && valid; i++) {
+            valid = header->sources[i].name < string_bytes;
+        }
+        if (!valid) {
+            std::cerr << "Blob delle regole corrotto: " << path << std::endl;
+            close();
+            return false;
+        }
+
+        if (check_sources && !sources_current()) {
+            std::cerr << "Blob delle regole non aggiornato rispetto ai file di testo: " << path << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (base) {
+            munmap(const_cast<byte*>(base), mapped_size);
+        }
+        base = nullptr;
+        mapped_size = 0;
+        header = nullptr;
+    }
+
+    bool is_open() const { return base != nullptr; }
+    uint64_t rules_fingerprint() const { return header->rules_fingerprint; }
+
+    const char* string_at(uint32_t offset) const {
+        return strings + offset;
+    }
+
+    // Definizione x86 di un opcode (nullptr se assente)
+    const RuleBlobX86Def* x86_def(uint8_t opcode) const {
+        return x86_defs[opcode].present ? &x86_defs[opcode] : nullptr;
+    }
+
+    // Definizione ARM di un opcode (nullptr se assente)
+    const RuleBlobArmDef* arm_def(uint32_t opcode) const {
+        const RuleBlobArmDef* end = arm_defs + arm_def_count();
+        const RuleBlobArmDef* it = std::lower_bound(arm_defs, end, opcode,
+                                                    [](const RuleBlobArmDef& d, uint32_t op) { return d.opcode < op; });
+        return (it != end && it->opcode == opcode) ? it : nullptr;
+    }
+
+    size_t arm_def_count() const { return header->sections[RULE_SECTION_ARM_DEFS].count; }
+
+    // Sequenza ARM della regola di un opcode x86; false se non c'è una regola
+    bool translation(uint8_t opcode, const uint32_t*& opcodes, uint32_t& count) const {
+        const RuleBlobTranslation& rule = translations[opcode];
+        opcodes = arm_opcodes + rule.first_opcode;
+        count = rule.opcode_count;
+        return count > 0;
+    }
+
+    const char* translation_description(uint8_t opcode) const {
+        return string_at(translations[opcode].description);
+    }
+
+    size_t register_count() const { return header->sections[RULE_SECTION_REGISTERS].count; }
+    const RuleBlobRegister& register_at(size_t i) const { return registers[i]; }
+
+    size_t pattern_count() const { return header->sections[RULE_SECTION_PATTERNS].count; }
+    const RuleBlobPattern& pattern_at(size_t i) const { return patterns[i]; }
+    const byte* pattern_x86_bytes(const RuleBlobPattern& p) const { return pattern_bytes + p.x86_bytes; }
+    const byte* pattern_x86_mask(const RuleBlobPattern& p) const { return pattern_bytes + p.x86_bytes + p.x86_length; }
+    const uint32_t* pattern_arm_opcodes(const RuleBlobPattern& p) const { return arm_opcodes + p.first_opcode; }
+};
+
+// Compilatore dei file di testo delle regole nel blob
+class RuleSetCompiler {
+private:
+    std::vector<RuleBlobX86Def> x86_defs = std::vector<RuleBlobX86Def>(256);
+    std::vector<RuleBlobArmDef> arm_defs;
+    std::vector<RuleBlobTranslation> translations = std::vector<RuleBlobTranslation>(256);
+    std::vector<uint32_t> arm_opcodes;
+    std::vector<RuleBlobRegister> registers;
+    std::vector<RuleBlobPattern> patterns;
+    std::vector<byte> pattern_bytes;
+    std::string strings = std::string(1, '\0');
+    std::unordered_map<std::string, uint32_t> string_offsets;
+
+    uint32_t add_string(const std::string& value) {
+        if (value.empty()) {
+            return 0;
+        }
+        auto it = string_offsets.find(value);
+        if (it != string_offsets.end()) {
+            return it->second;
+        }
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings.append(value);
+        strings.push_back('\0');
+        string_offsets.emplace(value, offset);
+        return offset;
+    }
+
+    static std::string trim(const std::string& text) {
+        size_t start = text.find_first_not_of(" \t\r");
+        size_t end = text.find_last_not_of(" \t\r");
+        return start == std::string::npos ? std::string() : text.substr(start, end - start + 1);
+    }
+
+    static bool is_hex(const std::string& token) {
+        return !token.empty() && token.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos;
+    }
+
+    // Righe significative di un file (senza commenti e righe vuote); false se il file manca
+    static bool read_lines(const std::string& path, std::vector<std::string>& lines) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty() && line[0] != '#') {
+                lines.push_back(line);
+            }
+        }
+        return true;
+    }
+
+    // Stessa sintassi di load_definitions: vale l'ultima definizione di un opcode
+    void parse_x86(const std::vector<std::string>& lines) {
+        for (const auto& line : lines) {
+            std::istringstream iss(line);
+            std::string opcode_str, mnemonic, modrm, sib, disp, imm;
+            int size = 0;
+            iss >> opcode_str >> mnemonic >> size >> modrm >> sib >> disp >> imm;
+
+            RuleBlobX86Def& def = x86_defs[static_cast<uint8_t>(std::stoi(opcode_str, nullptr, 16))];
+            def.present = 1;
+            def.size = static_cast<uint8_t>(size);
+            def.flags = (modrm == "1" ? RULE_X86_MODRM : 0) | (sib == "1" ? RULE_X86_SIB : 0) |
+                        (disp == "1" ? RULE_X86_DISPLACEMENT : 0) | (imm == "1" ? RULE_X86_IMMEDIATE : 0);
+            def.mnemonic = add_string(mnemonic);
+        }
+    }
+
+    void parse_arm(const std::vector<std::string>& lines) {
+        std::unordered_map<uint32_t, RuleBlobArmDef> defs;
+        for (const auto& line : lines) {
+            std::istringstream iss(line);
+            std::string opcode_str, mnemonic, mask_str, value_str;
+            iss >> opcode_str >> mnemonic >> mask_str >> value_str;
+
+            RuleBlobArmDef def;
+            def.opcode = static_cast<uint32_t>(std::stoul(opcode_str, nullptr, 16));
+            def.opcode_mask = static_cast<uint32_t>(std::stoul(mask_str, nullptr, 16));
+            def.opcode_value = static_cast<uint32_t>(std::stoul(value_str, nullptr, 16));
+            def.mnemonic = add_string(mnemonic);
+            defs[def.opcode] = def;
+        }
+        for (const auto& pair : defs) {
+            arm_defs.push_back(pair.second);
+        }
+        std::sort(arm_defs.begin(), arm_defs.end(),
+                  [](const RuleBlobArmDef& a, const RuleBlobArmDef& b) { return a.opcode < b.opcode; });
+    }
+
+    // translate_x86_instruction usa la prima regola di un opcode: le successive sono ignorate
+    void parse_translations(const std::vector<std::string>& lines) {
+        for (const auto& line : lines) {
+            std::istringstream iss(line);
+            std::string x86_opcode_str;
+            iss >> x86_opcode_str;
+            RuleBlobTranslation& rule = translations[static_cast<uint8_t>(std::stoi(x86_opcode_str, nullptr, 16))];
+
+            std::vector<uint32_t> opcodes;
+            std::string arm_opcode_str;
+            while (iss >> arm_opcode_str && arm_opcode_str != "#") {
+                opcodes.push_back(static_cast<uint32_t>(std::stoul(arm_opcode_str, nullptr, 16)));
+            }
+            std::string description;
+            std::getline(iss, description);
+            if (rule.opcode_count > 0 || opcodes.empty()) {
+                continue;
+            }
+
+            rule.first_opcode = static_cast<uint32_t>(arm_opcodes.size());
+            rule.opcode_count = static_cast<uint32_t>(opcodes.size());
+            rule.description = add_string(trim(description));
+            arm_opcodes.insert(arm_opcodes.end(), opcodes.begin(), opcodes.end());
+        }
+    }
+
+    // Formato: registro_x86 registro_arm descrizione
+    void parse_registers(const std::vector<std::string>& lines) {
+        for (const auto& line : lines) {
+            std::istringstream iss(line);
+            std::string x86_name, arm_name, description;
+            iss >> x86_name >> arm_name;
+            std::getline(iss, description);
+            if (arm_name.empty()) {
+                continue;
+            }
+
+            RuleBlobRegister reg;
+            reg.x86_name = add_string(x86_name);
+            reg.arm_name = add_string(arm_name);
+            reg.description = add_string(trim(description));
+            reg.reserved = 0;
+            registers.push_back(reg);
+        }
+    }
+
+    // Formato: id byte_x86... opcode_arm... # descrizione. I byte x86 sono token
+    // di 2 cifre esadecimali (XX = qualunque), gli opcode ARM di 8; una riga che
+    // inizia con un opcode ARM continua il pattern precedente.
+    void parse_patterns(const std::vector<std::string>& lines) {
+        struct PendingPattern {
+            std::string id, description;
+            std::vector<byte> bytes, mask;
+            std::vector<uint32_t> opcodes;
+        };
+        std::vector<PendingPattern> pending;
+
+        for (const auto& line : lines) {
+            std::string body = line;
+            std::string description;
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) {
+                body = line.substr(0, comment);
+                description = trim(line.substr(comment + 1));
+            }
+
+            std::istringstream iss(body);
+            std::string token;
+            if (!(iss >> token)) {
+                continue;
+            }
+            bool continuation = token.size() == 8 && is_hex(token) && !pending.empty();
+            if (!continuation) {
+                pending.push_back(PendingPattern());
+                pending.back().id = token;
+                if (!(iss >> token)) {
+                    pending.back().description = description;
+                    continue;
+                }
+            }
+
+            PendingPattern& pattern = pending.back();
+            do {
+                if (token.size() == 2 && (token == "XX" || is_hex(token))) {
+                    pattern.bytes.push_back(token == "XX" ? 0 : static_cast<byte>(std::stoul(token, nullptr, 16)));
+                    pattern.mask.push_back(token == "XX" ? 0x00 : 0xFF);
+                } else if (token.size() == 8 && is_hex(token)) {
+                    pattern.opcodes.push_back(static_cast<uint32_t>(std::stoul(token, nullptr, 16)));
+                }
+            } while (iss >> token);
+            if (pattern.description.empty()) {
+                pattern.description = description;
+            } else if (!description.empty()) {
+                pattern.description += " / " + description;
+            }
+        }
+
+        for (const auto& pattern : pending) {
+            RuleBlobPattern p;
+            p.id = add_string(pattern.id);
+            p.x86_bytes = static_cast<uint32_t>(pattern_bytes.size());
+            p.x86_length = static_cast<uint32_t>(pattern.bytes.size());
+            p.first_opcode = static_cast<uint32_t>(arm_opcodes.size());
+            p.opcode_count = static_cast<uint32_t>(pattern.opcodes.size());
+            p.description = add_string(pattern.description);
+            pattern_bytes.insert(pattern_bytes.end(), pattern.bytes.begin(), pattern.bytes.end());
+            pattern_bytes.insert(pattern_bytes.end(), pattern.mask.begin(), pattern.mask.end());
+            arm_opcodes.insert(arm_opcodes.end(), pattern.opcodes.begin(), pattern.opcodes.end());
+            patterns.push_back(p);
+        }
+    }
+
+    template <typename T>
+    static void append_section(std::vector<byte>& blob, RuleBlobSection& section, const T* data, size_t count) {
+        blob.resize((blob.size() + 7) & ~size_t(7), 0);
+        section.offset = static_cast<uint32_t>(blob.size());
+        section.count = static_cast<uint32_t>(count);
+        const byte* bytes = reinterpret_cast<const byte*>(data);
+        blob.insert(blob.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    // Legge e analizza i file di regole. x86_defs, arm_defs e translation_rules
+    // sono obbligatori; registri e pattern mancanti lasciano le sezioni vuote.
+    bool parse_sources(const RuleSourceFiles& sources, const std::string& output) {
+        std::vector<std::string> x86_lines, arm_lines, rule_lines, register_lines, pattern_lines;
+        if (!read_lines(sources.x86_defs, x86_lines) || !read_lines(sources.arm_defs, arm_lines) ||
+            !read_lines(sources.translation_rules, rule_lines)) {
+            std::cerr << "File delle regole mancanti: impossibile compilare " << output << std::endl;
+            return false;
+        }
+        read_lines(sources.register_mapping, register_lines);
+        read_lines(sources.optimization_patterns, pattern_lines);
+
+        try {
+            parse_x86(x86_lines);
+            parse_arm(arm_lines);
+            parse_translations(rule_lines);
+            parse_registers(register_lines);
+            parse_patterns(pattern_lines);
+        } catch (const std::exception& e) {
+            std::cerr << "Errore nella compilazione delle regole: " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Scrive in un file temporaneo e rinomina: chi legge output non vede mai un file parziale
+    static bool replace_file(const std::string& output, const char* data, size_t size) {
+        std::string temp_path = output + ".tmp." + std::to_string(getpid());
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            file.write(data, size);
+            file.flush();
+            if (!file) {
+                std::cerr << "Errore nella scrittura delle regole compilate: " << temp_path << std::endl;
+                file.close();
+                std::remove(temp_path.c_str());
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp_path, output, ec);
+        if (ec) {
+            std::cerr << "Errore nella sostituzione delle regole compilate: " << output << std::endl;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Letterale C++ di una stringa delle regole
+    std::string quoted(uint32_t offset) const {
+        std::string literal = "\"";
+        for (const char* c = strings.c_str() + offset; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                literal.push_back('\\');
+            }
+            literal.push_back(*c);
+        }
+        return literal + "\"";
+    }
+
+    static std::string hex(uint64_t value, int width) {
+        std::ostringstream out;
+        out << "0x" << std::uppercase << std::hex << std::setw(width) << std::setfill('0') << value;
+        return out.str();
+    }
+
+public:
+    // Compila i file di regole nel blob output; rules_fingerprint è registrata
+    // nell'header per la cache di traduzione
+    static bool compile(const RuleSourceFiles& sources, uint64_t rules_fingerprint, const std::string& output) {
+        RuleSetCompiler compiler;
+        if (!compiler.parse_sources(sources, output)) {
+            return false;
+        }
+
+        RuleBlobHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = RULE_BLOB_MAGIC;
+        header.version = RULE_BLOB_VERSION;
+        header.header_size = sizeof(RuleBlobHeader);
+        header.rules_fingerprint = rules_fingerprint;
+
+        std::vector<std::string> paths = sources.all();
+        for (size_t i = 0; i < RULE_BLOB_SOURCES; i++) {
+            RuleBlobSource& source = header.sources[i];
+            source.present = RuleSetBlob::content_hash(paths[i], source.content_hash) ? 1 : 0;
+            source.name = compiler.add_string(paths[i]);
+        }
+
+        std::vector<byte> blob(sizeof(RuleBlobHeader), 0);
+        append_section(blob, header.sections[RULE_SECTION_X86_DEFS], compiler.x86_defs.data(), compiler.x86_defs.size());
+        append_section(blob, header.sections[RULE_SECTION_ARM_DEFS], compiler.arm_defs.data(), compiler.arm_defs.size());
+        append_section(blob, header.sections[RULE_SECTION_TRANSLATIONS], compiler.translations.data(),
+                       compiler.translations.size());
+        append_section(blob, header.sections[RULE_SECTION_ARM_OPCODES], compiler.arm_opcodes.data(),
+                       compiler.arm_opcodes.size());
+        append_section(blob, header.sections[RULE_SECTION_REGISTERS], compiler.registers.data(), compiler.registers.size());
+        append_section(blob, header.sections[RULE_SECTION_PATTERNS], compiler.patterns.data(), compiler.patterns.size());
+        append_section(blob, header.sections[RULE_SECTION_PATTERN_BYTES], compiler.pattern_bytes.data(),
+                       compiler.pattern_bytes.size());
+        append_section(blob, header.sections[RULE_SECTION_STRINGS], compiler.strings.data(), compiler.strings.size());
+
+        header.total_size = blob.size();
+        header.checksum = XXH64(blob.data() + sizeof(RuleBlobHeader), blob.size() - sizeof(RuleBlobHeader), 0);
+        memcpy(blob.data(), &header, sizeof(header));
+
+        if (!replace_file(output, reinterpret_cast<const char*>(blob.data()), blob.size())) {
+            return false;
+        }
+
+        std::cout << "Regole compilate in " << output << ": " << compiler.arm_defs.size() << " definizioni ARM, "
+                  << compiler.registers.size() << " registri, " << compiler.patterns.size() << " pattern ("
+                  << blob.size() << " byte)" << std::endl;
+        return true;
+    }
+
+    // Genera l'header C++ delle regole statiche (ROTHECA_STATIC_RULES): tabelle
+    // constexpr delle definizioni x86 e, per ogni opcode con una regola, una
+    // specializzazione di StaticRule che scrive direttamente la sequenza ARM,
+    // raggiunta da uno switch che il compilatore può espandere in linea
+    static bool generate_static_tables(const RuleSourceFiles& sources, uint64_t rules_fingerprint,
+                                       const std::string& output) {
+        RuleSetCompiler compiler;
+        if (!compiler.parse_sources(sources, output)) {
+            return false;
+        }
+
+        uint32_t max_rule_length = 1;
+        size_t rule_count = 0;
+        for (const auto& rule : compiler.translations) {
+            max_rule_length = std::max(max_rule_length, rule.opcode_count);
+            rule_count += rule.opcode_count > 0;
+        }
+
+        std::ostringstream out;
+        out << "/**\n"
+            << " * " << std::filesystem::path(output).filename().string()
+            << " - Regole di traduzione statiche di Mini-Rosetta\n"
+            << " *\n"
+            << " * Generato da 'rotheca --generate-rule-tables' a partire da " << sources.x86_defs << " e "
+            << sources.translation_rules << ":\n"
+            << " * non modificare a mano, rigenerare dopo ogni modifica delle regole.\n"
+            << " */\n\n"
+            << "#ifndef RULES_STATIC_H\n"
+            << "#define RULES_STATIC_H\n\n"
+            << "#include <cstddef>\n"
+            << "#include <cstdint>\n\n"
+            << "namespace static_rules {\n\n"
+            << "constexpr uint64_t RULES_FINGERPRINT = " << hex(rules_fingerprint, 16) << ";\n"
+            << "constexpr size_t MAX_RULE_LENGTH = " << max_rule_length << ";\n\n"
+            << "struct X86Def {\n"
+            << "    bool present;\n"
+            << "    uint8_t flags;            // RULE_X86_*\n"
+            << "    const char* mnemonic;\n"
+            << "};\n\n"
+            << "constexpr X86Def X86_DEFS[256] = {\n";
+        for (size_t opcode = 0; opcode < 256; opcode++) {
+            const RuleBlobX86Def& def = compiler.x86_defs[opcode];
+            if (def.present) {
+                out << "    {true, " << hex(def.flags, 2) << ", " << compiler.quoted(def.mnemonic) << "},  // "
+                    << hex(opcode, 2) << "\n";
+            } else {
+                out << "    {false, 0x00, \"UNKNOWN\"},\n";
+            }
+        }
+        out << "};\n\n"
+            << "// Sequenza ARM della regola di un opcode x86: emit scrive MAX_RULE_LENGTH\n"
+            << "// istruzioni al più e restituisce quante ne ha scritte\n"
+            << "template <uint8_t Opcode>\n"
+            << "struct StaticRule {\n"
+            << "    static constexpr bool defined = false;\n"
+            << "};\n";
+        for (size_t opcode = 0; opcode < 256; opcode++) {
+            const RuleBlobTranslation& rule = compiler.translations[opcode];
+            if (rule.opcode_count == 0) {
+                continue;
+            }
+            out << "\n";
+            if (rule.description != 0) {
+                // Un backslash finale continuerebbe il commento sulla riga successiva
+                std::string description = compiler.strings.c_str() + rule.description;
+                while (!description.empty() && description.back() == '\\') {
+                    description.pop_back();
+                }
+                out << "// " << description << "\n";
+            }
+            out << "template <>\n"
+                << "struct StaticRule<" << hex(opcode, 2) << "> {\n"
+                << "    static constexpr bool defined = true;\n"
+                << "    static constexpr size_t length = " << rule.opcode_count << ";\n"
+                << "    static inline size_t emit(uint32_t* out) {\n";
+            for (uint32_t i = 0; i < rule.opcode_count; i++) {
+                out << "        out[" << i << "] = " << hex(compiler.arm_opcodes[rule.first_opcode + i], 8) << ";\n";
+            }
+            out << "        return length;\n"
+                << "    }\n"
+                << "};\n";
+        }
+        out << "\n"
+            << "// Traduce un opcode x86; 0 se non c'è una regola\n"
+            << "inline size_t emit_translation(uint8_t opcode, uint32_t* out) {\n"
+            << "    switch (opcode) {\n";
+        for (size_t opcode = 0; opcode < 256; opcode++) {
+            if (compiler.translations[opcode].opcode_count > 0) {
+                out << "    case " << hex(opcode, 2) << ": return StaticRule<" << hex(opcode, 2) << ">::emit(out);\n";
+            }
+        }
+        out << "    default: return 0;\n"
+            << "    }\n"
+            << "}\n\n"
+            << "} // namespace static_rules\n\n"
+            << "#endif // RULES_STATIC_H\n";
+
+        std::string source = out.str();
+        if (!replace_file(output, source.data(), source.size())) {
+            return false;
+        }
+
+        std::cout << "Tabelle statiche generate in " << output << ": " << rule_count << " regole di traduzione"
+                  << std::endl;
+        return true;
+    }
+};
+
+// Regole statiche generate da RuleSetCompiler::generate_static_tables
+#ifdef ROTHECA_STATIC_RULES
+#if __has_include("rules-static.h")
+#include "rules-static.h"
+#else
+#error "ROTHECA_STATIC_RULES richiede rules-static.h: generarlo con 'rotheca --generate-rule-tables'"
+#endif
+#endif
+
+#endif // RULES_BLOB_H